@@ -11,510 +11,8578 @@
 #include <stdexcept>
 #include <chrono>
 #include <thread>
-#include <functional> // For std::function if needed (not strictly used here yet)
+#include <functional> // For std::function (thread pool tasks)
 #include <utility> // For std::move
+#include <tuple> // For StaticFlow node storage
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <exception> // For std::exception_ptr
+#include <algorithm>
+#include <queue> // For the event loop timer heap
+#include <string_view>
+#include <cstdint>
+#include <initializer_list>
+#include <array>
+#include <unordered_map>
+#include <list> // For memo cache LRU order
+#include <filesystem> // For truncating checkpoint logs
+#include <typeindex>
+#include <shared_mutex>
+#include <cstring>
+#include <cstdio> // For trace export formatting
+#include <typeinfo>
+#include <memory_resource> // For per-run arenas
+#include <cstddef>
+#include <new> // For aligned inference buffers
+#include <cmath>
+#include <random> // For retry jitter
+#if defined(__linux__)
+#include <pthread.h> // For pinning executor threads
+#include <sched.h>
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+#define COGNITOFLOW_HAS_MMAP 1
+#include <fcntl.h> // For memory-mapped snapshots
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define COGNITOFLOW_HAS_MMAP 0
+#endif
+// Inference kernels: x86 ones are compiled per function with target attributes and
+// picked at runtime; NEON is part of the aarch64 baseline
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define COGNITOFLOW_X86_SIMD 1
+#include <immintrin.h>
+#else
+#define COGNITOFLOW_X86_SIMD 0
+#endif
+#if defined(__ARM_NEON)
+#define COGNITOFLOW_NEON_SIMD 1
+#include <arm_neon.h>
+#else
+#define COGNITOFLOW_NEON_SIMD 0
+#endif
 
 namespace cognitoflow {
 
-// --- Type Definitions ---
-using Context = std::map<std::string, std::any>;
-using Params = std::map<std::string, std::any>;
+// --- Context Keys ---
+namespace detail {
+    // FNV-1a over `key`, continuing from `hash`: hashKeyFrom(hashKey(a), b) == hashKey(a + b)
+    constexpr std::uint64_t hashKeyFrom(std::uint64_t hash, std::string_view key) {
+        for (char c : key) {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
 
-// --- Constants ---
-// Use std::nullopt to represent the default action instead of a magic string
-// static const std::string DEFAULT_ACTION = "default"; // Optional: if you prefer explicit string
+    // FNV-1a; constexpr so keys built from literals are hashed at compile time
+    constexpr std::uint64_t hashKey(std::string_view key) {
+        return hashKeyFrom(14695981039346656037ull, key);
+    }
+} // namespace detail
 
-// --- Utility Functions ---
-inline void logWarn(const std::string& message) {
-    std::cerr << "WARN: CognitoFlow - " << message << std::endl;
-}
+// Typed, pre-hashed context key, e.g. `ContextKey<int> currentValue{"currentValue"}`.
+// The name is not copied: build keys from string literals or other long-lived strings.
+template <typename T>
+class ContextKey {
+    std::string_view keyName;
+    std::uint64_t keyHash;
 
-// --- Custom Exception ---
-class CognitoFlowException : public std::runtime_error {
 public:
-    CognitoFlowException(const std::string& message) : std::runtime_error(message) {}
-    CognitoFlowException(const std::string& message, const std::exception& cause)
-        : std::runtime_error(message + " (Caused by: " + cause.what() + ")") {} // Simple cause handling
-};
+    constexpr explicit ContextKey(std::string_view name) : keyName(name), keyHash(detail::hashKey(name)) {}
 
+    constexpr std::string_view name() const { return keyName; }
+    constexpr std::uint64_t hash() const { return keyHash; }
+};
 
-// --- Forward Declarations ---
-class IBaseNode; // Non-templated base interface
 
-// --- Base Node Interface (Non-Templated) ---
-// Needed to store heterogeneous node types in successors map
-class IBaseNode {
-public:
-    virtual ~IBaseNode() = default; // IMPORTANT: Virtual destructor
+// --- Access Taps ---
+class Context;
+class Params;
 
-    virtual void setParamsInternal(const Params& params) = 0;
-    virtual std::optional<std::string> internalRun(Context& sharedContext) = 0;
-    virtual std::shared_ptr<IBaseNode> getNextNode(const std::optional<std::string>& action) const = 0;
-    virtual bool hasSuccessors() const = 0;
-    virtual const std::string& getClassName() const = 0; // For logging
+namespace detail {
+    class IncrementalState;
 
-    // Simplified next chaining accepting any IBaseNode. More type-safe versions
-    // can be added in the templated BaseNode.
-    virtual std::shared_ptr<IBaseNode> next(std::shared_ptr<IBaseNode> node, const std::string& action) = 0;
-    virtual std::shared_ptr<IBaseNode> next(std::shared_ptr<IBaseNode> node) = 0; // Default action
+    // Observer of the context and param accesses made on this thread; incremental flows
+    // install one around each node to learn what it read and wrote. Taps nest, and each
+    // forwards to the tap that was active before it.
+    class AccessTap {
+    public:
+        virtual ~AccessTap() = default;
+        // `value` is the entry before the access (nullptr if absent)
+        virtual void contextRead(const Context& context, std::string_view key, const std::any* value, std::uint64_t version) = 0;
+        virtual void contextWrite(const Context& context, std::string_view key) = 0;
+        // Copied, moved, iterated or cleared as a whole
+        virtual void contextWhole(const Context& context) = 0;
+        virtual void paramRead(std::string_view key, const std::any* value) = 0;
+        virtual void paramsWhole() = 0;
+    };
 
-    // Allow getting params (e.g., for result capture in tests)
-    virtual const Params& getParams() const = 0;
-};
+    inline AccessTap*& accessTap() {
+        thread_local AccessTap* active = nullptr;
+        return active;
+    }
 
+    // High half of a context's version stamps; unique per context copy, so stamps of
+    // unrelated contexts never collide
+    inline std::uint64_t newContextEpoch() {
+        static std::atomic<std::uint64_t> epochs{0};
+        return (epochs.fetch_add(1, std::memory_order_relaxed) + 1) << 32;
+    }
+} // namespace detail
 
-// --- Base Node Template ---
-template <typename P, typename E>
-class BaseNode : public IBaseNode {
-protected:
-    Params params;
-    std::map<std::string, std::shared_ptr<IBaseNode>> successors;
-    std::string className = typeid(*this).name(); // Store class name approximation
 
+// --- Context ---
+// Shared data store passed through a flow. Entries live in a dense vector (iteration
+// follows insertion order until an erase) indexed by an open-addressing hash table.
+// The string-keyed API mirrors the std::map subset nodes use (operator[], at, find,
+// count, erase, iteration over entry.first/entry.second); ContextKey<T> lookups skip
+// hashing and type-check with a pointer any_cast. Values stay std::any so existing
+// std::any_cast call sites keep working; std::any stores small trivially movable
+// values (int, double, pointers) inline. Every assignment through operator[], set or
+// insert_or_assign gives the entry a new version(); references returned by at(),
+// find() and getIf() are for reading.
+class Context {
 public:
-    virtual ~BaseNode() override = default;
+    struct Entry {
+        std::string first;  // Key; do not modify through an iterator
+        std::any second;    // Value
+    };
+    using iterator = std::pmr::vector<Entry>::iterator;
+    using const_iterator = std::pmr::vector<Entry>::const_iterator;
+    using size_type = std::size_t;
 
-    // --- Configuration ---
-    // Returns *this reference to allow chaining like Java, but less common in C++
-    BaseNode<P, E>& setParams(const Params& newParams) {
-        params = newParams; // Creates a copy
+private:
+    static constexpr std::uint32_t EMPTY_SLOT = 0xFFFFFFFFu;
+
+    struct Slot {
+        std::uint32_t entry = EMPTY_SLOT; // Index into entries
+        std::uint32_t hashTag = 0;        // Low hash bits, checked before comparing strings
+    };
+
+    // Storage comes from a polymorphic resource so a run's scratch context can live in
+    // its RunArena. Copies always use the default resource; keys longer than the small
+    // string buffer and std::any payloads that are not stored inline use the global heap.
+    std::pmr::vector<Entry> entries;
+    std::pmr::vector<std::uint64_t> hashes; // Parallel to entries
+    std::pmr::vector<std::uint64_t> versions; // Parallel to entries
+    std::pmr::vector<Slot> slots;           // Power-of-two capacity, at most half full
+    std::uint64_t clock = 0;                // Last version stamp; 0 = no epoch drawn yet
+    std::string keyPrefix;                  // Current namespace; prepended to every key
+    std::uint64_t prefixHash = detail::hashKey("");
+
+    friend class detail::IncrementalState;
+
+public:
+    Context() = default;
+    explicit Context(std::pmr::memory_resource* resource) : entries(resource), hashes(resource), versions(resource), slots(resource) {}
+    Context(const Context& other, std::pmr::memory_resource* resource)
+        : entries(other.entries, resource), hashes(other.hashes, resource), versions(other.versions, resource), slots(other.slots, resource),
+          keyPrefix(other.keyPrefix), prefixHash(other.prefixHash) {
+        noteWhole(other);
+    }
+    // Copies keep the entries' versions but stamp later writes from a fresh epoch
+    Context(const Context& other)
+        : entries(other.entries), hashes(other.hashes), versions(other.versions), slots(other.slots),
+          keyPrefix(other.keyPrefix), prefixHash(other.prefixHash) {
+        noteWhole(other);
+    }
+    Context(Context&& other) // Keeps the source's resource
+        : entries(std::move(other.entries)), hashes(std::move(other.hashes)), versions(std::move(other.versions)),
+          slots(std::move(other.slots)), clock(other.clock), keyPrefix(std::move(other.keyPrefix)), prefixHash(other.prefixHash) {
+        noteWhole(other);
+        other.clock = 0;
+    }
+    Context& operator=(const Context& other) {
+        if (this == &other) return *this;
+        noteWhole(other);
+        noteWhole(*this);
+        entries = other.entries;
+        hashes = other.hashes;
+        versions = other.versions;
+        slots = other.slots;
+        clock = 0; // The namespace is kept: assignment replaces the entries, not the view
         return *this;
     }
-
-    // Override from IBaseNode
-    void setParamsInternal(const Params& newParams) override {
-        params = newParams;
+    Context& operator=(Context&& other) {
+        if (this == &other) return *this;
+        noteWhole(other);
+        noteWhole(*this);
+        entries = std::move(other.entries);
+        hashes = std::move(other.hashes);
+        versions = std::move(other.versions);
+        slots = std::move(other.slots);
+        clock = other.clock;
+        other.clock = 0;
+        return *this;
+    }
+    Context(std::initializer_list<std::pair<std::string, std::any>> init) {
+        reserve(init.size());
+        for (const auto& item : init) insert_or_assign(item.first, item.second);
     }
 
-    const Params& getParams() const override {
-        return params;
+    // --- String-keyed API (std::map compatible subset) ---
+    std::any& operator[](std::string_view key) {
+        return entries[writeSlot(key, keyHash(key))].second;
     }
 
-    // --- Chaining ---
-    // Templated next for potential type checking at connection time if needed,
-    // but primarily delegates to the IBaseNode interface version.
-    template <typename NEXT_P, typename NEXT_E>
-    std::shared_ptr<BaseNode<NEXT_P, NEXT_E>> next(std::shared_ptr<BaseNode<NEXT_P, NEXT_E>> node, const std::string& action) {
-        if (!node) {
-            throw std::invalid_argument("Successor node cannot be null");
-        }
-        if (successors.count(action)) {
-            logWarn("Overwriting successor for action '" + action + "' in node " + getClassName());
-        }
-        successors[action] = node; // Implicit cast to shared_ptr<IBaseNode>
-        return node;
+    std::any& at(std::string_view key) {
+        std::size_t index = readSlot(key, keyHash(key));
+        if (index == npos()) throw std::out_of_range("Context has no key '" + std::string(key) + "'");
+        return entries[index].second;
     }
 
-    template <typename NEXT_P, typename NEXT_E>
-    std::shared_ptr<BaseNode<NEXT_P, NEXT_E>> next(std::shared_ptr<BaseNode<NEXT_P, NEXT_E>> node) {
-        // Use "" or a specific constant internally to represent the default action key
-        return next(node, ""); // Empty string as internal key for default
+    const std::any& at(std::string_view key) const {
+        std::size_t index = readSlot(key, keyHash(key));
+        if (index == npos()) throw std::out_of_range("Context has no key '" + std::string(key) + "'");
+        return entries[index].second;
     }
 
-    // IBaseNode implementation for next (needed for polymorphism)
-    std::shared_ptr<IBaseNode> next(std::shared_ptr<IBaseNode> node, const std::string& action) override {
-         if (!node) {
-            throw std::invalid_argument("Successor node cannot be null");
-        }
-        if (successors.count(action)) {
-            logWarn("Overwriting successor for action '" + action + "' in node " + getClassName());
-        }
-        successors[action] = node;
-        return node; // Return the base interface pointer
+    iterator find(std::string_view key) {
+        std::size_t index = readSlot(key, keyHash(key));
+        return index == npos() ? entries.end() : entries.begin() + static_cast<std::ptrdiff_t>(index);
     }
 
-    std::shared_ptr<IBaseNode> next(std::shared_ptr<IBaseNode> node) override {
-        return next(node, ""); // Empty string for default
+    const_iterator find(std::string_view key) const {
+        std::size_t index = readSlot(key, keyHash(key));
+        return index == npos() ? entries.end() : entries.begin() + static_cast<std::ptrdiff_t>(index);
     }
 
+    size_type count(std::string_view key) const { return readSlot(key, keyHash(key)) == npos() ? 0 : 1; }
+    bool contains(std::string_view key) const { return count(key) != 0; }
 
-    // --- Core Methods (to be implemented by subclasses) ---
-    virtual P prep(Context& sharedContext) {
-        // Default implementation returns default-constructed P
-        // Handle void case explicitly if needed, though default works ok.
-        if constexpr (std::is_same_v<P, void>) {
-             return; // Or handle differently if void needs special logic
-        } else {
-            return P{};
-        }
+    void insert_or_assign(std::string_view key, std::any value) {
+        entries[writeSlot(key, keyHash(key))].second = std::move(value);
     }
 
-    virtual E exec(P prepResult) = 0; // Pure virtual
+    size_type erase(std::string_view key) {
+        std::uint64_t hash = keyHash(key);
+        std::size_t index = lookup(key, hash, keyPrefix);
+        if (index == npos()) return 0;
+        if (detail::AccessTap* tap = detail::accessTap()) tap->contextWrite(*this, fullKey(key));
+        eraseAt(index, hash);
+        return 1;
+    }
 
-    virtual std::optional<std::string> post(Context& sharedContext, const P& prepResult, const E& execResult) {
-        // Default implementation returns nullopt (default action)
-        return std::nullopt;
+    iterator begin() { noteWhole(*this); return entries.begin(); }
+    iterator end() { return entries.end(); }
+    const_iterator begin() const { noteWhole(*this); return entries.begin(); }
+    const_iterator end() const { return entries.end(); }
+
+    size_type size() const { return entries.size(); }
+    bool empty() const { return entries.empty(); }
+
+    void clear() {
+        noteWhole(*this);
+        entries.clear();
+        hashes.clear();
+        versions.clear();
+        std::fill(slots.begin(), slots.end(), Slot{});
     }
 
-    // --- Internal Execution Logic ---
-protected:
-    // This internal method allows Node<P,E> to override execution with retries
-    virtual E internalExec(P prepResult) {
-        return exec(std::move(prepResult)); // Use move if P is movable
+    // Stamp of the entry's last assignment, 0 if the key is absent. Equal stamps mean
+    // the same value, also across copies of a context.
+    std::uint64_t version(std::string_view key) const {
+        std::size_t index = lookup(key, keyHash(key), keyPrefix);
+        return index == npos() ? 0 : versions[index];
     }
 
-public:
-    // IBaseNode implementation
-    std::optional<std::string> internalRun(Context& sharedContext) override {
-        P prepRes = prep(sharedContext);
-        E execRes = internalExec(std::move(prepRes)); // Use move if P is movable
-        // Need to handle void return type E potentially
-        if constexpr (std::is_same_v<E, void>) {
-             return post(sharedContext, prepRes, {}); // Pass dummy value for void E
-        } else {
-             return post(sharedContext, prepRes, execRes);
-        }
+    // Stamp of the entry at `position`, an iterator into this context
+    std::uint64_t version(const_iterator position) const {
+        return versions[static_cast<std::size_t>(position - entries.begin())];
     }
 
+    // --- Namespaces ---
+    // While a prefix is set, every keyed access refers to the entry named prefix + key,
+    // so a sub-flow's keys stay apart from its parent's without copying the context.
+    // Iteration, size() and copies still see all entries under their full names.
+    const std::string& keyNamespace() const { return keyPrefix; }
 
-    // --- Standalone Run ---
-    // Note: Return type matches internalRun now. The Java version returned String.
-    // Returning optional<string> seems more consistent here.
-    std::optional<std::string> run(Context& sharedContext) {
-        if (!successors.empty()) {
-            logWarn("Node " + getClassName() + " has successors, but run() was called. Successors won't be executed. Use Flow.");
-        }
-        return internalRun(sharedContext);
+    void setKeyNamespace(std::string prefix) {
+        keyPrefix = std::move(prefix);
+        prefixHash = detail::hashKey(keyPrefix);
     }
 
-    // --- Successor Retrieval (IBaseNode implementation) ---
-    std::shared_ptr<IBaseNode> getNextNode(const std::optional<std::string>& action) const override {
-        std::string actionKey = action.value_or(""); // Use "" for default action key
-        auto it = successors.find(actionKey);
-        if (it != successors.end()) {
-            return it->second;
-        } else {
-            if (!successors.empty()) {
-                std::string requestedAction = action.has_value() ? "'" + action.value() + "'" : "default";
-                std::string availableActions;
-                for(const auto& pair : successors) {
-                    availableActions += "'" + (pair.first.empty() ? "<default>" : pair.first) + "' ";
-                }
-                 logWarn("Flow might end: Action " + requestedAction + " not found in successors ["
-                         + availableActions + "] of node " + getClassName());
-            }
-            return nullptr; // No successor found
-        }
+    std::pmr::memory_resource* resource() const { return entries.get_allocator().resource(); }
+
+    void reserve(size_type count) {
+        entries.reserve(count);
+        hashes.reserve(count);
+        versions.reserve(count);
+        if (count * 2 > slots.size()) rehash(count * 2);
     }
 
-    bool hasSuccessors() const override {
-        return !successors.empty();
+    // --- Typed API ---
+    template <typename T>
+    void set(const ContextKey<T>& key, T value) {
+        entries[writeSlot(key.name(), keyHash(key))].second = std::move(value);
     }
 
-    const std::string& getClassName() const override {
-        // Return a potentially mangled name. Provide a way to set a clean name if needed.
-        // For now, use the stored approximation.
-        // A better way: Add a virtual getName() method overridden by each concrete node.
-        return className;
+    // nullptr if the key is missing or holds a different type
+    template <typename T>
+    T* getIf(const ContextKey<T>& key) {
+        std::size_t index = readSlot(key.name(), keyHash(key));
+        return index == npos() ? nullptr : std::any_cast<T>(&entries[index].second);
     }
 
-protected:
-     // Helper to safely get from map with default
-     template<typename T>
-     T getParamOrDefault(const std::string& key, T defaultValue) const {
-         auto it = params.find(key);
-         if (it != params.end()) {
-             try {
-                 return std::any_cast<T>(it->second);
-             } catch (const std::bad_any_cast& e) {
-                 // Log or handle cast error - return default for now
-                 logWarn("Bad any_cast for param '" + key + "' in node " + getClassName() + ". Expected different type.");
-                 return defaultValue;
-             }
-         }
-         return defaultValue;
-     }
-};
+    template <typename T>
+    const T* getIf(const ContextKey<T>& key) const {
+        std::size_t index = readSlot(key.name(), keyHash(key));
+        return index == npos() ? nullptr : std::any_cast<T>(&entries[index].second);
+    }
 
+    // Throws std::out_of_range if missing and std::bad_any_cast on a type mismatch
+    template <typename T>
+    T& at(const ContextKey<T>& key) {
+        std::size_t index = readSlot(key.name(), keyHash(key));
+        if (index == npos()) throw std::out_of_range("Context has no key '" + std::string(key.name()) + "'");
+        T* value = std::any_cast<T>(&entries[index].second);
+        if (!value) throw std::bad_any_cast();
+        return *value;
+    }
 
-// --- Synchronous Node with Retries ---
-template <typename P, typename E>
-class Node : public BaseNode<P, E> {
-protected:
-    int maxRetries;
-    long long waitMillis; // Use long long for milliseconds
-    int currentRetry = 0;
+    template <typename T>
+    const T& at(const ContextKey<T>& key) const {
+        return const_cast<Context*>(this)->at(key);
+    }
 
-public:
-    Node(int retries = 1, long long waitMilliseconds = 0)
-        : maxRetries(retries), waitMillis(waitMilliseconds) {
-        if (maxRetries < 1) throw std::invalid_argument("maxRetries must be at least 1");
-        if (waitMillis < 0) throw std::invalid_argument("waitMillis cannot be negative");
+    template <typename T>
+    T getOr(const ContextKey<T>& key, T defaultValue) const {
+        const T* value = getIf(key);
+        return value ? *value : defaultValue;
     }
 
-    virtual ~Node() override = default;
+    template <typename T>
+    bool contains(const ContextKey<T>& key) const { return readSlot(key.name(), keyHash(key)) != npos(); }
 
-    // Fallback method to be overridden if needed
-    virtual E execFallback(P prepResult, const std::exception& lastException) {
-        // Default behavior is to re-throw the last exception
-        throw CognitoFlowException("Node execution failed after " + std::to_string(maxRetries) + " retries, and fallback was not implemented or also failed.", lastException);
+    template <typename T>
+    size_type erase(const ContextKey<T>& key) {
+        std::uint64_t hash = keyHash(key);
+        std::size_t index = lookup(key.name(), hash, keyPrefix);
+        if (index == npos()) return 0;
+        if (detail::AccessTap* tap = detail::accessTap()) tap->contextWrite(*this, fullKey(key.name()));
+        eraseAt(index, hash);
+        return 1;
     }
 
-protected:
-    // Override internalExec to add retry logic
-    E internalExec(P prepResult) override {
-        std::unique_ptr<std::exception> lastExceptionPtr; // Store last exception
+private:
+    static constexpr std::size_t npos() { return static_cast<std::size_t>(-1); }
 
-        for (currentRetry = 0; currentRetry < maxRetries; ++currentRetry) {
-            try {
-                // Need to copy or move prepResult carefully if exec might modify it
-                // Assuming exec takes by value or const ref for simplicity here
-                // If P is expensive to copy, consider passing by ref and ensuring exec handles it.
-                return this->exec(prepResult); // Call the user-defined exec
-            } catch (const std::exception& e) {
-                // Using unique_ptr to manage exception polymorphism if needed,
-                // but storing a copy of the base std::exception might suffice.
-                // Let's store the last exception message simply for now.
-                // A better approach might involve exception_ptr.
-                // lastException = e; // Direct copy loses polymorphic type
+    std::size_t mask() const { return slots.size() - 1; }
 
-                // Store the exception *type* to rethrow properly or use std::exception_ptr
-                 try { throw; } // Rethrow to capture current exception
-                 catch (const std::exception& current_e) {
-                     // Store the exception to be used in fallback
-                      lastExceptionPtr = std::make_unique<std::runtime_error>(current_e.what()); // Store message
-                 }
+    std::uint64_t keyHash(std::string_view key) const {
+        return keyPrefix.empty() ? detail::hashKey(key) : detail::hashKeyFrom(prefixHash, key);
+    }
 
+    template <typename T>
+    std::uint64_t keyHash(const ContextKey<T>& key) const {
+        return keyPrefix.empty() ? key.hash() : detail::hashKeyFrom(prefixHash, key.name());
+    }
 
-                if (currentRetry < maxRetries - 1 && waitMillis > 0) {
-                    try {
-                        std::this_thread::sleep_for(std::chrono::milliseconds(waitMillis));
-                    } catch (...) {
-                        // Handle potential exceptions during sleep? Unlikely but possible.
-                        throw CognitoFlowException("Thread interrupted during retry wait", std::runtime_error("sleep interrupted"));
-                    }
-                }
-            } catch (...) { // Catch non-std exceptions if necessary
-                 lastExceptionPtr = std::make_unique<std::runtime_error>("Non-standard exception caught during exec");
-                 if (currentRetry < maxRetries - 1 && waitMillis > 0) {
-                     std::this_thread::sleep_for(std::chrono::milliseconds(waitMillis));
-                 }
-            }
-        }
+    // Name of the entry `key` refers to under the current namespace
+    std::string fullKey(std::string_view key) const {
+        std::string name(keyPrefix);
+        name.append(key);
+        return name;
+    }
 
-        // If loop finishes, all retries failed
-        try {
-            if (!lastExceptionPtr) {
-                 throw CognitoFlowException("Execution failed after retries, but no exception was captured.");
-            }
-             // Call fallback, passing a reference to the stored exception approximation
-            return execFallback(std::move(prepResult), *lastExceptionPtr);
-        } catch (const std::exception& fallbackException) {
-            // If fallback fails, throw appropriate exception
-             throw CognitoFlowException("Fallback execution failed after main exec retries failed.", fallbackException);
-        } catch (...) {
-             throw CognitoFlowException("Fallback execution failed with non-standard exception.", std::runtime_error("Unknown fallback error"));
+    void noteWhole(const Context& context) const {
+        if (detail::AccessTap* tap = detail::accessTap()) tap->contextWhole(context);
+    }
+
+    std::size_t readSlot(std::string_view key, std::uint64_t hash) const {
+        std::size_t index = lookup(key, hash, keyPrefix);
+        if (detail::AccessTap* tap = detail::accessTap()) {
+            tap->contextRead(*this, fullKey(key), index == npos() ? nullptr : &entries[index].second, index == npos() ? 0 : versions[index]);
         }
+        return index;
     }
-};
 
+    std::size_t writeSlot(std::string_view key, std::uint64_t hash) {
+        std::size_t index = findOrInsert(key, hash, keyPrefix);
+        if (detail::AccessTap* tap = detail::accessTap()) tap->contextWrite(*this, fullKey(key));
+        if (clock == 0) clock = detail::newContextEpoch();
+        versions[index] = ++clock;
+        return index;
+    }
 
-// --- Synchronous Batch Node ---
-template <typename IN_ITEM, typename OUT_ITEM>
-class BatchNode : public Node<std::vector<IN_ITEM>, std::vector<OUT_ITEM>> {
-public:
-    BatchNode(int retries = 1, long long waitMilliseconds = 0)
-        : Node<std::vector<IN_ITEM>, std::vector<OUT_ITEM>>(retries, waitMilliseconds) {}
+    // Index of the entry named prefix + key; `hash` is the hash of the whole name
+    std::size_t lookup(std::string_view key, std::uint64_t hash, std::string_view prefix = {}) const {
+        if (slots.empty()) return npos();
+        std::uint32_t tag = static_cast<std::uint32_t>(hash);
+        for (std::size_t pos = hash & mask();; pos = (pos + 1) & mask()) {
+            const Slot& slot = slots[pos];
+            if (slot.entry == EMPTY_SLOT) return npos();
+            if (slot.hashTag == tag && hashes[slot.entry] == hash && nameMatches(entries[slot.entry].first, prefix, key)) {
+                return slot.entry;
+            }
+        }
+    }
 
-    virtual ~BatchNode() override = default;
+    static bool nameMatches(const std::string& name, std::string_view prefix, std::string_view key) {
+        if (prefix.empty()) return name == key;
+        return name.size() == prefix.size() + key.size() && name.compare(0, prefix.size(), prefix) == 0
+            && name.compare(prefix.size(), key.size(), key) == 0;
+    }
 
-    // --- Methods for subclasses to implement ---
-    virtual OUT_ITEM execItem(const IN_ITEM& item) = 0; // Process a single item
+    std::size_t findOrInsert(std::string_view key, std::uint64_t hash, std::string_view prefix = {}) {
+        std::size_t existing = lookup(key, hash, prefix);
+        if (existing != npos()) return existing;
+        if ((entries.size() + 1) * 2 > slots.size()) {
+            rehash(std::max<std::size_t>(16, slots.size() * 2));
+        }
+        std::size_t index = entries.size();
+        std::string name;
+        name.reserve(prefix.size() + key.size());
+        name.append(prefix).append(key);
+        entries.push_back(Entry{std::move(name), std::any{}});
+        hashes.push_back(hash);
+        versions.push_back(0);
+        placeSlot(static_cast<std::uint32_t>(index), hash);
+        return index;
+    }
 
-    virtual OUT_ITEM execItemFallback(const IN_ITEM& item, const std::exception& lastException) {
-        // Default fallback re-throws
-         throw CognitoFlowException("Batch item execution failed after retries, and fallback was not implemented or also failed.", lastException);
+    void placeSlot(std::uint32_t entryIndex, std::uint64_t hash) {
+        std::size_t pos = hash & mask();
+        while (slots[pos].entry != EMPTY_SLOT) pos = (pos + 1) & mask();
+        slots[pos] = Slot{entryIndex, static_cast<std::uint32_t>(hash)};
     }
 
-    // --- Base class methods that MUST NOT be overridden by user ---
-    // Make exec final to prevent accidental override. User should implement execItem.
-    std::vector<OUT_ITEM> exec(std::vector<IN_ITEM> prepResult) final {
-        // This method is conceptually hidden by internalExec override below.
-        // We override internalExec directly.
-        throw std::logic_error("BatchNode::exec should not be called directly.");
+    void rehash(std::size_t minSlots) {
+        std::size_t capacity = 16;
+        while (capacity < minSlots) capacity *= 2;
+        slots.assign(capacity, Slot{});
+        for (std::size_t i = 0; i < entries.size(); ++i) {
+            placeSlot(static_cast<std::uint32_t>(i), hashes[i]);
+        }
     }
 
-     // Fallback for the whole batch (rarely needed if item fallback exists)
-     std::vector<OUT_ITEM> execFallback(std::vector<IN_ITEM> prepResult, const std::exception& lastException) final {
-         // This fallback applies if the *looping* itself fails, not individual items.
-         throw CognitoFlowException("BatchNode internal execution loop failed.", lastException);
-     }
+    std::size_t slotOf(std::uint32_t entryIndex, std::uint64_t hash) const {
+        std::size_t pos = hash & mask();
+        while (slots[pos].entry != entryIndex) pos = (pos + 1) & mask();
+        return pos;
+    }
 
+    // Backward-shift deletion keeps probe chains intact without tombstones; the last
+    // entry is moved into the freed position of the dense vector.
+    void eraseAt(std::size_t index, std::uint64_t hash) {
+        std::size_t hole = slotOf(static_cast<std::uint32_t>(index), hash);
+        for (std::size_t pos = (hole + 1) & mask(); slots[pos].entry != EMPTY_SLOT; pos = (pos + 1) & mask()) {
+            std::size_t home = hashes[slots[pos].entry] & mask();
+            // Move the slot back if its home position is not in the cyclic range (hole, pos]
+            bool homeInRange = hole <= pos ? (home > hole && home <= pos) : (home > hole || home <= pos);
+            if (!homeInRange) {
+                slots[hole] = slots[pos];
+                hole = pos;
+            }
+        }
+        slots[hole] = Slot{};
 
-protected:
-    // Override internalExec for batch processing logic
-    std::vector<OUT_ITEM> internalExec(std::vector<IN_ITEM> batchPrepResult) override {
-        if (batchPrepResult.empty()) {
-            return {};
+        std::size_t last = entries.size() - 1;
+        if (index != last) {
+            slots[slotOf(static_cast<std::uint32_t>(last), hashes[last])].entry = static_cast<std::uint32_t>(index);
+            entries[index] = std::move(entries[last]);
+            hashes[index] = hashes[last];
+            versions[index] = versions[last];
         }
+        entries.pop_back();
+        hashes.pop_back();
+        versions.pop_back();
+    }
+};
 
-        std::vector<OUT_ITEM> results;
-        results.reserve(batchPrepResult.size());
 
-        for (const auto& item : batchPrepResult) {
-             std::unique_ptr<std::exception> lastItemExceptionPtr;
-             bool itemSuccess = false;
-             OUT_ITEM itemResult{}; // Default construct
-
-             for (this->currentRetry = 0; this->currentRetry < this->maxRetries; ++this->currentRetry) {
-                 try {
-                     itemResult = execItem(item); // Call user implementation
-                     itemSuccess = true;
-                     break; // Success, exit retry loop for this item
-                 } catch (const std::exception& e) {
-                      try { throw; } catch(const std::exception& current_e) {
-                          lastItemExceptionPtr = std::make_unique<std::runtime_error>(current_e.what());
-                      }
-                     if (this->currentRetry < this->maxRetries - 1 && this->waitMillis > 0) {
-                         std::this_thread::sleep_for(std::chrono::milliseconds(this->waitMillis));
-                     }
-                 } catch (...) {
-                      lastItemExceptionPtr = std::make_unique<std::runtime_error>("Non-standard exception during execItem");
-                      if (this->currentRetry < this->maxRetries - 1 && this->waitMillis > 0) {
-                         std::this_thread::sleep_for(std::chrono::milliseconds(this->waitMillis));
-                      }
-                 }
-             } // End retry loop for item
-
-             if (!itemSuccess) {
-                 try {
-                     if (!lastItemExceptionPtr) {
-                         throw CognitoFlowException("Item execution failed without exception for item."); // Add item info if possible
-                     }
-                     itemResult = execItemFallback(item, *lastItemExceptionPtr); // Call user fallback
-                 } catch (const std::exception& fallbackEx) {
-                      throw CognitoFlowException("Item fallback execution failed.", fallbackEx); // Add item info if possible
-                 } catch (...) {
-                      throw CognitoFlowException("Item fallback failed with non-standard exception.", std::runtime_error("Unknown item fallback error"));
-                 }
-             }
-             results.push_back(std::move(itemResult)); // Move if possible
-        } // End loop over items
+// Enters a nested namespace of `context` for the scope's lifetime:
+//     ContextNamespace scope(ctx, "search/"); // ctx["query"] is now "search/query"
+class ContextNamespace {
+    Context& context;
+    std::string previous;
 
-        return results;
+public:
+    ContextNamespace(Context& scopedContext, std::string_view keyNamespace)
+        : context(scopedContext), previous(scopedContext.keyNamespace()) {
+        context.setKeyNamespace(previous + std::string(keyNamespace));
     }
+    ~ContextNamespace() { context.setKeyNamespace(std::move(previous)); }
+    ContextNamespace(const ContextNamespace&) = delete;
+    ContextNamespace& operator=(const ContextNamespace&) = delete;
 };
 
 
-/
-// --- Flow Orchestrator ---
-// Inherits from BaseNode with dummy types for consistency, but overrides run logic.
-// Using std::nullptr_t for unused P type.
-class Flow : public BaseNode<std::nullptr_t, std::optional<std::string>> {
-protected:
-    std::shared_ptr<IBaseNode> startNode = nullptr;
+// --- Params ---
+// Immutable-by-default parameter set with copy-on-write. Copying a Params only bumps
+// a reference count. layered(base, overrides) stacks the override layers on top of
+// the base without merging them, so a flow builds its run params once and BatchFlow
+// entries stack on the flow's params for the cost of one small allocation. Lookups
+// walk the layers top-down; writes (operator[], erase, insert_or_assign) first flatten
+// into a private map. Iteration and find() use a flattened view cached per layer.
+class Params {
+public:
+    using Map = std::map<std::string, std::any, std::less<>>;
+    using const_iterator = Map::const_iterator;
+    using iterator = const_iterator; // Entries are read-only; write through operator[]
+    using size_type = std::size_t;
+
+private:
+    struct Layer {
+        std::shared_ptr<Map> values;            // Shared between Params copies; never modified while shared
+        std::shared_ptr<const Layer> parent;    // Lower-precedence layers
+        mutable std::once_flag flattenOnce;
+        mutable std::shared_ptr<const Map> flat; // Cached merged view of this layer and its parents
+
+        Layer(std::shared_ptr<Map> layerValues, std::shared_ptr<const Layer> lower)
+            : values(std::move(layerValues)), parent(std::move(lower)) {}
+    };
+    std::shared_ptr<const Layer> top; // nullptr = empty
+
+    static const Map& emptyMap() {
+        static const Map empty;
+        return empty;
+    }
 
 public:
-    Flow() = default;
-    explicit Flow(std::shared_ptr<IBaseNode> start) { this->start(std::move(start)); }
-    virtual ~Flow() override = default;
+    Params() = default;
+    Params(std::initializer_list<std::pair<const std::string, std::any>> init)
+        : Params(Map(init)) {}
+    Params(Map values) {
+        if (!values.empty()) top = std::make_shared<Layer>(std::make_shared<Map>(std::move(values)), nullptr);
+    }
+    Params(const std::map<std::string, std::any>& values)
+        : Params(Map(values.begin(), values.end())) {}
+
+    // `overrides` take precedence over `base`; neither is copied
+    static Params layered(const Params& base, const Params& overrides) {
+        if (!overrides.top) return base;
+        if (!base.top) return overrides;
+        std::vector<const Layer*> overrideLayers;
+        for (const Layer* layer = overrides.top.get(); layer; layer = layer->parent.get()) {
+            overrideLayers.push_back(layer);
+        }
+        Params result = base;
+        for (auto it = overrideLayers.rbegin(); it != overrideLayers.rend(); ++it) {
+            result.top = std::make_shared<Layer>((*it)->values, result.top);
+        }
+        return result;
+    }
+
+    // --- Lookup ---
+    // nullptr if the key is absent; the fast path for reading a single param
+    const std::any* lookup(std::string_view key) const {
+        const std::any* value = findValue(key);
+        if (detail::AccessTap* tap = detail::accessTap()) tap->paramRead(key, value);
+        return value;
+    }
+
+    size_type count(std::string_view key) const { return lookup(key) ? 1 : 0; }
+    bool contains(std::string_view key) const { return lookup(key) != nullptr; }
+
+    const std::any& at(std::string_view key) const {
+        const std::any* value = lookup(key);
+        if (!value) throw std::out_of_range("Params has no key '" + std::string(key) + "'");
+        return *value;
+    }
+
+    // --- Flattened view ---
+    const Map& view() const {
+        if (detail::AccessTap* tap = detail::accessTap()) tap->paramsWhole();
+        if (!top) return emptyMap();
+        if (!top->parent) return *top->values;
+        std::call_once(top->flattenOnce, [this] { top->flat = std::make_shared<const Map>(flatten()); });
+        return *top->flat;
+    }
+
+    const_iterator find(std::string_view key) const { return view().find(key); }
+    const_iterator begin() const { return view().begin(); }
+    const_iterator end() const { return view().end(); }
+    size_type size() const { return view().size(); }
+    bool empty() const { return !top || view().empty(); }
+
+    // --- Writes (copy-on-write) ---
+    std::any& operator[](std::string_view key) {
+        Map& values = mutableValues();
+        auto it = values.find(key);
+        if (it == values.end()) it = values.emplace(std::string(key), std::any{}).first;
+        return it->second;
+    }
+
+    void insert_or_assign(std::string_view key, std::any value) {
+        (*this)[key] = std::move(value);
+    }
+
+    size_type erase(std::string_view key) {
+        if (!findValue(key)) return 0;
+        Map& values = mutableValues();
+        auto it = values.find(key);
+        values.erase(it);
+        return 1;
+    }
+
+    void clear() { top.reset(); }
+
+private:
+    friend class detail::IncrementalState;
+
+    const std::any* findValue(std::string_view key) const {
+        for (const Layer* layer = top.get(); layer; layer = layer->parent.get()) {
+            auto it = layer->values->find(key);
+            if (it != layer->values->end()) return &it->second;
+        }
+        return nullptr;
+    }
+
+    Map flatten() const {
+        Map merged;
+        for (const Layer* layer = top.get(); layer; layer = layer->parent.get()) {
+            merged.insert(layer->values->begin(), layer->values->end()); // Upper layers were inserted first and win
+        }
+        return merged;
+    }
+
+    // Ensures this object owns a single, unshared layer and returns its map
+    Map& mutableValues() {
+        bool unique = top && !top->parent && top.use_count() == 1 && top->values.use_count() == 1;
+        if (!unique) {
+            Map merged = flatten();
+            top = std::make_shared<Layer>(std::make_shared<Map>(std::move(merged)), nullptr);
+        }
+        // Sole owner, so no other Params can observe the change
+        Layer& layer = const_cast<Layer&>(*top);
+        layer.flat.reset();
+        return *layer.values;
+    }
+};
+
+// --- Payload ---
+// Shared, immutable ownership of a large prep or exec result (tensors, token buffers).
+// Copying a Payload copies a pointer, so with Payload<T> as P or E the value is
+// materialized once per run and every exec attempt, the fallback, post and the
+// context share it: Node<Payload<Tensor>, Payload<Logits>>. prep() can simply
+// `return tensor;` (moved in) or `return Payload<Tensor>::make(args...);`.
+template <typename T>
+class Payload {
+    std::shared_ptr<const T> value;
+
+public:
+    Payload() = default; // Empty
+    Payload(T payload) : value(std::make_shared<const T>(std::move(payload))) {}
+    explicit Payload(std::shared_ptr<const T> shared) : value(std::move(shared)) {}
+
+    template <typename... Args>
+    static Payload make(Args&&... args) {
+        return Payload(std::shared_ptr<const T>(std::make_shared<const T>(std::forward<Args>(args)...)));
+    }
+
+    const T& get() const {
+        if (!value) throw std::logic_error("Payload is empty");
+        return *value;
+    }
+    const T& operator*() const { return get(); }
+    const T* operator->() const { return &get(); }
+
+    bool empty() const { return !value; }
+    explicit operator bool() const { return static_cast<bool>(value); }
+
+    // The underlying shared pointer, e.g. to hand the value to another owner
+    const std::shared_ptr<const T>& shared() const { return value; }
+    long useCount() const { return value.use_count(); }
+};
+
+// --- Constants ---
+// Use std::nullopt to represent the default action instead of a magic string
+// static const std::string DEFAULT_ACTION = "default"; // Optional: if you prefer explicit string
+
+// --- Logging ---
+// Log calls only enqueue: messages go into a bounded lock-free ring that a background
+// thread drains into the current LogSink, so callers never hold the stderr lock or
+// wait for a flush. When the ring is full the message is dropped and counted. Hot call
+// sites pass a static LogSite and a formatter lambda; the message is then built only
+// if the level is enabled and the site is within its per-second rate limit.
+enum class LogLevel : int { Debug, Info, Warn, Error, Off };
+
+inline const char* logLevelName(LogLevel level) {
+    switch (level) {
+        case LogLevel::Debug: return "DEBUG";
+        case LogLevel::Info: return "INFO";
+        case LogLevel::Warn: return "WARN";
+        case LogLevel::Error: return "ERROR";
+        default: return "OFF";
+    }
+}
+
+// Receives messages on the logger thread (or the caller's, in synchronous mode)
+class LogSink {
+public:
+    virtual ~LogSink() = default;
+    virtual void write(LogLevel level, const std::string& message) = 0;
+    virtual void flush() {} // Called after each drained batch
+};
+
+class StderrLogSink : public LogSink {
+public:
+    void write(LogLevel level, const std::string& message) override {
+        std::cerr << logLevelName(level) << ": CognitoFlow - " << message << '\n';
+    }
+    void flush() override { std::cerr.flush(); }
+};
+
+// Rate-limit state of one call site; declare it `static` next to the log call
+class LogSite {
+    std::atomic<std::int64_t> windowStart{INT64_MIN / 2};
+    std::atomic<std::uint32_t> inWindow{0};
+    std::atomic<std::uint32_t> suppressed{0};
+
+public:
+    // False if the message should be dropped. On the first message of a new one-second
+    // window `suppressedBefore` receives how many were dropped in the previous ones.
+    bool admit(std::uint32_t perSecond, std::uint32_t& suppressedBefore) {
+        if (perSecond == 0) return true;
+        std::int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        std::int64_t start = windowStart.load(std::memory_order_relaxed);
+        if (now - start >= 1000 && windowStart.compare_exchange_strong(start, now, std::memory_order_relaxed)) {
+            inWindow.store(0, std::memory_order_relaxed);
+            suppressedBefore = suppressed.exchange(0, std::memory_order_relaxed);
+        }
+        if (inWindow.fetch_add(1, std::memory_order_relaxed) < perSecond) return true;
+        suppressed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+};
+
+class Logger {
+    struct Cell {
+        std::atomic<std::size_t> sequence{0};
+        LogLevel level = LogLevel::Info;
+        std::string message;
+    };
+
+    // Bounded multi-producer ring (Vyukov); the logger thread is the only consumer
+    static constexpr std::size_t CAPACITY = 8192;
+    std::unique_ptr<Cell[]> cells{new Cell[CAPACITY]};
+    std::atomic<std::size_t> enqueuePos{0};
+    std::atomic<std::size_t> dequeuePos{0};
+
+    std::atomic<int> minLevel{static_cast<int>(LogLevel::Warn)};
+    std::atomic<std::uint32_t> perSiteLimit{10};
+    std::atomic<bool> synchronous{false};
+    std::atomic<std::uint64_t> dropped{0};
+    std::shared_ptr<LogSink> sink = std::make_shared<StderrLogSink>(); // Read with std::atomic_load
+
+    std::once_flag startOnce;
+    std::thread worker;
+    std::mutex wakeMutex;
+    std::condition_variable wakeCondition;
+    std::condition_variable drainedCondition;
+    std::atomic<bool> workerSleeping{false};
+    std::mutex syncWriteMutex;
+
+    Logger() {
+        for (std::size_t i = 0; i < CAPACITY; ++i) cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+public:
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
+    static Logger& instance() {
+        // Never destroyed, so threads can log during static destruction; pending
+        // messages are flushed when the program exits normally.
+        static Logger* logger = new Logger();
+        struct FlushAtExit { ~FlushAtExit() { Logger::instance().flush(); } };
+        static FlushAtExit flushAtExit;
+        return *logger;
+    }
+
+    void setLevel(LogLevel level) { minLevel.store(static_cast<int>(level), std::memory_order_relaxed); }
+    LogLevel getLevel() const { return static_cast<LogLevel>(minLevel.load(std::memory_order_relaxed)); }
+    bool isEnabled(LogLevel level) const {
+        return level != LogLevel::Off && static_cast<int>(level) >= minLevel.load(std::memory_order_relaxed);
+    }
+
+    // Messages per second each LogSite may emit (0 = unlimited). Defaults to 10.
+    void setRateLimit(std::uint32_t messagesPerSecondPerSite) { perSiteLimit.store(messagesPerSecondPerSite, std::memory_order_relaxed); }
+
+    void setSink(std::shared_ptr<LogSink> newSink) {
+        if (!newSink) throw std::invalid_argument("Log sink cannot be null");
+        std::atomic_store(&sink, std::move(newSink));
+    }
+
+    // Synchronous mode writes on the calling thread, e.g. for tests or crash-time logging
+    void setSynchronous(bool writeOnCaller) { synchronous.store(writeOnCaller, std::memory_order_relaxed); }
+
+    // Messages lost because the ring was full
+    std::uint64_t droppedCount() const { return dropped.load(std::memory_order_relaxed); }
+
+    void log(LogLevel level, std::string message) {
+        if (!isEnabled(level)) return;
+        if (synchronous.load(std::memory_order_relaxed)) {
+            std::shared_ptr<LogSink> target = std::atomic_load(&sink);
+            std::lock_guard<std::mutex> lock(syncWriteMutex);
+            target->write(level, message);
+            target->flush();
+            return;
+        }
+        std::call_once(startOnce, [this] { worker = std::thread([this] { drainLoop(); }); });
+        if (!tryPush(level, std::move(message))) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        if (workerSleeping.load()) {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            wakeCondition.notify_one();
+        }
+    }
+
+    // Formats the message only if `level` is enabled and `site` is within its rate limit
+    template <typename F>
+    void log(LogSite& site, LogLevel level, F&& makeMessage) {
+        if (!isEnabled(level)) return;
+        std::uint32_t suppressed = 0;
+        if (!site.admit(perSiteLimit.load(std::memory_order_relaxed), suppressed)) return;
+        std::string message = makeMessage();
+        if (suppressed) message += " (" + std::to_string(suppressed) + " similar messages suppressed)";
+        log(level, std::move(message));
+    }
+
+    // Blocks until every message enqueued before the call has reached the sink
+    void flush() {
+        std::size_t target = enqueuePos.load();
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        if (!worker.joinable()) return;
+        wakeCondition.notify_one();
+        while (dequeuePos.load() < target) {
+            drainedCondition.wait_for(lock, std::chrono::milliseconds(10));
+        }
+    }
+
+private:
+    bool tryPush(LogLevel level, std::string&& message) {
+        std::size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells[pos % CAPACITY];
+            std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.level = level;
+                    cell.message = std::move(message);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // Full
+            } else {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool tryPop(LogLevel& level, std::string& message) {
+        std::size_t pos = dequeuePos.load(std::memory_order_relaxed);
+        Cell& cell = cells[pos % CAPACITY];
+        if (cell.sequence.load(std::memory_order_acquire) != pos + 1) return false;
+        level = cell.level;
+        message.swap(cell.message);
+        cell.message.clear();
+        cell.sequence.store(pos + CAPACITY, std::memory_order_release);
+        dequeuePos.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    void drainLoop() {
+        std::uint64_t reportedDrops = 0;
+        LogLevel level;
+        std::string message;
+        for (;;) {
+            std::shared_ptr<LogSink> target = std::atomic_load(&sink);
+            bool wrote = false;
+            while (tryPop(level, message)) {
+                target->write(level, message);
+                wrote = true;
+            }
+            std::uint64_t drops = dropped.load(std::memory_order_relaxed);
+            if (drops != reportedDrops) {
+                target->write(LogLevel::Warn, std::to_string(drops - reportedDrops) + " log messages dropped (queue full)");
+                reportedDrops = drops;
+                wrote = true;
+            }
+            if (wrote) target->flush();
+
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            drainedCondition.notify_all();
+            workerSleeping.store(true);
+            if (dequeuePos.load() == enqueuePos.load()) {
+                wakeCondition.wait_for(lock, std::chrono::milliseconds(50));
+            }
+            workerSleeping.store(false);
+        }
+    }
+};
+
+inline void logWarn(const std::string& message) {
+    Logger::instance().log(LogLevel::Warn, message);
+}
+
+// Lazy, rate-limited form for hot paths:
+//     static LogSite site;
+//     logWarn(site, [&] { return "Action " + action + " not found"; });
+template <typename F>
+void logWarn(LogSite& site, F&& makeMessage) {
+    Logger::instance().log(site, LogLevel::Warn, std::forward<F>(makeMessage));
+}
+
+// --- Graph Watchers ---
+namespace detail {
+    // Stale flags of the compiled graphs that contain one node. The node raises them
+    // when its successors (or, for a flow, how it may be inlined) change, so only the
+    // graphs built from it recompile. A copied node belongs to no graph yet.
+    class GraphWatchers {
+        std::mutex mutex;
+        std::vector<std::weak_ptr<std::atomic<bool>>> staleFlags;
+
+    public:
+        GraphWatchers() = default;
+        GraphWatchers(const GraphWatchers&) {}
+        GraphWatchers& operator=(const GraphWatchers&) { return *this; }
+
+        void add(const std::shared_ptr<std::atomic<bool>>& stale) {
+            std::lock_guard<std::mutex> lock(mutex);
+            staleFlags.erase(std::remove_if(staleFlags.begin(), staleFlags.end(),
+                                            [](const std::weak_ptr<std::atomic<bool>>& flag) { return flag.expired(); }),
+                             staleFlags.end());
+            staleFlags.push_back(stale);
+        }
+
+        void notify() {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (const auto& flag : staleFlags) {
+                if (std::shared_ptr<std::atomic<bool>> stale = flag.lock()) stale->store(true, std::memory_order_release);
+            }
+            staleFlags.clear(); // Each of those graphs is rebuilt, and registers again
+        }
+    };
+} // namespace detail
+
+
+// --- Run Arena ---
+// Monotonic memory for the temporary state of one flow run, released in one shot when
+// the run ends. Its first block comes from a per-thread pool and returns to it
+// afterwards; the pool remembers how much the largest run on that thread needed, so
+// steady-state runs get a block big enough to never fall back to the global heap.
+// A RunArena belongs to the thread that created it and is not thread-safe.
+class RunArena;
+
+namespace detail {
+    // Counts what a monotonic resource had to request beyond its initial block
+    class CountingResource : public std::pmr::memory_resource {
+        std::pmr::memory_resource* upstream;
+        std::size_t requested = 0;
+    public:
+        explicit CountingResource(std::pmr::memory_resource* next) : upstream(next) {}
+        std::size_t bytesRequested() const { return requested; }
+    private:
+        void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+            requested += bytes;
+            return upstream->allocate(bytes, alignment);
+        }
+        void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override {
+            upstream->deallocate(p, bytes, alignment);
+        }
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+    };
+
+    // Recycled arena blocks of the calling thread
+    class ArenaBlockPool {
+        static constexpr std::size_t MAX_BLOCKS = 4;
+        std::vector<std::pair<std::unique_ptr<std::byte[]>, std::size_t>> blocks;
+        std::size_t preferredSize = 0; // Largest footprint of a run on this thread
+
+    public:
+        static ArenaBlockPool& local() {
+            thread_local ArenaBlockPool pool;
+            return pool;
+        }
+
+        std::pair<std::unique_ptr<std::byte[]>, std::size_t> acquire(std::size_t minBytes) {
+            std::size_t wanted = std::max(minBytes, preferredSize);
+            for (auto it = blocks.begin(); it != blocks.end(); ++it) {
+                if (it->second >= wanted) {
+                    auto block = std::move(*it);
+                    blocks.erase(it);
+                    return block;
+                }
+            }
+            return {std::unique_ptr<std::byte[]>(new std::byte[wanted]), wanted};
+        }
+
+        void release(std::unique_ptr<std::byte[]> block, std::size_t size, std::size_t footprint) {
+            preferredSize = std::max(preferredSize, footprint);
+            if (size < preferredSize) return; // Too small for the next run; let it go
+            if (blocks.size() < MAX_BLOCKS) blocks.emplace_back(std::move(block), size);
+        }
+    };
+
+    inline RunArena*& currentArena() {
+        thread_local RunArena* active = nullptr;
+        return active;
+    }
+
+    class ScopedArena {
+        RunArena* previous;
+    public:
+        explicit ScopedArena(RunArena* arena) : previous(currentArena()) { currentArena() = arena; }
+        ~ScopedArena() { currentArena() = previous; }
+        ScopedArena(const ScopedArena&) = delete;
+        ScopedArena& operator=(const ScopedArena&) = delete;
+    };
+} // namespace detail
+
+class RunArena {
+    std::unique_ptr<std::byte[]> block;
+    std::size_t blockSize;
+    detail::CountingResource overflow{std::pmr::new_delete_resource()};
+    std::pmr::monotonic_buffer_resource monotonic;
+
+    static std::pair<std::unique_ptr<std::byte[]>, std::size_t> pooledBlock(std::size_t initialBytes) {
+        return detail::ArenaBlockPool::local().acquire(initialBytes);
+    }
+
+    explicit RunArena(std::pair<std::unique_ptr<std::byte[]>, std::size_t> pooled)
+        : block(std::move(pooled.first)), blockSize(pooled.second), monotonic(block.get(), blockSize, &overflow) {}
+
+public:
+    static constexpr std::size_t DEFAULT_BLOCK = 64 * 1024;
+    static constexpr std::size_t ITEM_BLOCK = 4 * 1024; // Parallel items running on other threads
+
+    explicit RunArena(std::size_t initialBytes = DEFAULT_BLOCK) : RunArena(pooledBlock(initialBytes)) {}
+
+    ~RunArena() {
+        monotonic.release();
+        detail::ArenaBlockPool::local().release(std::move(block), blockSize, blockSize + overflow.bytesRequested());
+    }
+
+    RunArena(const RunArena&) = delete;
+    RunArena& operator=(const RunArena&) = delete;
+
+    std::pmr::memory_resource* resource() { return &monotonic; }
+
+    // Bytes this run needed beyond its initial block (0 once the pool has warmed up)
+    std::size_t overflowBytes() const { return overflow.bytesRequested(); }
+
+    // Arena of the run executing on this thread, or the default resource outside one
+    static std::pmr::memory_resource* currentResource() {
+        RunArena* arena = detail::currentArena();
+        return arena ? arena->resource() : std::pmr::get_default_resource();
+    }
+};
+
+
+// --- Run Frame ---
+// Per-invocation state for stateless execution: the run's params, the retry counter
+// of the executing node and a scratch store for node-local data. A frame is passed
+// to IBaseNode::internalRun(Context&, RunFrame&) and is also reachable from inside
+// prep/exec/post via BaseNode::currentFrame(). While a frame is active, nodes read
+// params from it instead of their `params` member and orchestration never writes
+// node members, so one graph can serve many concurrent runs.
+class RunFrame {
+    Params runParams;
+    RunFrame* parentFrame;
+    int retry = 0;
+    Context scratchpad;
+
+public:
+    // Inside a run with a RunArena the scratch store allocates from the arena
+    explicit RunFrame(Params params = {}, RunFrame* parent = nullptr)
+        : runParams(std::move(params)), parentFrame(parent), scratchpad(RunArena::currentResource()) {}
+
+    RunFrame(const RunFrame&) = delete;
+    RunFrame& operator=(const RunFrame&) = delete;
+
+    const Params& params() const { return runParams; }
+    RunFrame* parent() const { return parentFrame; }
+
+    // Attempt index of the node currently executing in this frame
+    int& retryCounter() { return retry; }
+    int currentRetry() const { return retry; }
+
+    // Node-local data for this invocation; use instead of writing node members
+    Context& scratch() { return scratchpad; }
+
+    // Memory for temporaries that must not outlive the run (the run's arena, if any)
+    std::pmr::memory_resource* arena() const { return RunArena::currentResource(); }
+};
+
+namespace detail {
+    inline RunFrame*& currentFrame() {
+        thread_local RunFrame* active = nullptr;
+        return active;
+    }
+
+    class ScopedFrame {
+        RunFrame* previous;
+    public:
+        explicit ScopedFrame(RunFrame* frame) : previous(currentFrame()) {
+            currentFrame() = frame;
+        }
+        ~ScopedFrame() { currentFrame() = previous; }
+        ScopedFrame(const ScopedFrame&) = delete;
+        ScopedFrame& operator=(const ScopedFrame&) = delete;
+    };
+
+    // Best-effort check whether two values differ. Values of common scalar/string types
+    // are compared; anything else is assumed to have changed.
+    template <typename T>
+    bool anyHoldsEqual(const std::any& a, const std::any& b, bool& known) {
+        if (a.type() != typeid(T)) return false;
+        known = true;
+        return *std::any_cast<T>(&a) == *std::any_cast<T>(&b);
+    }
+
+    inline bool anyValueChanged(const std::any& before, const std::any& after) {
+        if (before.type() != after.type()) return true;
+        if (!before.has_value()) return false;
+        bool known = false;
+        bool equal = anyHoldsEqual<int>(before, after, known) || anyHoldsEqual<long>(before, after, known)
+                  || anyHoldsEqual<long long>(before, after, known) || anyHoldsEqual<unsigned>(before, after, known)
+                  || anyHoldsEqual<unsigned long>(before, after, known) || anyHoldsEqual<unsigned long long>(before, after, known)
+                  || anyHoldsEqual<double>(before, after, known) || anyHoldsEqual<float>(before, after, known)
+                  || anyHoldsEqual<bool>(before, after, known) || anyHoldsEqual<char>(before, after, known)
+                  || anyHoldsEqual<std::string>(before, after, known);
+        return known ? !equal : true;
+    }
+
+    // Calls onChange(key, value) for every key `run` added or changed relative to `base`
+    // (value may be moved from) and onChange(key, nullptr) for every key it erased.
+    // `run` should start as a copy of `base`: entries whose version stamps still match
+    // are unchanged whatever their type, and only reassigned entries are compared by value.
+    template <typename F>
+    void forEachContextChange(const Context& base, Context& run, F&& onChange) {
+        for (auto entry = run.begin(); entry != run.end(); ++entry) {
+            auto previous = base.find(entry->first);
+            if (previous != base.end()
+                && (base.version(previous) == run.version(entry) || !anyValueChanged(previous->second, entry->second))) {
+                continue;
+            }
+            onChange(entry->first, &entry->second);
+        }
+        for (const auto& entry : base) {
+            if (!run.count(entry.first)) {
+                onChange(entry.first, static_cast<std::any*>(nullptr));
+            }
+        }
+    }
+} // namespace detail
+
+
+// --- Custom Exception ---
+class CognitoFlowException : public std::runtime_error {
+public:
+    CognitoFlowException(const std::string& message) : std::runtime_error(message) {}
+    CognitoFlowException(const std::string& message, const std::exception& cause)
+        : std::runtime_error(message + " (Caused by: " + cause.what() + ")") {} // Simple cause handling
+};
+
+
+// --- Exec Results ---
+// Optional non-throwing failure channel for exec attempts. Node::tryExec and
+// BatchNode::tryExecItem may return ExecResult<E>::failure(...) instead of throwing:
+// the attempt is retried without unwinding or allocating, and once every attempt has
+// failed the fallback receives the stored exception, or a CognitoFlowException with
+// the reason. Thrown exceptions are kept as std::exception_ptr, so fallbacks always
+// see the original exception type. A static reason (a string literal) costs nothing;
+// a std::string reason is stored in a CognitoFlowException, so it may be a temporary.
+struct ExecFailure {
+    const char* reason = nullptr; // Static storage only; usually a string literal
+    std::exception_ptr exception; // Set for thrown or explicitly attached exceptions
+};
+
+template <typename T>
+class ExecResult {
+    std::optional<T> result;
+    ExecFailure failureInfo;
+
+public:
+    ExecResult(T value) : result(std::move(value)) {}
+    ExecResult(ExecFailure failure) : failureInfo(std::move(failure)) {}
+
+    static ExecResult failure(const char* staticReason) { return ExecResult(ExecFailure{staticReason, nullptr}); }
+    static ExecResult failure(std::string reason) {
+        return ExecResult(ExecFailure{nullptr, std::make_exception_ptr(CognitoFlowException(std::move(reason)))});
+    }
+    static ExecResult failure(std::exception_ptr exception) { return ExecResult(ExecFailure{{}, std::move(exception)}); }
+
+    bool ok() const { return result.has_value(); }
+    explicit operator bool() const { return ok(); }
+
+    // The value; rethrows the failure if there is none
+    T& value() & {
+        if (!result) throwFailure();
+        return *result;
+    }
+    T&& value() && {
+        if (!result) throwFailure();
+        return std::move(*result);
+    }
+
+    const ExecFailure& error() const { return failureInfo; }
+
+private:
+    [[noreturn]] void throwFailure() const {
+        if (failureInfo.exception) std::rethrow_exception(failureInfo.exception);
+        throw CognitoFlowException(std::string("Exec failed: ") + (failureInfo.reason ? failureInfo.reason : "no reason given"));
+    }
+};
+
+namespace detail {
+    // Calls fallback(const std::exception&) with the exception of the last failed attempt
+    template <typename F>
+    auto callWithFailure(const ExecFailure& failure, F&& fallback) -> decltype(fallback(std::declval<const std::exception&>())) {
+        if (failure.exception) {
+            try {
+                std::rethrow_exception(failure.exception);
+            } catch (const std::exception& lastException) {
+                return fallback(lastException);
+            } catch (...) {
+                return fallback(std::runtime_error("Non-standard exception caught during exec"));
+            }
+        }
+        return fallback(CognitoFlowException(failure.reason ? failure.reason : "Exec failed"));
+    }
+
+    // Carries the last attempt's failure out of a memoized computation, so the fallback
+    // runs outside the cache and its value is never stored
+    struct ExecAttemptsFailed {
+        ExecFailure failure;
+    };
+} // namespace detail
+
+
+// --- Deadlines ---
+// A run's latency budget. A deadline is set per thread with DeadlineScope or
+// Flow::setRunTimeout and is carried into parallel items, branches and async stages.
+// Flows do not start a node once the deadline has passed. Retries are not scheduled
+// unless the wait plus the duration of the last attempt still fits. BatchNodes stop
+// processing items when the deadline passes.
+class DeadlineExceededException : public CognitoFlowException {
+public:
+    using CognitoFlowException::CognitoFlowException;
+};
+
+// A single exec attempt ran longer than its node's timeout
+class TimeoutException : public CognitoFlowException {
+public:
+    using CognitoFlowException::CognitoFlowException;
+};
+
+namespace detail {
+    using DeadlineClock = std::chrono::steady_clock;
+
+    // time_point::max() when the current run has no deadline
+    inline DeadlineClock::time_point& currentDeadline() {
+        thread_local DeadlineClock::time_point active = DeadlineClock::time_point::max();
+        return active;
+    }
+
+    // Replaces the thread's deadline (use max() to clear it) and restores it on exit
+    class ScopedDeadline {
+        DeadlineClock::time_point previous;
+    public:
+        explicit ScopedDeadline(DeadlineClock::time_point deadline) : previous(currentDeadline()) {
+            currentDeadline() = deadline;
+        }
+        ~ScopedDeadline() { currentDeadline() = previous; }
+        ScopedDeadline(const ScopedDeadline&) = delete;
+        ScopedDeadline& operator=(const ScopedDeadline&) = delete;
+    };
+
+    // Whether waiting `wait` and then running an attempt as long as `attempt` still
+    // finishes before the deadline
+    inline bool attemptFits(DeadlineClock::duration wait, DeadlineClock::duration attempt) {
+        DeadlineClock::time_point deadline = currentDeadline();
+        if (deadline == DeadlineClock::time_point::max()) return true;
+        return DeadlineClock::now() + wait + attempt < deadline;
+    }
+
+    // Threads that run timed exec attempts, reused across attempts. A timed-out attempt
+    // is abandoned, not stopped, and keeps its thread until it returns; while
+    // maxAbandoned attempts are still running or all maxThreads threads are busy, new
+    // timed attempts fail at once instead of piling up.
+    class AttemptPool {
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::deque<std::function<void()>> tasks;
+        std::size_t threads = 0;
+        std::size_t idle = 0;
+        std::size_t abandoned = 0;
+        std::size_t maxThreads = 64;
+        std::size_t maxAbandoned = 16;
+
+        void workerLoop() {
+            std::unique_lock<std::mutex> lock(mutex);
+            for (;;) {
+                ++idle;
+                wake.wait(lock, [this] { return !tasks.empty(); });
+                --idle;
+                std::function<void()> task = std::move(tasks.front());
+                tasks.pop_front();
+                lock.unlock();
+                task();
+                task = nullptr; // Drops the attempt's node and prep result before idling
+                lock.lock();
+            }
+        }
+
+    public:
+        // Never destroyed: abandoned attempts may still be running when main returns
+        static AttemptPool& instance() {
+            static AttemptPool* pool = new AttemptPool();
+            return *pool;
+        }
+
+        void setLimits(std::size_t threadLimit, std::size_t abandonedLimit) {
+            std::lock_guard<std::mutex> lock(mutex);
+            maxThreads = threadLimit;
+            maxAbandoned = abandonedLimit;
+        }
+
+        // Starts task on a free thread (spawning one below the limit); returns why it
+        // could not, or nullptr
+        const char* start(std::function<void()> task) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (abandoned >= maxAbandoned) return "could not start: too many timed-out attempts still running";
+            if (idle <= tasks.size()) {
+                if (threads >= maxThreads) return "could not start: every attempt thread is busy";
+                ++threads;
+                std::thread([this] { workerLoop(); }).detach();
+            }
+            tasks.push_back(std::move(task));
+            wake.notify_one();
+            return nullptr;
+        }
+
+        void attemptAbandoned() {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++abandoned;
+        }
+
+        void abandonedAttemptFinished() {
+            std::lock_guard<std::mutex> lock(mutex);
+            --abandoned;
+        }
+
+        std::size_t abandonedCount() {
+            std::lock_guard<std::mutex> lock(mutex);
+            return abandoned;
+        }
+    };
+
+    // Runs attempt() on the AttemptPool and waits at most `limit` for it. The attempt
+    // does not see the caller's RunFrame: it gets a frame of its own holding a snapshot
+    // of the node's params and the attempt index, plus the caller's deadline, and it
+    // keeps `node` alive, so an abandoned attempt never reaches into a finished run.
+    // attempt() must own (or share) everything else it uses. A node not owned by a
+    // shared_ptr (a StaticFlow step, a node on the stack) cannot be kept alive, so its
+    // attempts run on the caller's thread, an overrun is only reported once the attempt
+    // returns, and a warning says so.
+    template <typename E, typename NodeType, typename Attempt>
+    ExecResult<E> runWithTimeout(const NodeType& node, int attemptIndex, Attempt attempt, DeadlineClock::duration limit) {
+        struct Outcome {
+            std::mutex mutex;
+            std::condition_variable cv;
+            bool done = false;
+            bool abandoned = false;
+            std::optional<ExecResult<E>> result;
+            std::exception_ptr error;
+        };
+        auto timeoutFailure = [&](const char* reason) {
+            long long millis = std::chrono::duration_cast<std::chrono::milliseconds>(limit).count();
+            return ExecResult<E>::failure(std::make_exception_ptr(TimeoutException(
+                "Node " + node.getClassName() + " exec attempt " + reason + " (limit " + std::to_string(millis) + " ms)")));
+        };
+        if (limit <= DeadlineClock::duration::zero()) return timeoutFailure("had no time left");
+
+        auto owner = node.weak_from_this().lock();
+        if (!owner) {
+            static LogSite site;
+            logWarn(site, [&] {
+                return "Node " + node.getClassName() + " has a timeout but is not owned by a shared_ptr; its attempts run inline "
+                       "and a hung exec is not abandoned.";
+            });
+            DeadlineClock::time_point started = DeadlineClock::now();
+            ExecResult<E> result = attempt();
+            if (DeadlineClock::now() - started > limit) return timeoutFailure("overran");
+            return result;
+        }
+
+        auto outcome = std::make_shared<Outcome>();
+        AttemptPool& pool = AttemptPool::instance();
+        const char* refused = pool.start([outcome, owner, attempt = std::move(attempt), params = node.getParams(),
+                                          attemptIndex, deadline = currentDeadline()]() mutable {
+            RunFrame frame(std::move(params));
+            frame.retryCounter() = attemptIndex;
+            ScopedFrame frameScope(&frame);
+            ScopedDeadline deadlineScope(deadline);
+            std::optional<ExecResult<E>> result;
+            std::exception_ptr error;
+            try {
+                result.emplace(attempt());
+            } catch (...) {
+                error = std::current_exception();
+            }
+            bool wasAbandoned = false;
+            {
+                std::lock_guard<std::mutex> lock(outcome->mutex);
+                outcome->result = std::move(result);
+                outcome->error = error;
+                outcome->done = true;
+                wasAbandoned = outcome->abandoned;
+                outcome->cv.notify_all();
+            }
+            if (wasAbandoned) AttemptPool::instance().abandonedAttemptFinished();
+        });
+        if (refused) return timeoutFailure(refused);
+
+        std::unique_lock<std::mutex> lock(outcome->mutex);
+        if (!outcome->cv.wait_for(lock, limit, [&] { return outcome->done; })) {
+            outcome->abandoned = true;
+            pool.attemptAbandoned(); // Under the outcome lock, so it precedes the attempt's decrement
+            return timeoutFailure("timed out");
+        }
+        if (outcome->error) std::rethrow_exception(outcome->error);
+        return std::move(*outcome->result);
+    }
+} // namespace detail
+
+// Bounds the threads that run Node::setTimeout attempts (default 64) and the timed-out
+// attempts that may still be running (default 16). Call before running flows.
+inline void setTimedAttemptLimits(std::size_t maxThreads, std::size_t maxAbandoned) {
+    if (maxThreads == 0) throw std::invalid_argument("maxThreads must be at least 1");
+    detail::AttemptPool::instance().setLimits(maxThreads, maxAbandoned);
+}
+
+class DeadlineScope {
+    detail::ScopedDeadline scope;
+
+public:
+    // Never extends an enclosing deadline
+    explicit DeadlineScope(std::chrono::steady_clock::time_point deadline)
+        : scope(std::min(detail::currentDeadline(), deadline)) {}
+
+    explicit DeadlineScope(std::chrono::steady_clock::duration budget)
+        : DeadlineScope(std::chrono::steady_clock::now() + budget) {}
+
+    // The current thread's deadline, if its run has one
+    static std::optional<std::chrono::steady_clock::time_point> current() {
+        auto deadline = detail::currentDeadline();
+        if (deadline == detail::DeadlineClock::time_point::max()) return std::nullopt;
+        return deadline;
+    }
+
+    // Time left before the deadline (zero once it has passed), or nullopt without one
+    static std::optional<std::chrono::steady_clock::duration> remaining() {
+        auto deadline = current();
+        if (!deadline) return std::nullopt;
+        return std::max(*deadline - std::chrono::steady_clock::now(), std::chrono::steady_clock::duration::zero());
+    }
+
+    static bool expired() {
+        auto deadline = detail::currentDeadline();
+        return deadline != detail::DeadlineClock::time_point::max() && std::chrono::steady_clock::now() >= deadline;
+    }
+};
+
+
+// --- Retry Policies ---
+// Pluggable retry behavior for Node and the batch nodes. A RetryPolicy decides
+// whether each retry may happen and how long to wait first. A CircuitBreaker
+// watches the outcomes of every node that calls one downstream. Policies and
+// breakers are shared between nodes and items, so they must be thread-safe.
+// The node's maxRetries remains the hard cap on attempts.
+class RetryPolicy {
+public:
+    virtual ~RetryPolicy() = default;
+
+    // Called once per exec (or batch item) before its first attempt
+    virtual void onFirstAttempt() {}
+
+    // Delay before retry number `retry` (1 = the first retry); `previousDelay` is the
+    // delay this call waited last time (zero before the first retry). nullopt stops
+    // retrying and goes to the fallback.
+    virtual std::optional<std::chrono::milliseconds> retryDelay(int retry, std::chrono::milliseconds previousDelay) = 0;
+};
+
+// The same wait before every retry; what Node does without a policy
+class FixedDelayRetry : public RetryPolicy {
+    std::chrono::milliseconds delay;
+
+public:
+    explicit FixedDelayRetry(std::chrono::milliseconds wait) : delay(wait) {}
+
+    std::optional<std::chrono::milliseconds> retryDelay(int, std::chrono::milliseconds) override { return delay; }
+};
+
+// Exponential backoff with decorrelated jitter: each delay is drawn uniformly from
+// [base, 3 x previous delay] and capped at `cap`. Callers that failed together spread
+// out instead of retrying in lockstep.
+class ExponentialBackoffRetry : public RetryPolicy {
+    std::chrono::milliseconds base;
+    std::chrono::milliseconds cap;
+
+public:
+    ExponentialBackoffRetry(std::chrono::milliseconds baseDelay, std::chrono::milliseconds maxDelay)
+        : base(baseDelay), cap(maxDelay) {
+        if (base.count() < 0 || cap < base) throw std::invalid_argument("Backoff needs 0 <= baseDelay <= maxDelay");
+    }
+
+    std::optional<std::chrono::milliseconds> retryDelay(int, std::chrono::milliseconds previousDelay) override {
+        using Rep = std::chrono::milliseconds::rep;
+        Rep low = base.count();
+        Rep high = std::max(low, std::min(cap.count(), 3 * std::max(previousDelay.count(), low)));
+        std::uniform_int_distribution<Rep> pick(low, high);
+        return std::chrono::milliseconds(pick(generator()));
+    }
+
+private:
+    static std::mt19937_64& generator() {
+        thread_local std::mt19937_64 engine(std::random_device{}());
+        return engine;
+    }
+};
+
+// Caps retries at a fraction of the traffic: each exec deposits retryRatio tokens, up
+// to maxTokens, and each retry spends one. When the bucket is empty, calls fall back
+// at once. This stops a degraded downstream from getting a retry storm. The bucket
+// starts full, which allows an initial burst. Delays come from `delays`.
+class RetryBudget : public RetryPolicy {
+    std::shared_ptr<RetryPolicy> delays;
+    double ratio;
+    double maxTokens;
+    mutable std::mutex mutex;
+    double tokens;
+
+public:
+    explicit RetryBudget(std::shared_ptr<RetryPolicy> delayPolicy, double retryRatio = 0.2, double reserve = 10.0)
+        : delays(std::move(delayPolicy)), ratio(retryRatio), maxTokens(reserve), tokens(reserve) {
+        if (!delays) throw std::invalid_argument("RetryBudget needs a delay policy");
+        if (ratio < 0 || maxTokens < 1) throw std::invalid_argument("RetryBudget needs retryRatio >= 0 and reserve >= 1");
+    }
+
+    void onFirstAttempt() override {
+        delays->onFirstAttempt();
+        std::lock_guard<std::mutex> lock(mutex);
+        tokens = std::min(maxTokens, tokens + ratio);
+    }
+
+    std::optional<std::chrono::milliseconds> retryDelay(int retry, std::chrono::milliseconds previousDelay) override {
+        std::optional<std::chrono::milliseconds> delay = delays->retryDelay(retry, previousDelay);
+        if (!delay) return std::nullopt;
+        std::lock_guard<std::mutex> lock(mutex);
+        if (tokens < 1.0) return std::nullopt;
+        tokens -= 1.0;
+        return delay;
+    }
+
+    double availableTokens() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return tokens;
+    }
+};
+
+// The breaker is open and rejected the attempt without running it
+class CircuitOpenException : public CognitoFlowException {
+public:
+    using CognitoFlowException::CognitoFlowException;
+};
+
+struct CircuitBreakerOptions {
+    int failureThreshold = 5;                     // Consecutive failed attempts that open the breaker
+    std::chrono::milliseconds openDuration{1000}; // Time calls are rejected before a probe is let through
+    int halfOpenProbes = 1;                       // Trial attempts allowed at once while half-open
+};
+
+// Shared per downstream. After failureThreshold consecutive failures it opens, and
+// nodes stop calling exec: they go straight to their fallback. Once openDuration has
+// passed it is half-open and lets halfOpenProbes attempts through. The first probe
+// that succeeds closes the breaker; a failed probe opens it again.
+class CircuitBreaker {
+public:
+    enum class State { Closed, Open, HalfOpen };
+
+private:
+    CircuitBreakerOptions options;
+    mutable std::mutex mutex;
+    State current = State::Closed;
+    int consecutiveFailures = 0;
+    int probesInFlight = 0;
+    std::chrono::steady_clock::time_point openedAt;
+    std::atomic<std::uint64_t> rejected{0};
+
+public:
+    explicit CircuitBreaker(CircuitBreakerOptions breakerOptions = {}) : options(breakerOptions) {
+        if (options.failureThreshold < 1 || options.halfOpenProbes < 1 || options.openDuration.count() < 0) {
+            throw std::invalid_argument("CircuitBreaker needs failureThreshold >= 1, halfOpenProbes >= 1 and openDuration >= 0");
+        }
+    }
+
+    CircuitBreaker(const CircuitBreaker&) = delete;
+    CircuitBreaker& operator=(const CircuitBreaker&) = delete;
+
+    // Whether an attempt may run now; a true answer must be followed by recordSuccess or
+    // recordFailure
+    bool allowRequest() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (current == State::Open) {
+            if (std::chrono::steady_clock::now() - openedAt < options.openDuration) {
+                rejected.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            current = State::HalfOpen;
+            probesInFlight = 0;
+        }
+        if (current == State::HalfOpen) {
+            if (probesInFlight >= options.halfOpenProbes) {
+                rejected.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            ++probesInFlight;
+        }
+        return true;
+    }
+
+    void recordSuccess() {
+        std::lock_guard<std::mutex> lock(mutex);
+        consecutiveFailures = 0;
+        if (current == State::HalfOpen) {
+            current = State::Closed;
+            probesInFlight = 0;
+        }
+    }
+
+    void recordFailure() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (current == State::HalfOpen || ++consecutiveFailures >= options.failureThreshold) {
+            current = State::Open;
+            openedAt = std::chrono::steady_clock::now();
+            consecutiveFailures = 0;
+            probesInFlight = 0;
+        }
+    }
+
+    State state() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return current;
+    }
+
+    // Attempts turned away while open or half-open
+    std::uint64_t rejectedCalls() const { return rejected.load(std::memory_order_relaxed); }
+};
+
+namespace detail {
+    // A node's retry configuration as the retry loops see it
+    struct RetrySettings {
+        int maxRetries = 1;
+        long long waitMillis = 0;
+        RetryPolicy* policy = nullptr;
+        CircuitBreaker* breaker = nullptr;
+    };
+
+    // Retry bookkeeping for one exec or item. Attempts are only timed when the run has a
+    // deadline, keeping clock reads off the common path.
+    class RetrySchedule {
+        const RetrySettings& settings;
+        std::chrono::milliseconds previousDelay{0};
+        const bool timed = currentDeadline() != DeadlineClock::time_point::max();
+        DeadlineClock::time_point attemptStart;
+        DeadlineClock::duration lastAttempt{0};
+
+    public:
+        explicit RetrySchedule(const RetrySettings& retrySettings) : settings(retrySettings) {
+            if (settings.policy) settings.policy->onFirstAttempt();
+        }
+
+        // Wait before the next retry, or nullopt to stop: the policy refused, or the wait
+        // plus another attempt as long as the last one would overrun the deadline
+        std::optional<std::chrono::milliseconds> nextDelay(int retry) {
+            std::optional<std::chrono::milliseconds> delay = settings.policy
+                ? settings.policy->retryDelay(retry, previousDelay)
+                : std::chrono::milliseconds(settings.waitMillis);
+            if (!delay || !attemptFits(*delay, lastAttempt)) return std::nullopt;
+            previousDelay = *delay;
+            return delay;
+        }
+
+        // False (with `failure` set) when the breaker turns the attempt away
+        template <typename NodeName>
+        bool admit(ExecFailure& failure, NodeName&& nodeName) const {
+            if (!settings.breaker || settings.breaker->allowRequest()) return true;
+            failure = ExecFailure{{}, std::make_exception_ptr(CircuitOpenException("Circuit breaker is open; node " + nodeName() + " skipped exec"))};
+            return false;
+        }
+
+        void attemptStarted() {
+            if (timed) attemptStart = DeadlineClock::now();
+        }
+
+        void record(bool succeeded) {
+            if (!succeeded && timed) lastAttempt = DeadlineClock::now() - attemptStart;
+            if (!settings.breaker) return;
+            if (succeeded) {
+                settings.breaker->recordSuccess();
+            } else {
+                settings.breaker->recordFailure();
+            }
+        }
+    };
+} // namespace detail
+
+
+// --- Executor ---
+// Work-stealing thread pool shared by all parallel node types. Each worker owns a
+// deque: it pushes and pops its own tasks at the back while idle workers steal from
+// the front of other deques; tasks submitted from outside go to a shared injection
+// queue. parallelFor lets the calling thread take part and, while it waits for
+// in-flight items, run other queued tasks, so nested parallelism (a parallel batch
+// inside a parallel flow) reuses the same threads instead of adding more and cannot
+// deadlock. One process-wide instance is returned by defaultExecutor().
+class Executor;
+
+namespace detail {
+    // Executor the current thread works for, or the one installed by the enclosing Flow
+    inline Executor*& currentExecutor() {
+        thread_local Executor* active = nullptr;
+        return active;
+    }
+
+    class ScopedExecutor {
+        Executor* previous;
+    public:
+        explicit ScopedExecutor(Executor* executor) : previous(currentExecutor()) {
+            if (executor) currentExecutor() = executor;
+        }
+        ~ScopedExecutor() { currentExecutor() = previous; }
+        ScopedExecutor(const ScopedExecutor&) = delete;
+        ScopedExecutor& operator=(const ScopedExecutor&) = delete;
+    };
+} // namespace detail
+
+struct ExecutorOptions {
+    std::size_t threadCount = 0;  // 0 = std::thread::hardware_concurrency()
+    bool pinThreads = false;      // Pin worker i to cpus[i % cpus.size()] (or CPU i if cpus is empty)
+    std::vector<int> cpus;        // CPU ids to pin to, e.g. the cores of one NUMA node (Linux only)
+};
+
+class Executor {
+    using Task = std::function<void()>;
+
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::thread thread;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::mutex injectMutex;
+    std::deque<Task> injected;
+    std::mutex sleepMutex;
+    std::condition_variable sleepCv;
+    std::atomic<std::size_t> queuedTasks{0};
+    std::atomic<bool> stopping{false};
+    ExecutorOptions options;
+
+    static constexpr std::size_t NOT_A_WORKER = static_cast<std::size_t>(-1);
+
+    struct WorkerIdentity {
+        const Executor* executor = nullptr;
+        std::size_t index = NOT_A_WORKER;
+    };
+    static WorkerIdentity& currentWorker() {
+        thread_local WorkerIdentity identity;
+        return identity;
+    }
+
+public:
+    explicit Executor(ExecutorOptions executorOptions = {}) : options(std::move(executorOptions)) {
+        std::size_t threadCount = options.threadCount == 0 ? hardwareThreads() : options.threadCount;
+        workers.reserve(threadCount);
+        for (std::size_t i = 0; i < threadCount; ++i) {
+            workers.push_back(std::make_unique<Worker>());
+        }
+        for (std::size_t i = 0; i < threadCount; ++i) {
+            workers[i]->thread = std::thread([this, i] { workerLoop(i); });
+        }
+    }
+
+    explicit Executor(std::size_t threadCount) : Executor(ExecutorOptions{threadCount, false, {}}) {}
+
+    ~Executor() {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+            sleepCv.notify_all();
+        }
+        for (auto& worker : workers) {
+            worker->thread.join(); // Queued tasks are drained before the workers exit
+        }
+    }
+
+    Executor(const Executor&) = delete;
+    Executor& operator=(const Executor&) = delete;
+
+    static std::size_t hardwareThreads() {
+        unsigned int hw = std::thread::hardware_concurrency();
+        return hw == 0 ? 1 : hw;
+    }
+
+    // Process-wide executor used by parallel nodes that were not given one
+    static std::shared_ptr<Executor> defaultExecutor() {
+        std::lock_guard<std::mutex> lock(defaultMutex());
+        std::shared_ptr<Executor>& instance = defaultInstance();
+        if (!instance) instance = std::make_shared<Executor>();
+        return instance;
+    }
+
+    // Replaces the process-wide executor, e.g. with pinned threads. Call before running flows.
+    static void setDefaultExecutor(std::shared_ptr<Executor> executor) {
+        std::lock_guard<std::mutex> lock(defaultMutex());
+        defaultInstance() = std::move(executor);
+    }
+
+    // Executor a parallel node should use: its own, else the thread's current one, else the default
+    static std::shared_ptr<Executor> resolve(const std::shared_ptr<Executor>& preferred) {
+        if (preferred) return preferred;
+        if (Executor* current = detail::currentExecutor()) return current->shared();
+        return defaultExecutor();
+    }
+
+    std::size_t size() const { return workers.size(); }
+
+    bool isWorkerThread() const { return currentWorker().executor == this; }
+
+    void submit(Task task) {
+        const WorkerIdentity& self = currentWorker();
+        if (self.executor == this) {
+            Worker& worker = *workers[self.index];
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            worker.tasks.push_back(std::move(task));
+        } else {
+            std::lock_guard<std::mutex> lock(injectMutex);
+            injected.push_back(std::move(task));
+        }
+        queuedTasks.fetch_add(1);
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        sleepCv.notify_one();
+    }
+
+    // Runs one queued task on the calling thread if there is one
+    bool tryRunOne() {
+        Task task;
+        if (!takeTask(currentWorker().executor == this ? currentWorker().index : NOT_A_WORKER, task)) return false;
+        detail::ScopedArena noArena(nullptr); // The task may belong to another run
+        detail::ScopedDeadline noDeadline(detail::DeadlineClock::time_point::max());
+        task();
+        return true;
+    }
+
+    // Calls body(i) for every i in [0, count) using at most maxConcurrency threads,
+    // the calling thread included (0 = every worker plus the caller). If a call throws,
+    // items that have not started are skipped and the first exception is rethrown once
+    // the running ones have finished.
+    void parallelFor(std::size_t count, std::size_t maxConcurrency, const std::function<void(std::size_t)>& body) {
+        if (count == 0) return;
+
+        struct State {
+            std::atomic<std::size_t> nextIndex{0};
+            std::atomic<std::size_t> finished{0};
+            std::atomic<bool> failed{false};
+            std::size_t count = 0;
+            const std::function<void(std::size_t)>* body = nullptr;
+            Executor* executor = nullptr;
+            detail::DeadlineClock::time_point deadline; // The caller's, applied to every item
+            std::exception_ptr firstError;
+            std::mutex mutex;
+            std::condition_variable cv;
+        };
+        auto state = std::make_shared<State>();
+        state->count = count;
+        state->body = &body;
+        state->executor = this;
+        state->deadline = detail::currentDeadline();
+
+        // Late helpers only touch the shared state: they see nextIndex >= count and leave.
+        auto drain = [](const std::shared_ptr<State>& st) {
+            detail::ScopedExecutor scope(st->executor);
+            detail::ScopedDeadline deadlineScope(st->deadline);
+            std::size_t index;
+            while ((index = st->nextIndex.fetch_add(1)) < st->count) {
+                if (!st->failed.load(std::memory_order_relaxed)) {
+                    try {
+                        (*st->body)(index);
+                    } catch (...) {
+                        std::lock_guard<std::mutex> lock(st->mutex);
+                        if (!st->firstError) st->firstError = std::current_exception();
+                        st->failed = true;
+                    }
+                }
+                if (st->finished.fetch_add(1) + 1 == st->count) {
+                    std::lock_guard<std::mutex> lock(st->mutex);
+                    st->cv.notify_all();
+                }
+            }
+        };
+
+        std::size_t participants = maxConcurrency == 0 ? size() + 1 : std::min(maxConcurrency, size() + 1);
+        participants = std::min(participants, count);
+        for (std::size_t i = 1; i < participants; ++i) {
+            submit([state, drain] { drain(state); });
+        }
+        drain(state);
+
+        // Help with other queued work while helpers finish their in-flight items
+        while (state->finished.load() != state->count) {
+            if (tryRunOne()) continue;
+            std::unique_lock<std::mutex> lock(state->mutex);
+            state->cv.wait_for(lock, std::chrono::microseconds(200),
+                               [&] { return state->finished.load() == state->count; });
+        }
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if (state->firstError) {
+            std::rethrow_exception(state->firstError);
+        }
+    }
+
+private:
+    static std::mutex& defaultMutex() {
+        static std::mutex mutex;
+        return mutex;
+    }
+
+    static std::shared_ptr<Executor>& defaultInstance() {
+        static std::shared_ptr<Executor> instance;
+        return instance;
+    }
+
+    // Non-owning shared_ptr for executors reached through the thread-local pointer;
+    // the owner keeps the executor alive while its threads or scoped flows run
+    std::shared_ptr<Executor> shared() {
+        return std::shared_ptr<Executor>(std::shared_ptr<Executor>(), this);
+    }
+
+    bool takeTask(std::size_t selfIndex, Task& task) {
+        if (queuedTasks.load() == 0) return false;
+        if (selfIndex != NOT_A_WORKER) {
+            Worker& self = *workers[selfIndex];
+            std::lock_guard<std::mutex> lock(self.mutex);
+            if (!self.tasks.empty()) {
+                task = std::move(self.tasks.back()); // LIFO for the owner: cache-warm, bounds nesting depth
+                self.tasks.pop_back();
+                queuedTasks.fetch_sub(1);
+                return true;
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(injectMutex);
+            if (!injected.empty()) {
+                task = std::move(injected.front());
+                injected.pop_front();
+                queuedTasks.fetch_sub(1);
+                return true;
+            }
+        }
+        std::size_t start = selfIndex == NOT_A_WORKER ? 0 : selfIndex + 1;
+        for (std::size_t offset = 0; offset < workers.size(); ++offset) {
+            std::size_t victimIndex = (start + offset) % workers.size();
+            if (victimIndex == selfIndex) continue;
+            Worker& victim = *workers[victimIndex];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front()); // FIFO steal: oldest, usually largest, work
+                victim.tasks.pop_front();
+                queuedTasks.fetch_sub(1);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void pinCurrentThread(std::size_t index) {
+#if defined(__linux__)
+        int cpu = options.cpus.empty() ? static_cast<int>(index % hardwareThreads())
+                                       : options.cpus[index % options.cpus.size()];
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        CPU_SET(cpu, &cpuSet);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) != 0) {
+            logWarn("Executor could not pin worker " + std::to_string(index) + " to CPU " + std::to_string(cpu));
+        }
+#else
+        (void)index;
+        logWarn("Executor thread pinning is only supported on Linux");
+#endif
+    }
+
+    void workerLoop(std::size_t index) {
+        currentWorker() = WorkerIdentity{this, index};
+        detail::currentExecutor() = this;
+        if (options.pinThreads) pinCurrentThread(index);
+
+        for (;;) {
+            Task task;
+            if (takeTask(index, task)) {
+                task();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            if (stopping && queuedTasks.load() == 0) return;
+            sleepCv.wait(lock, [this] { return stopping || queuedTasks.load() > 0; });
+        }
+    }
+};
+
+
+// --- Async Results and Event Loop ---
+// Minimal future with continuations. A promise completes it from any thread;
+// onReady callbacks run on the completing thread (or immediately if already done).
+template <typename T>
+class AsyncPromise;
+
+template <typename T>
+class AsyncResult {
+    friend class AsyncPromise<T>;
+
+    struct State {
+        std::mutex mutex;
+        bool ready = false;
+        std::optional<T> value;
+        std::exception_ptr error;
+        std::vector<std::function<void()>> callbacks;
+    };
+    std::shared_ptr<State> state;
+
+    explicit AsyncResult(std::shared_ptr<State> st) : state(std::move(st)) {}
+
+public:
+    AsyncResult() : state(std::make_shared<State>()) {}
+
+    static AsyncResult<T> fromValue(T value) {
+        AsyncResult<T> result;
+        result.state->value.emplace(std::move(value));
+        result.state->ready = true;
+        return result;
+    }
+
+    static AsyncResult<T> fromException(std::exception_ptr error) {
+        AsyncResult<T> result;
+        result.state->error = std::move(error);
+        result.state->ready = true;
+        return result;
+    }
+
+    // Runs fn synchronously and captures its value or exception
+    template <typename F>
+    static AsyncResult<T> invoke(F&& fn) {
+        try {
+            return fromValue(fn());
+        } catch (...) {
+            return fromException(std::current_exception());
+        }
+    }
+
+    bool isReady() const {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        return state->ready;
+    }
+
+    // Rethrows the stored exception if the operation failed. Only valid once ready.
+    const T& get() const {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if (!state->ready) throw std::logic_error("AsyncResult::get() called before the result was ready");
+        if (state->error) std::rethrow_exception(state->error);
+        return *state->value;
+    }
+
+    void onReady(std::function<void()> callback) const {
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (!state->ready) {
+                state->callbacks.push_back(std::move(callback));
+                return;
+            }
+        }
+        callback();
+    }
+};
+
+template <typename T>
+class AsyncPromise {
+    std::shared_ptr<typename AsyncResult<T>::State> state = std::make_shared<typename AsyncResult<T>::State>();
+
+    template <typename Fill>
+    void complete(Fill&& fill) {
+        std::vector<std::function<void()>> callbacks;
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (state->ready) throw std::logic_error("AsyncPromise completed twice");
+            fill(*state);
+            state->ready = true;
+            callbacks.swap(state->callbacks);
+        }
+        for (auto& callback : callbacks) callback();
+    }
+
+public:
+    AsyncResult<T> result() const { return AsyncResult<T>(state); }
+
+    void setValue(T value) {
+        complete([&](auto& st) { st.value.emplace(std::move(value)); });
+    }
+
+    void setException(std::exception_ptr error) {
+        complete([&](auto& st) { st.error = std::move(error); });
+    }
+};
+
+// Single-threaded driver for async nodes and flows. Tasks and timers may be added
+// from any thread; they only run on the thread calling run()/runUntil(). Retry
+// backoff is a timer here, so a waiting node never parks the thread.
+class EventLoop {
+    using Clock = std::chrono::steady_clock;
+
+    struct Timer {
+        Clock::time_point due;
+        std::uint64_t sequence; // FIFO order for timers due at the same time
+        std::function<void()> task;
+        bool operator>(const Timer& other) const {
+            return due != other.due ? due > other.due : sequence > other.sequence;
+        }
+    };
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::function<void()>> ready;
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers;
+    std::uint64_t nextSequence = 0;
+
+public:
+    EventLoop() = default;
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    // Notifying under the lock keeps a loop that is about to return (and be destroyed)
+    // from racing with a notify issued by another thread.
+    void post(std::function<void()> task) {
+        std::lock_guard<std::mutex> lock(mutex);
+        ready.push_back(std::move(task));
+        cv.notify_one();
+    }
+
+    void schedule(std::chrono::milliseconds delay, std::function<void()> task) {
+        std::lock_guard<std::mutex> lock(mutex);
+        timers.push(Timer{Clock::now() + delay, nextSequence++, std::move(task)});
+        cv.notify_one();
+    }
+
+    // Runs tasks until no task or timer is left. Work completed by other threads
+    // later is not waited for; use runUntil for that.
+    void run() {
+        runWhile([] { return true; }, false);
+    }
+
+    // Runs tasks until done() returns true, sleeping while nothing is due
+    template <typename Pred>
+    void runUntil(Pred done) {
+        runWhile([&] { return !done(); }, true);
+    }
+
+    template <typename T>
+    void runUntil(const AsyncResult<T>& result) {
+        result.onReady([this] { wake(); });
+        runUntil([&] { return result.isReady(); });
+    }
+
+    void wake() {
+        std::lock_guard<std::mutex> lock(mutex);
+        cv.notify_all();
+    }
+
+private:
+    template <typename Pred>
+    void runWhile(Pred keepGoing, bool waitForExternal) {
+        while (keepGoing()) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                for (;;) {
+                    if (!timers.empty() && timers.top().due <= Clock::now()) {
+                        ready.push_back(std::move(const_cast<Timer&>(timers.top()).task));
+                        timers.pop();
+                        continue;
+                    }
+                    if (!ready.empty()) break;
+                    if (!waitForExternal && timers.empty()) return;
+                    lock.unlock();
+                    bool stop = !keepGoing();
+                    lock.lock();
+                    if (stop) return;
+                    if (!ready.empty()) break;
+                    if (timers.empty()) {
+                        cv.wait(lock);
+                    } else {
+                        cv.wait_until(lock, timers.top().due);
+                    }
+                }
+                task = std::move(ready.front());
+                ready.pop_front();
+            }
+            task();
+        }
+    }
+};
+
+
+// --- Forward Declarations ---
+class IBaseNode; // Non-templated base interface
+class IAsyncNode; // Implemented by nodes that can run on an EventLoop
+class ParallelFlow; // Fork/join node created by BaseNode::fork
+
+// --- Actions ---
+// Interned action tokens. An Action is a 32-bit id for an action name, interned once
+// in a process-wide table, so comparing and dispatching on it are integer operations.
+// Id 0 is the default action (""/nullopt). Create the tokens once, e.g.
+//     static const Action ADDED("added");
+// and return them from BaseNode::postAction. Enum values also convert to Actions,
+// named "<enum type>::<value>". Strings remain the storage format for successors and
+// the return type of post()/run(); a token's name() is the string form.
+namespace detail {
+    class ActionTable {
+        mutable std::shared_mutex mutex;
+        std::map<std::string, std::uint32_t, std::less<>> ids{{"", 0}};
+        std::deque<std::string> names{""}; // Stable references
+        std::deque<std::uint64_t> hashes{hashKey("")}; // hashKey of each name, by id
+
+    public:
+        static ActionTable& instance() {
+            static ActionTable* table = new ActionTable(); // Leaked: tokens outlive static destructors
+            return *table;
+        }
+
+        std::uint32_t intern(std::string_view name) {
+            {
+                std::shared_lock<std::shared_mutex> lock(mutex);
+                auto it = ids.find(name);
+                if (it != ids.end()) return it->second;
+            }
+            std::unique_lock<std::shared_mutex> lock(mutex);
+            auto it = ids.find(name);
+            if (it != ids.end()) return it->second;
+            std::uint32_t id = static_cast<std::uint32_t>(names.size());
+            names.emplace_back(name);
+            hashes.push_back(hashKey(name));
+            ids.emplace(names.back(), id);
+            return id;
+        }
+
+        std::optional<std::uint32_t> find(std::string_view name) const {
+            std::shared_lock<std::shared_mutex> lock(mutex);
+            auto it = ids.find(name);
+            if (it == ids.end()) return std::nullopt;
+            return it->second;
+        }
+
+        const std::string& name(std::uint32_t id) const {
+            std::shared_lock<std::shared_mutex> lock(mutex);
+            return names.at(id);
+        }
+
+        std::uint64_t hash(std::uint32_t id) const {
+            std::shared_lock<std::shared_mutex> lock(mutex);
+            return hashes.at(id);
+        }
+    };
+} // namespace detail
+
+class Action {
+    static constexpr std::uint32_t UNSET = static_cast<std::uint32_t>(-1);
+    std::uint32_t value = 0;
+
+    struct FromId {};
+    constexpr Action(FromId, std::uint32_t id) : value(id) {}
+
+public:
+    constexpr Action() = default; // The default action
+
+    explicit Action(std::string_view name) : value(detail::ActionTable::instance().intern(name)) {}
+    explicit Action(const char* name) : Action(std::string_view(name)) {}
+    explicit Action(const std::string& name) : Action(std::string_view(name)) {}
+
+    // nullopt is the default action
+    explicit Action(const std::optional<std::string>& action) : value(action ? detail::ActionTable::instance().intern(*action) : 0) {}
+
+    // Enum-typed actions. Values 0..63 are interned once per enum type; others are
+    // looked up on every conversion.
+    template <typename Enum, typename = std::enable_if_t<std::is_enum_v<Enum>>>
+    Action(Enum enumValue) : value(internEnum(enumValue)) {}
+
+    // "Not set": returned by the default BaseNode::postAction so that post() is used
+    static constexpr Action unset() { return Action(FromId{}, UNSET); }
+
+    // The token with id `id`, which must come from another Action's id()
+    static Action fromId(std::uint32_t id) { return Action(FromId{}, id); }
+
+    // The token of an already interned name, without interning it
+    static std::optional<Action> find(std::string_view name) {
+        std::optional<std::uint32_t> id = detail::ActionTable::instance().find(name);
+        if (!id) return std::nullopt;
+        return Action(FromId{}, *id);
+    }
+
+    std::uint32_t id() const { return value; }
+    bool isDefault() const { return value == 0; }
+    bool isUnset() const { return value == UNSET; }
+
+    // Interned name ("" for the default action); the reference stays valid for the process
+    const std::string& name() const { return detail::ActionTable::instance().name(value); }
+
+    // actionHash(name()), computed once when the name was interned
+    std::uint64_t hash() const { return detail::ActionTable::instance().hash(value); }
+
+    // The string form flows and post() use: nullopt for the default action
+    std::optional<std::string> toOptional() const {
+        if (value == 0) return std::nullopt;
+        return name();
+    }
+
+    friend bool operator==(Action a, Action b) { return a.value == b.value; }
+    friend bool operator!=(Action a, Action b) { return a.value != b.value; }
+    friend bool operator<(Action a, Action b) { return a.value < b.value; }
+
+private:
+    template <typename Enum>
+    static std::uint32_t internEnum(Enum enumValue) {
+        using Underlying = std::underlying_type_t<Enum>;
+        const auto raw = static_cast<Underlying>(enumValue);
+        auto intern = [&] {
+            return detail::ActionTable::instance().intern(std::string(typeid(Enum).name()) + "::" + std::to_string(static_cast<long long>(raw)));
+        };
+        constexpr std::size_t CACHED = 64;
+        if (raw < Underlying{} || static_cast<std::size_t>(raw) >= CACHED) return intern();
+        static std::array<std::atomic<std::uint32_t>, CACHED> cache{}; // 0 = not interned yet (0 is never an enum's id)
+        std::atomic<std::uint32_t>& slot = cache[static_cast<std::size_t>(raw)];
+        std::uint32_t id = slot.load(std::memory_order_relaxed);
+        if (id == 0) {
+            id = intern();
+            slot.store(id, std::memory_order_relaxed);
+        }
+        return id;
+    }
+};
+
+namespace detail {
+    // Hands a node's Action token to the dispatcher that ran it without building the
+    // string. The dispatcher names the node it is about to run in `expecting`. If that
+    // node's postAction returns a token, internalRun stores it here, sets `reporter`,
+    // and returns nullopt. Nodes that are not expected, or that override internalRun,
+    // return strings as before.
+    struct ActionChannel {
+        const IBaseNode* expecting = nullptr;
+        const IBaseNode* reporter = nullptr;
+        Action token;
+    };
+
+    inline ActionChannel& actionChannel() {
+        thread_local ActionChannel channel;
+        return channel;
+    }
+
+    // Runs one node for a token-aware dispatcher: returns the node's token, or
+    // Action::unset() with `action` set when the node answered with a string
+    template <typename Run>
+    Action runForToken(const IBaseNode* node, std::optional<std::string>& action, Run&& run) {
+        ActionChannel& channel = actionChannel();
+        channel.expecting = node;
+        channel.reporter = nullptr;
+        try {
+            action = run();
+        } catch (...) {
+            channel.expecting = nullptr;
+            throw;
+        }
+        channel.expecting = nullptr;
+        if (channel.reporter != node) return Action::unset();
+        channel.reporter = nullptr;
+        return channel.token;
+    }
+} // namespace detail
+
+
+// --- Base Node Interface (Non-Templated) ---
+// What a compiled parent needs to inline a nested flow: the flow's start node and
+// the context namespace its nodes run in ("" = the parent's)
+struct InlineSubflow {
+    std::shared_ptr<IBaseNode> start;
+    std::string keyNamespace;
+};
+
+// Needed to store heterogeneous node types in successors map
+// Shared from this so a timed-out exec attempt can keep its node alive
+class IBaseNode : public std::enable_shared_from_this<IBaseNode> {
+    detail::GraphWatchers graphWatchers;
+
+public:
+    virtual ~IBaseNode() = default; // IMPORTANT: Virtual destructor
+
+    // Marks `stale` once this node's wiring changes; called by CompiledGraph
+    void watchWiring(const std::shared_ptr<std::atomic<bool>>& stale) { graphWatchers.add(stale); }
+
+    virtual void setParamsInternal(const Params& params) = 0;
+    virtual std::optional<std::string> internalRun(Context& sharedContext) = 0;
+
+    // Stateless entry point: per-run state lives in `frame`, node members are not
+    // written. Nodes read the frame through the thread's current-frame pointer.
+    virtual std::optional<std::string> internalRun(Context& sharedContext, RunFrame& frame) {
+        detail::ScopedFrame scope(&frame);
+        return internalRun(sharedContext);
+    }
+    virtual std::shared_ptr<IBaseNode> getNextNode(const std::optional<std::string>& action) const = 0;
+    virtual bool hasSuccessors() const = 0;
+    virtual const std::string& getClassName() const = 0; // For logging
+
+    // Simplified next chaining accepting any IBaseNode. More type-safe versions
+    // can be added in the templated BaseNode.
+    virtual std::shared_ptr<IBaseNode> next(std::shared_ptr<IBaseNode> node, const std::string& action) = 0;
+    virtual std::shared_ptr<IBaseNode> next(std::shared_ptr<IBaseNode> node) = 0; // Default action
+
+    // Allow getting params (e.g., for result capture in tests)
+    virtual const Params& getParams() const = 0;
+
+    // Non-null for nodes that support non-blocking execution (AsyncNode, AsyncFlow)
+    virtual IAsyncNode* asAsyncNode() { return nullptr; }
+
+    // Successors keyed by action ("" = default); used by Flow::compile()
+    virtual const std::map<std::string, std::shared_ptr<IBaseNode>>& getSuccessors() const = 0;
+
+    // Actions post() may return. Empty means unknown; when non-empty, Flow::compile()
+    // rejects successors wired to actions the node never returns.
+    virtual std::vector<std::string> declaredActions() const { return {}; }
+
+    // Set for a nested flow that a compiled parent may splice into its own graph
+    virtual std::optional<InlineSubflow> inlineSubflow() const { return std::nullopt; }
+
+protected:
+    // Makes the compiled graphs containing this node recompile on their next run
+    void wiringChanged() { graphWatchers.notify(); }
+};
+
+namespace detail {
+    // Called by flows before starting `next`
+    inline void checkDeadline(const IBaseNode* next) {
+        DeadlineClock::time_point deadline = currentDeadline();
+        if (deadline != DeadlineClock::time_point::max() && DeadlineClock::now() >= deadline) {
+            throw DeadlineExceededException("Run deadline passed before node " + next->getClassName() + " could start");
+        }
+    }
+} // namespace detail
+
+
+// --- Async Node Interface ---
+class IAsyncNode {
+public:
+    virtual ~IAsyncNode() = default;
+
+    // Starts the node on `loop`. sharedContext must stay alive until the result is ready.
+    virtual AsyncResult<std::optional<std::string>> internalRunAsync(Context& sharedContext, EventLoop& loop) = 0;
+};
+
+
+// --- Fork Branch ---
+// One branch of a fork: the sub-flow starting at `start` and the context keys it may
+// write. A key ending in '*' matches every key with that prefix. With no declared
+// keys the branch may write anything, but no two branches may write the same key.
+struct ForkBranch {
+    std::shared_ptr<IBaseNode> start;
+    std::vector<std::string> contextKeys;
+
+    ForkBranch(std::shared_ptr<IBaseNode> branchStart, std::vector<std::string> writableKeys = {})
+        : start(std::move(branchStart)), contextKeys(std::move(writableKeys)) {}
+
+    template <typename NodeT>
+    ForkBranch(std::shared_ptr<NodeT> branchStart, std::vector<std::string> writableKeys = {})
+        : ForkBranch(std::shared_ptr<IBaseNode>(std::move(branchStart)), std::move(writableKeys)) {}
+
+    bool mayWrite(const std::string& key) const {
+        if (contextKeys.empty()) return true;
+        for (const auto& pattern : contextKeys) {
+            if (!pattern.empty() && pattern.back() == '*') {
+                if (key.compare(0, pattern.size() - 1, pattern, 0, pattern.size() - 1) == 0) return true;
+            } else if (pattern == key) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+
+// --- Memoization ---
+// Opt-in result cache for Node<P, E> whose exec is a pure function of its prep result
+// and a few params (Node::enableMemoization). A 64-bit hash picks the slot, and the
+// exact prep result and param values stored with each entry are compared on every hit,
+// so colliding hashes never share a result. Entries live in independently locked LRU
+// shards with an optional TTL, and concurrent misses on the same key run exec once
+// while the others wait for its result. Failures are not cached.
+enum class MemoOutcome : std::uint8_t { Hit, Miss, Shared };
+
+struct MemoOptions {
+    std::size_t capacity = 1024;              // Entries across all shards
+    std::chrono::milliseconds ttl{0};         // 0 = entries never expire
+    std::size_t shards = 16;
+};
+
+struct MemoStats {
+    std::uint64_t hits = 0;
+    std::uint64_t misses = 0;
+    std::uint64_t shared = 0;    // Lookups that joined an in-flight computation
+    std::uint64_t evictions = 0; // Entries dropped for capacity
+    std::uint64_t expirations = 0;
+};
+
+namespace detail {
+    template <typename T, typename = void>
+    struct IsStdHashable : std::false_type {};
+    template <typename T>
+    struct IsStdHashable<T, std::void_t<decltype(std::hash<T>{}(std::declval<const T&>()))>> : std::true_type {};
+
+    template <typename T, typename = void>
+    struct IsEqualityComparable : std::false_type {};
+    template <typename T>
+    struct IsEqualityComparable<T, std::void_t<decltype(bool(std::declval<const T&>() == std::declval<const T&>()))>> : std::true_type {};
+
+    inline std::uint64_t combineHash(std::uint64_t seed, std::uint64_t value) {
+        return seed ^ (value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2));
+    }
+
+    // splitmix64 finalizer: every input bit affects the whole word, so weak component
+    // hashes (std::hash<int> is the identity) do not cancel out once combined
+    inline std::uint64_t mixHash(std::uint64_t value) {
+        value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+        value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+        return value ^ (value >> 31);
+    }
+
+    inline std::uint64_t combineMemoHash(std::uint64_t seed, std::uint64_t value) {
+        return mixHash(combineHash(seed, mixHash(value)));
+    }
+
+    // Hash of a param value for memo keys; nullopt for types it cannot hash
+    inline std::optional<std::uint64_t> hashParamValue(const std::any& value) {
+        if (auto v = std::any_cast<std::string>(&value)) return std::hash<std::string>{}(*v);
+        if (auto v = std::any_cast<const char*>(&value)) return std::hash<std::string_view>{}(*v);
+        if (auto v = std::any_cast<int>(&value)) return std::hash<int>{}(*v);
+        if (auto v = std::any_cast<long>(&value)) return std::hash<long>{}(*v);
+        if (auto v = std::any_cast<long long>(&value)) return std::hash<long long>{}(*v);
+        if (auto v = std::any_cast<unsigned>(&value)) return std::hash<unsigned>{}(*v);
+        if (auto v = std::any_cast<unsigned long>(&value)) return std::hash<unsigned long>{}(*v);
+        if (auto v = std::any_cast<unsigned long long>(&value)) return std::hash<unsigned long long>{}(*v);
+        if (auto v = std::any_cast<bool>(&value)) return std::hash<bool>{}(*v);
+        if (auto v = std::any_cast<double>(&value)) return std::hash<double>{}(*v);
+        if (auto v = std::any_cast<float>(&value)) return std::hash<float>{}(*v);
+        return std::nullopt;
+    }
+
+    // Equality of two memo param values (nullptr = param not set); false for types
+    // hashParamValue cannot hash either
+    inline bool memoParamEquals(const std::any* a, const std::any* b) {
+        if (!a || !b) return a == b;
+        if (auto x = std::any_cast<const char*>(a)) {
+            auto y = std::any_cast<const char*>(b);
+            return y && std::string_view(*x) == std::string_view(*y);
+        }
+        return !anyValueChanged(*a, *b);
+    }
+
+    // Exact key behind a memo hash. Lookups pass a probe that only refers to the
+    // caller's values; clone() makes the owning copy an entry keeps.
+    class MemoIdentity {
+    public:
+        virtual ~MemoIdentity() = default;
+        virtual bool equals(const MemoIdentity& other) const = 0;
+        virtual std::shared_ptr<const MemoIdentity> clone() const = 0;
+    };
+
+    // Prep result plus the values of the node's memo params, in memo param order
+    template <typename P>
+    class MemoPrepIdentity final : public MemoIdentity {
+        std::optional<P> ownedPrep;
+        std::vector<std::any> ownedParams;
+        const P* prep;
+        std::vector<const std::any*> params; // nullptr = param not set
+
+    public:
+        MemoPrepIdentity(const P& prepResult, std::vector<const std::any*> paramValues)
+            : prep(&prepResult), params(std::move(paramValues)) {}
+
+        MemoPrepIdentity(const MemoPrepIdentity&) = delete;
+        MemoPrepIdentity& operator=(const MemoPrepIdentity&) = delete;
+
+        bool equals(const MemoIdentity& other) const override {
+            auto that = dynamic_cast<const MemoPrepIdentity*>(&other);
+            if (!that || params.size() != that->params.size() || !(*prep == *that->prep)) return false;
+            for (std::size_t i = 0; i < params.size(); ++i) {
+                if (!memoParamEquals(params[i], that->params[i])) return false;
+            }
+            return true;
+        }
+
+        std::shared_ptr<const MemoIdentity> clone() const override {
+            auto copy = std::make_shared<MemoPrepIdentity>(*prep, params);
+            copy->ownedPrep.emplace(*prep);
+            copy->prep = &*copy->ownedPrep;
+            copy->ownedParams.reserve(params.size()); // No reallocation: params point into it
+            for (const std::any*& value : copy->params) {
+                if (!value) continue;
+                copy->ownedParams.push_back(*value);
+                value = &copy->ownedParams.back();
+            }
+            return copy;
+        }
+    };
+
+    // A stored identity matches a probe if both are absent (hash-only keys) or equal
+    inline bool sameMemoIdentity(const std::shared_ptr<const MemoIdentity>& stored, const MemoIdentity* probe) {
+        if (!stored || !probe) return !stored && !probe;
+        return stored->equals(*probe);
+    }
+} // namespace detail
+
+template <typename E>
+class MemoCache {
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry {
+        std::uint64_t key;
+        std::shared_ptr<const detail::MemoIdentity> identity; // nullptr = keyed by the hash alone
+        E value;
+        Clock::time_point expires;
+    };
+
+    // One computation other lookups of the same key wait for
+    struct Flight {
+        std::shared_ptr<const detail::MemoIdentity> identity;
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool done = false;
+        std::optional<E> value;
+        std::exception_ptr error;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::list<Entry> lru; // Most recently used first
+        std::unordered_map<std::uint64_t, typename std::list<Entry>::iterator> index;
+        std::unordered_map<std::uint64_t, std::shared_ptr<Flight>> inFlight;
+    };
+
+    MemoOptions options;
+    std::size_t shardCapacity;
+    std::unique_ptr<Shard[]> shardData;
+    std::atomic<std::uint64_t> hitCount{0};
+    std::atomic<std::uint64_t> missCount{0};
+    std::atomic<std::uint64_t> sharedCount{0};
+    std::atomic<std::uint64_t> evictionCount{0};
+    std::atomic<std::uint64_t> expirationCount{0};
+
+public:
+    explicit MemoCache(MemoOptions cacheOptions = {}) : options(cacheOptions) {
+        if (options.capacity == 0) throw std::invalid_argument("MemoCache capacity must be at least 1");
+        if (options.ttl.count() < 0) throw std::invalid_argument("MemoCache ttl cannot be negative");
+        options.shards = std::max<std::size_t>(1, std::min(options.shards, options.capacity));
+        shardCapacity = (options.capacity + options.shards - 1) / options.shards;
+        shardData.reset(new Shard[options.shards]);
+    }
+
+    MemoCache(const MemoCache&) = delete;
+    MemoCache& operator=(const MemoCache&) = delete;
+
+    const MemoOptions& getOptions() const { return options; }
+
+    // Cached value for key, or compute()'s result once it is stored. Lookups that arrive
+    // while the same key is being computed wait and share its value or exception.
+    template <typename F>
+    E getOrCompute(std::uint64_t key, F&& compute, MemoOutcome* outcome = nullptr) {
+        return getOrCompute(key, nullptr, std::forward<F>(compute), outcome);
+    }
+
+    // Same, but a cached or in-flight value is used only if its identity equals
+    // `identity` too. A colliding entry is replaced; a colliding computation in flight
+    // is not joined, and this one runs on its own.
+    template <typename F>
+    E getOrCompute(std::uint64_t key, const detail::MemoIdentity* identity, F&& compute, MemoOutcome* outcome = nullptr) {
+        Shard& shard = shardFor(key);
+        std::shared_ptr<Flight> flight;
+        std::shared_ptr<const detail::MemoIdentity> ownedIdentity;
+        bool leader = false;
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            if (const E* cached = findLocked(shard, key, identity)) {
+                hitCount.fetch_add(1, std::memory_order_relaxed);
+                if (outcome) *outcome = MemoOutcome::Hit;
+                return *cached;
+            }
+            auto running = shard.inFlight.find(key);
+            if (running != shard.inFlight.end() && detail::sameMemoIdentity(running->second->identity, identity)) {
+                flight = running->second;
+            } else {
+                ownedIdentity = identity ? identity->clone() : nullptr;
+                if (running == shard.inFlight.end()) {
+                    flight = std::make_shared<Flight>();
+                    flight->identity = ownedIdentity;
+                    shard.inFlight.emplace(key, flight);
+                    leader = true;
+                }
+            }
+        }
+
+        if (flight && !leader) {
+            sharedCount.fetch_add(1, std::memory_order_relaxed);
+            if (outcome) *outcome = MemoOutcome::Shared;
+            std::unique_lock<std::mutex> lock(flight->mutex);
+            flight->cv.wait(lock, [&] { return flight->done; });
+            if (flight->error) std::rethrow_exception(flight->error);
+            return *flight->value;
+        }
+
+        missCount.fetch_add(1, std::memory_order_relaxed);
+        if (outcome) *outcome = MemoOutcome::Miss;
+        std::optional<E> value;
+        std::exception_ptr error;
+        try {
+            value.emplace(compute());
+        } catch (...) {
+            error = std::current_exception();
+        }
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            if (value) insertLocked(shard, key, ownedIdentity, *value);
+            if (leader) shard.inFlight.erase(key);
+        }
+        if (leader) {
+            std::lock_guard<std::mutex> lock(flight->mutex);
+            if (value) flight->value = value;
+            flight->error = error;
+            flight->done = true;
+        }
+        if (leader) flight->cv.notify_all();
+        if (error) std::rethrow_exception(error);
+        return std::move(*value);
+    }
+
+    // Entry stored under key alone (no identity), as insert() adds them
+    std::optional<E> find(std::uint64_t key) {
+        Shard& shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (const E* cached = findLocked(shard, key, nullptr)) return *cached;
+        return std::nullopt;
+    }
+
+    void insert(std::uint64_t key, E value) {
+        Shard& shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        insertLocked(shard, key, nullptr, std::move(value));
+    }
+
+    bool erase(std::uint64_t key) {
+        Shard& shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.index.find(key);
+        if (it == shard.index.end()) return false;
+        shard.lru.erase(it->second);
+        shard.index.erase(it);
+        return true;
+    }
+
+    void clear() {
+        for (std::size_t i = 0; i < options.shards; ++i) {
+            std::lock_guard<std::mutex> lock(shardData[i].mutex);
+            shardData[i].lru.clear();
+            shardData[i].index.clear();
+        }
+    }
+
+    std::size_t size() const {
+        std::size_t total = 0;
+        for (std::size_t i = 0; i < options.shards; ++i) {
+            std::lock_guard<std::mutex> lock(shardData[i].mutex);
+            total += shardData[i].lru.size();
+        }
+        return total;
+    }
+
+    MemoStats stats() const {
+        MemoStats result;
+        result.hits = hitCount.load(std::memory_order_relaxed);
+        result.misses = missCount.load(std::memory_order_relaxed);
+        result.shared = sharedCount.load(std::memory_order_relaxed);
+        result.evictions = evictionCount.load(std::memory_order_relaxed);
+        result.expirations = expirationCount.load(std::memory_order_relaxed);
+        return result;
+    }
+
+private:
+    Shard& shardFor(std::uint64_t key) {
+        // Mix the high bits in so keys differing only there still spread over shards
+        return shardData[(key ^ (key >> 32)) % options.shards];
+    }
+
+    // Caller holds the shard lock; refreshes the entry's LRU position
+    const E* findLocked(Shard& shard, std::uint64_t key, const detail::MemoIdentity* identity) {
+        auto it = shard.index.find(key);
+        if (it == shard.index.end()) return nullptr;
+        if (!detail::sameMemoIdentity(it->second->identity, identity)) return nullptr; // Collision: a different key
+        if (options.ttl.count() > 0 && Clock::now() >= it->second->expires) {
+            shard.lru.erase(it->second);
+            shard.index.erase(it);
+            expirationCount.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        return &it->second->value;
+    }
+
+    void insertLocked(Shard& shard, std::uint64_t key, std::shared_ptr<const detail::MemoIdentity> identity, E value) {
+        Clock::time_point expires = options.ttl.count() > 0 ? Clock::now() + options.ttl : Clock::time_point::max();
+        auto it = shard.index.find(key);
+        if (it != shard.index.end()) {
+            it->second->identity = std::move(identity);
+            it->second->value = std::move(value);
+            it->second->expires = expires;
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+            return;
+        }
+        shard.lru.push_front(Entry{key, std::move(identity), std::move(value), expires});
+        shard.index.emplace(key, shard.lru.begin());
+        if (shard.lru.size() > shardCapacity) {
+            shard.index.erase(shard.lru.back().key);
+            shard.lru.pop_back();
+            evictionCount.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+};
+
+
+// --- Tracing ---
+// Opt-in instrumentation of every node run: prep/exec/post durations, each exec
+// attempt, retries, fallbacks and the chosen action. Define COGNITOFLOW_ENABLE_TRACING
+// to 1 before including this header to compile the hooks in; otherwise they are empty
+// inline functions that cost nothing. Each thread records into its own buffer with
+// relaxed atomic stores, so the hot path takes no locks. Tracer::instance() merges the
+// buffers on demand into per-node summaries or Chrome trace / OpenTelemetry spans.
+#ifndef COGNITOFLOW_ENABLE_TRACING
+#define COGNITOFLOW_ENABLE_TRACING 0
+#endif
+
+enum class TraceStage : std::uint8_t {
+    Node,     // Whole node run, prep through post
+    Prep,
+    Exec,     // internalExec, including every attempt, wait and fallback
+    Post,
+    Attempt,  // One exec attempt of a retrying node
+    Fallback
+};
+constexpr std::size_t TRACE_STAGE_COUNT = 6;
+
+inline const char* traceStageName(TraceStage stage) {
+    static const char* const names[TRACE_STAGE_COUNT] = {"node", "prep", "exec", "post", "attempt", "fallback"};
+    return names[static_cast<std::size_t>(stage)];
+}
+
+namespace detail {
+    struct AtomicHistogram;
+
+    inline unsigned highestBit(std::uint64_t value) { // value must be non-zero
+#if defined(__GNUC__) || defined(__clang__)
+        return 63u - static_cast<unsigned>(__builtin_clzll(value));
+#else
+        unsigned bit = 0;
+        while (value >>= 1) ++bit;
+        return bit;
+#endif
+    }
+
+    inline std::uint64_t traceNow() {
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+} // namespace detail
+
+// Log-linear latency histogram in nanoseconds. Four buckets per power of two keep
+// percentiles within 25% of the true value over the whole 64-bit range.
+class LatencyHistogram {
+public:
+    static constexpr std::size_t BUCKET_COUNT = 252;
+
+    static std::size_t bucketFor(std::uint64_t nanos) {
+        if (nanos < 4) return static_cast<std::size_t>(nanos);
+        unsigned msb = detail::highestBit(nanos);
+        return (msb - 1) * 4 + static_cast<std::size_t>((nanos >> (msb - 2)) & 3);
+    }
+
+    // Largest value that falls into `bucket`
+    static std::uint64_t bucketUpperBound(std::size_t bucket) {
+        if (bucket < 4) return bucket;
+        unsigned msb = static_cast<unsigned>(bucket / 4 + 1);
+        std::uint64_t lower = static_cast<std::uint64_t>(4 + bucket % 4) << (msb - 2);
+        return lower + ((std::uint64_t{1} << (msb - 2)) - 1);
+    }
+
+    void record(std::uint64_t nanos) {
+        ++bucketCounts[bucketFor(nanos)];
+        ++samples;
+        total += nanos;
+        minimum = std::min(minimum, nanos);
+        maximum = std::max(maximum, nanos);
+    }
+
+    void merge(const LatencyHistogram& other) {
+        for (std::size_t i = 0; i < BUCKET_COUNT; ++i) bucketCounts[i] += other.bucketCounts[i];
+        samples += other.samples;
+        total += other.total;
+        minimum = std::min(minimum, other.minimum);
+        maximum = std::max(maximum, other.maximum);
+    }
+
+    std::uint64_t count() const { return samples; }
+    std::uint64_t totalNanos() const { return total; }
+    std::uint64_t minNanos() const { return samples ? minimum : 0; }
+    std::uint64_t maxNanos() const { return maximum; }
+    double meanNanos() const { return samples ? static_cast<double>(total) / static_cast<double>(samples) : 0.0; }
+
+    // Upper bound of the bucket holding the q-quantile (0 <= q <= 1), capped at the maximum
+    std::uint64_t percentile(double q) const {
+        if (samples == 0) return 0;
+        double clamped = std::min(1.0, std::max(0.0, q));
+        std::uint64_t rank = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(clamped * static_cast<double>(samples) + 0.5));
+        std::uint64_t seen = 0;
+        for (std::size_t i = 0; i < BUCKET_COUNT; ++i) {
+            seen += bucketCounts[i];
+            if (seen >= rank) return std::min(bucketUpperBound(i), maximum);
+        }
+        return maximum;
+    }
+
+    const std::array<std::uint64_t, BUCKET_COUNT>& buckets() const { return bucketCounts; }
+
+private:
+    friend struct detail::AtomicHistogram;
+
+    std::array<std::uint64_t, BUCKET_COUNT> bucketCounts{};
+    std::uint64_t samples = 0;
+    std::uint64_t total = 0;
+    std::uint64_t minimum = UINT64_MAX;
+    std::uint64_t maximum = 0;
+};
+
+// Everything recorded for one node, merged over all threads
+struct NodeTraceSummary {
+    const IBaseNode* node = nullptr;
+    std::string name;
+    std::array<LatencyHistogram, TRACE_STAGE_COUNT> stages;
+    std::uint64_t retries = 0;   // Attempts after the first, batch items included
+    std::uint64_t fallbacks = 0; // execFallback / execItemFallback invocations
+    std::uint64_t failures = 0;  // Node runs that ended with an exception
+    std::uint64_t memoHits = 0;   // Memoized exec results served from the cache
+    std::uint64_t memoMisses = 0; // Memoized execs that ran
+    std::uint64_t memoShared = 0; // Memoized execs that waited for an identical in-flight one
+    std::map<std::string, std::uint64_t> actions; // Chosen action -> count ("" = default)
+
+    const LatencyHistogram& stage(TraceStage which) const { return stages[static_cast<std::size_t>(which)]; }
+};
+
+// One recorded stage, as exported to trace viewers
+struct TraceSpan {
+    const IBaseNode* node = nullptr;
+    std::string name;
+    TraceStage stage = TraceStage::Node;
+    std::uint32_t threadIndex = 0;
+    std::uint64_t startNanos = 0; // Relative to the tracer's creation
+    std::uint64_t durationNanos = 0;
+    int attempt = 0;
+    bool failed = false;
+    std::optional<std::string> action; // Node spans that completed
+};
+
+namespace detail {
+    // Written by a single thread, read by any: plain load+store increments suffice
+    inline void bumpCounter(std::atomic<std::uint64_t>& counter, std::uint64_t by = 1) {
+        counter.store(counter.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+    }
+
+    struct AtomicHistogram {
+        std::array<std::atomic<std::uint64_t>, LatencyHistogram::BUCKET_COUNT> bucketCounts{};
+        std::atomic<std::uint64_t> samples{0};
+        std::atomic<std::uint64_t> total{0};
+        std::atomic<std::uint64_t> minimum{UINT64_MAX};
+        std::atomic<std::uint64_t> maximum{0};
+
+        void record(std::uint64_t nanos) {
+            bumpCounter(bucketCounts[LatencyHistogram::bucketFor(nanos)]);
+            bumpCounter(samples);
+            bumpCounter(total, nanos);
+            if (nanos < minimum.load(std::memory_order_relaxed)) minimum.store(nanos, std::memory_order_relaxed);
+            if (nanos > maximum.load(std::memory_order_relaxed)) maximum.store(nanos, std::memory_order_relaxed);
+        }
+
+        void addTo(LatencyHistogram& out) const {
+            for (std::size_t i = 0; i < LatencyHistogram::BUCKET_COUNT; ++i) {
+                out.bucketCounts[i] += bucketCounts[i].load(std::memory_order_relaxed);
+            }
+            out.samples += samples.load(std::memory_order_relaxed);
+            out.total += total.load(std::memory_order_relaxed);
+            out.minimum = std::min(out.minimum, minimum.load(std::memory_order_relaxed));
+            out.maximum = std::max(out.maximum, maximum.load(std::memory_order_relaxed));
+        }
+
+        void reset() {
+            for (auto& bucket : bucketCounts) bucket.store(0, std::memory_order_relaxed);
+            samples.store(0, std::memory_order_relaxed);
+            total.store(0, std::memory_order_relaxed);
+            minimum.store(UINT64_MAX, std::memory_order_relaxed);
+            maximum.store(0, std::memory_order_relaxed);
+        }
+    };
+
+    struct TracedAction {
+        std::string action;
+        std::atomic<std::uint64_t> count{0};
+    };
+
+    struct TracedNode {
+        const IBaseNode* node = nullptr;
+        std::string name;
+        std::array<AtomicHistogram, TRACE_STAGE_COUNT> stages;
+        std::atomic<std::uint64_t> retries{0};
+        std::atomic<std::uint64_t> fallbacks{0};
+        std::atomic<std::uint64_t> failures{0};
+        std::atomic<std::uint64_t> memoHits{0};
+        std::atomic<std::uint64_t> memoMisses{0};
+        std::atomic<std::uint64_t> memoShared{0};
+        std::vector<std::unique_ptr<TracedAction>> actions; // Grown by the owner under ThreadTrace::mutex
+    };
+
+    // One slot of a thread's span ring. The owner bumps `sequence` to odd while it
+    // rewrites the slot, so readers can detect and skip torn slots (seqlock). Fields are
+    // stored with release and loaded with acquire, which orders them without fences.
+    struct SpanSlot {
+        std::atomic<std::uint64_t> sequence{0};
+        std::atomic<TracedNode*> node{nullptr};
+        std::atomic<std::uint64_t> meta{0}; // stage | failed << 8 | attempt << 16 | (action + 1) << 40
+        std::atomic<std::uint64_t> start{0};
+        std::atomic<std::uint64_t> duration{0};
+    };
+
+    // Trace buffer of one thread. Only that thread records into it; readers lock
+    // `mutex`, which the owner takes only when it sees a node or action for the first time.
+    class ThreadTrace {
+    public:
+        const std::uint32_t index;
+        std::mutex mutex;
+        std::unordered_map<const IBaseNode*, std::unique_ptr<TracedNode>> nodes;
+        const std::size_t capacity;
+        std::unique_ptr<SpanSlot[]> slots;
+        std::atomic<std::uint64_t> written{0};
+        std::atomic<std::uint64_t> firstVisible{0}; // Spans before this were cleared by Tracer::reset
+
+        ThreadTrace(std::uint32_t threadIndex, std::size_t spanCapacity)
+            : index(threadIndex), capacity(std::max<std::size_t>(1, spanCapacity)), slots(new SpanSlot[capacity]) {}
+
+        TracedNode& nodeFor(const IBaseNode* node) {
+            auto it = nodes.find(node); // Lock-free: only this thread modifies the map
+            if (it != nodes.end()) return *it->second;
+            auto traced = std::make_unique<TracedNode>();
+            traced->node = node;
+            traced->name = typeid(*node).name(); // Dynamic type; className is taken during BaseNode construction
+            std::lock_guard<std::mutex> lock(mutex);
+            return *nodes.emplace(node, std::move(traced)).first->second;
+        }
+
+        // Counts `action` for the node and returns its index in the node's action table
+        std::uint32_t countAction(TracedNode& traced, const std::optional<std::string>& action) {
+            const std::string& key = action ? *action : std::string();
+            for (std::size_t i = 0; i < traced.actions.size(); ++i) {
+                if (traced.actions[i]->action == key) {
+                    bumpCounter(traced.actions[i]->count);
+                    return static_cast<std::uint32_t>(i);
+                }
+            }
+            auto entry = std::make_unique<TracedAction>();
+            entry->action = key;
+            entry->count.store(1, std::memory_order_relaxed);
+            std::lock_guard<std::mutex> lock(mutex);
+            traced.actions.push_back(std::move(entry));
+            return static_cast<std::uint32_t>(traced.actions.size() - 1);
+        }
+
+        void pushSpan(TracedNode& traced, TraceStage stage, std::uint64_t start, std::uint64_t duration,
+                      int attempt, bool failed, std::int64_t actionIndex) {
+            std::uint64_t position = written.load(std::memory_order_relaxed);
+            SpanSlot& slot = slots[position % capacity];
+            std::uint64_t sequence = slot.sequence.load(std::memory_order_relaxed);
+            slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+            slot.node.store(&traced, std::memory_order_release);
+            slot.meta.store(static_cast<std::uint64_t>(stage)
+                                | (failed ? std::uint64_t{1} << 8 : 0)
+                                | (static_cast<std::uint64_t>(std::min(attempt, 0xFFFFFF)) << 16)
+                                | (static_cast<std::uint64_t>(actionIndex + 1) << 40),
+                            std::memory_order_release);
+            slot.start.store(start, std::memory_order_release);
+            slot.duration.store(duration, std::memory_order_release);
+            slot.sequence.store(sequence + 2, std::memory_order_release);
+            written.store(position + 1, std::memory_order_release);
+        }
+    };
+} // namespace detail
+
+// Process-wide collector of per-thread trace buffers. Recording is on by default when
+// tracing is compiled in; setEnabled(false) pauses it and setSpansEnabled(false) keeps
+// only the histograms and counters, which is the cheaper setting for production.
+class Tracer {
+    mutable std::mutex registryMutex;
+    std::vector<std::shared_ptr<detail::ThreadTrace>> threads;
+    std::atomic<bool> enabled{true};
+    std::atomic<bool> spansOn{true};
+    std::atomic<std::size_t> spanCapacity{16384};
+    const std::uint64_t epochNanos = detail::traceNow();
+    const std::int64_t unixEpochNanos = static_cast<std::int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+
+    Tracer() = default;
+
+public:
+    Tracer(const Tracer&) = delete;
+    Tracer& operator=(const Tracer&) = delete;
+
+    static Tracer& instance() {
+        static Tracer* tracer = new Tracer(); // Never destroyed: executor threads may trace during exit
+        return *tracer;
+    }
+
+    static constexpr bool compiledIn() { return COGNITOFLOW_ENABLE_TRACING != 0; }
+
+    void setEnabled(bool on) { enabled.store(on, std::memory_order_relaxed); }
+    bool isEnabled() const { return compiledIn() && enabled.load(std::memory_order_relaxed); }
+
+    void setSpansEnabled(bool on) { spansOn.store(on, std::memory_order_relaxed); }
+    bool spansEnabled() const { return spansOn.load(std::memory_order_relaxed); }
+
+    // Ring size for threads that start recording afterwards; older spans are overwritten
+    void setSpanCapacity(std::size_t spansPerThread) { spanCapacity.store(spansPerThread, std::memory_order_relaxed); }
+
+    // Buffer of the calling thread, registered on first use
+    detail::ThreadTrace& threadTrace() {
+        thread_local std::shared_ptr<detail::ThreadTrace> local;
+        if (!local) {
+            std::lock_guard<std::mutex> lock(registryMutex);
+            local = std::make_shared<detail::ThreadTrace>(static_cast<std::uint32_t>(threads.size()),
+                                                          spanCapacity.load(std::memory_order_relaxed));
+            threads.push_back(local);
+        }
+        return *local;
+    }
+
+    void recordStage(const IBaseNode* node, TraceStage stage, std::uint64_t start, std::uint64_t end,
+                     int attempt = 0, bool failed = false, const std::optional<std::string>* action = nullptr) {
+        detail::ThreadTrace& trace = threadTrace();
+        detail::TracedNode& traced = trace.nodeFor(node);
+        std::uint64_t duration = end > start ? end - start : 0;
+        traced.stages[static_cast<std::size_t>(stage)].record(duration);
+        if (stage == TraceStage::Fallback) detail::bumpCounter(traced.fallbacks);
+        if (stage == TraceStage::Node && failed) detail::bumpCounter(traced.failures);
+        std::int64_t actionIndex = action ? static_cast<std::int64_t>(trace.countAction(traced, *action)) : -1;
+        if (spansEnabled()) {
+            trace.pushSpan(traced, stage, start, duration, attempt, failed, actionIndex);
+        }
+    }
+
+    void recordRetry(const IBaseNode* node) {
+        detail::bumpCounter(threadTrace().nodeFor(node).retries);
+    }
+
+    void recordMemo(const IBaseNode* node, MemoOutcome outcome) {
+        detail::TracedNode& traced = threadTrace().nodeFor(node);
+        switch (outcome) {
+            case MemoOutcome::Hit: detail::bumpCounter(traced.memoHits); break;
+            case MemoOutcome::Miss: detail::bumpCounter(traced.memoMisses); break;
+            case MemoOutcome::Shared: detail::bumpCounter(traced.memoShared); break;
+        }
+    }
+
+    // Per-node totals merged over every thread, in order of first appearance
+    std::vector<NodeTraceSummary> summary() const {
+        std::vector<NodeTraceSummary> result;
+        std::unordered_map<const IBaseNode*, std::size_t> indexOf;
+        for (const auto& trace : snapshotThreads()) {
+            std::lock_guard<std::mutex> lock(trace->mutex);
+            for (const auto& entry : trace->nodes) {
+                const detail::TracedNode& traced = *entry.second;
+                auto inserted = indexOf.emplace(traced.node, result.size());
+                if (inserted.second) {
+                    result.emplace_back();
+                    result.back().node = traced.node;
+                    result.back().name = traced.name;
+                }
+                NodeTraceSummary& merged = result[inserted.first->second];
+                for (std::size_t s = 0; s < TRACE_STAGE_COUNT; ++s) traced.stages[s].addTo(merged.stages[s]);
+                merged.retries += traced.retries.load(std::memory_order_relaxed);
+                merged.fallbacks += traced.fallbacks.load(std::memory_order_relaxed);
+                merged.failures += traced.failures.load(std::memory_order_relaxed);
+                merged.memoHits += traced.memoHits.load(std::memory_order_relaxed);
+                merged.memoMisses += traced.memoMisses.load(std::memory_order_relaxed);
+                merged.memoShared += traced.memoShared.load(std::memory_order_relaxed);
+                for (const auto& action : traced.actions) {
+                    merged.actions[action->action] += action->count.load(std::memory_order_relaxed);
+                }
+            }
+        }
+        result.erase(std::remove_if(result.begin(), result.end(), [](const NodeTraceSummary& s) {
+            for (const auto& stage : s.stages) if (stage.count()) return false;
+            return s.retries == 0 && s.memoHits == 0 && s.memoShared == 0;
+        }), result.end());
+        return result;
+    }
+
+    // Spans still held by the per-thread rings, ordered by thread and start time
+    std::vector<TraceSpan> spans() const {
+        std::vector<TraceSpan> result;
+        for (const auto& trace : snapshotThreads()) {
+            std::lock_guard<std::mutex> lock(trace->mutex);
+            std::uint64_t end = trace->written.load(std::memory_order_acquire);
+            std::uint64_t begin = std::max(trace->firstVisible.load(std::memory_order_relaxed),
+                                           end > trace->capacity ? end - trace->capacity : 0);
+            for (std::uint64_t position = begin; position < end; ++position) {
+                const detail::SpanSlot& slot = trace->slots[position % trace->capacity];
+                std::uint64_t expected = 2 * (position / trace->capacity + 1);
+                if (slot.sequence.load(std::memory_order_acquire) != expected) continue;
+                detail::TracedNode* traced = slot.node.load(std::memory_order_acquire);
+                std::uint64_t meta = slot.meta.load(std::memory_order_acquire);
+                TraceSpan span;
+                span.startNanos = slot.start.load(std::memory_order_acquire);
+                span.durationNanos = slot.duration.load(std::memory_order_acquire);
+                if (slot.sequence.load(std::memory_order_relaxed) != expected || !traced) continue;
+
+                span.node = traced->node;
+                span.name = traced->name;
+                span.stage = static_cast<TraceStage>(meta & 0xFF);
+                span.failed = (meta >> 8) & 1;
+                span.attempt = static_cast<int>((meta >> 16) & 0xFFFFFF);
+                std::uint64_t action = meta >> 40;
+                if (action && action - 1 < traced->actions.size()) span.action = traced->actions[action - 1]->action;
+                span.threadIndex = trace->index;
+                span.startNanos = span.startNanos > epochNanos ? span.startNanos - epochNanos : 0;
+                result.push_back(std::move(span));
+            }
+        }
+        std::stable_sort(result.begin(), result.end(), [](const TraceSpan& a, const TraceSpan& b) {
+            if (a.threadIndex != b.threadIndex) return a.threadIndex < b.threadIndex;
+            if (a.startNanos != b.startNanos) return a.startNanos < b.startNanos;
+            return a.durationNanos > b.durationNanos; // Enclosing span first
+        });
+        return result;
+    }
+
+    // Chrome trace event format; open in chrome://tracing or https://ui.perfetto.dev
+    void writeChromeTrace(std::ostream& out) const {
+        out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+        bool first = true;
+        for (const TraceSpan& span : spans()) {
+            out << (first ? "" : ",") << "\n{\"name\":";
+            first = false;
+            writeJsonString(out, span.stage == TraceStage::Node ? span.name : span.name + "." + traceStageName(span.stage));
+            out << ",\"cat\":\"" << traceStageName(span.stage) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << span.threadIndex
+                << ",\"ts\":" << formatMicros(span.startNanos) << ",\"dur\":" << formatMicros(span.durationNanos)
+                << ",\"args\":{\"attempt\":" << span.attempt;
+            if (span.failed) out << ",\"failed\":true";
+            if (span.action) {
+                out << ",\"action\":";
+                writeJsonString(out, *span.action);
+            }
+            out << "}}";
+        }
+        out << "\n]}\n";
+    }
+
+    // OTLP/JSON ExportTraceServiceRequest. Spans nested on one thread become parent and
+    // child; every outermost span starts a new trace.
+    void writeOpenTelemetryJson(std::ostream& out, const std::string& serviceName = "cognitoflow") const {
+        std::vector<TraceSpan> all = spans();
+        out << "{\"resourceSpans\":[{\"resource\":{\"attributes\":[{\"key\":\"service.name\",\"value\":{\"stringValue\":";
+        writeJsonString(out, serviceName);
+        out << "}}]},\"scopeSpans\":[{\"scope\":{\"name\":\"cognitoflow\"},\"spans\":[";
+
+        std::vector<std::size_t> open; // Indices of enclosing spans on the current thread
+        std::vector<std::uint64_t> traceOf(all.size());
+        std::uint64_t traces = 0;
+        for (std::size_t i = 0; i < all.size(); ++i) {
+            const TraceSpan& span = all[i];
+            while (!open.empty() && (all[open.back()].threadIndex != span.threadIndex
+                   || all[open.back()].startNanos + all[open.back()].durationNanos < span.startNanos + span.durationNanos)) {
+                open.pop_back();
+            }
+            traceOf[i] = open.empty() ? ++traces : traceOf[open.back()];
+
+            out << (i ? "," : "") << "\n{\"traceId\":\"" << hexId(static_cast<std::uint64_t>(unixEpochNanos)) << hexId(traceOf[i])
+                << "\",\"spanId\":\"" << hexId(i + 1) << "\"";
+            if (!open.empty()) out << ",\"parentSpanId\":\"" << hexId(open.back() + 1) << "\"";
+            out << ",\"name\":";
+            writeJsonString(out, span.stage == TraceStage::Node ? span.name : span.name + "." + traceStageName(span.stage));
+            std::uint64_t startUnix = static_cast<std::uint64_t>(unixEpochNanos) + span.startNanos;
+            out << ",\"kind\":1,\"startTimeUnixNano\":\"" << startUnix << "\",\"endTimeUnixNano\":\"" << startUnix + span.durationNanos
+                << "\",\"attributes\":[{\"key\":\"cognitoflow.stage\",\"value\":{\"stringValue\":\"" << traceStageName(span.stage)
+                << "\"}},{\"key\":\"cognitoflow.attempt\",\"value\":{\"intValue\":\"" << span.attempt
+                << "\"}},{\"key\":\"thread.id\",\"value\":{\"intValue\":\"" << span.threadIndex << "\"}}";
+            if (span.action) {
+                out << ",{\"key\":\"cognitoflow.action\",\"value\":{\"stringValue\":";
+                writeJsonString(out, *span.action);
+                out << "}}";
+            }
+            out << "],\"status\":{\"code\":" << (span.failed ? 2 : 1) << "}}";
+            open.push_back(i);
+        }
+        out << "\n]}]}]}\n";
+    }
+
+    // Clears recorded data and forgets the buffers of threads that have exited.
+    // Counts recorded concurrently with a reset may be partially lost.
+    void reset() {
+        std::lock_guard<std::mutex> registryLock(registryMutex);
+        threads.erase(std::remove_if(threads.begin(), threads.end(), [](const std::shared_ptr<detail::ThreadTrace>& trace) {
+            return trace.use_count() == 1;
+        }), threads.end());
+        for (const auto& trace : threads) {
+            std::lock_guard<std::mutex> lock(trace->mutex);
+            trace->firstVisible.store(trace->written.load(std::memory_order_acquire), std::memory_order_relaxed);
+            for (auto& entry : trace->nodes) {
+                detail::TracedNode& traced = *entry.second;
+                for (auto& stage : traced.stages) stage.reset();
+                traced.retries.store(0, std::memory_order_relaxed);
+                traced.fallbacks.store(0, std::memory_order_relaxed);
+                traced.failures.store(0, std::memory_order_relaxed);
+                traced.memoHits.store(0, std::memory_order_relaxed);
+                traced.memoMisses.store(0, std::memory_order_relaxed);
+                traced.memoShared.store(0, std::memory_order_relaxed);
+                for (auto& action : traced.actions) action->count.store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    std::vector<std::shared_ptr<detail::ThreadTrace>> snapshotThreads() const {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        return threads;
+    }
+
+    static std::string formatMicros(std::uint64_t nanos) {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%llu.%03llu", static_cast<unsigned long long>(nanos / 1000),
+                      static_cast<unsigned long long>(nanos % 1000));
+        return buffer;
+    }
+
+    static std::string hexId(std::uint64_t value) {
+        char buffer[17];
+        std::snprintf(buffer, sizeof(buffer), "%016llx", static_cast<unsigned long long>(value));
+        return buffer;
+    }
+
+    static void writeJsonString(std::ostream& out, const std::string& text) {
+        out << '"';
+        for (char c : text) {
+            switch (c) {
+                case '"': out << "\\\""; break;
+                case '\\': out << "\\\\"; break;
+                case '\n': out << "\\n"; break;
+                case '\t': out << "\\t"; break;
+                default:
+                    if (static_cast<unsigned char>(c) < 0x20) {
+                        char escaped[8];
+                        std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(c));
+                        out << escaped;
+                    } else {
+                        out << c;
+                    }
+            }
+        }
+        out << '"';
+    }
+};
+
+namespace detail {
+#if COGNITOFLOW_ENABLE_TRACING
+    // Times the stages of one node run; records a failed node span if destroyed unfinished.
+    // Samples go to the buffer of whichever thread records them, so async runs work too.
+    class NodeTrace {
+        const IBaseNode* node;
+        std::uint64_t nodeStart;
+        std::uint64_t stageStart;
+        bool finished = false;
+    public:
+        explicit NodeTrace(const IBaseNode* tracedNode)
+            : node(Tracer::instance().isEnabled() ? tracedNode : nullptr),
+              nodeStart(node ? traceNow() : 0), stageStart(nodeStart) {}
+        NodeTrace(const NodeTrace&) = delete;
+        NodeTrace& operator=(const NodeTrace&) = delete;
+        ~NodeTrace() {
+            if (node && !finished) Tracer::instance().recordStage(node, TraceStage::Node, nodeStart, traceNow(), 0, true);
+        }
+
+        // Ends the stage that began at the previous mark (or at construction)
+        void stageDone(TraceStage stage) {
+            if (!node) return;
+            std::uint64_t now = traceNow();
+            Tracer::instance().recordStage(node, stage, stageStart, now);
+            stageStart = now;
+        }
+
+        void finish(const std::optional<std::string>& action) {
+            if (!node) return;
+            finished = true;
+            Tracer::instance().recordStage(node, TraceStage::Node, nodeStart, traceNow(), 0, false, &action);
+        }
+
+        void finish(Action token) {
+            if (!node) return;
+            finish(token.toOptional());
+        }
+    };
+
+    // Times one attempt or fallback call; counts as failed unless done() is called
+    class StageTrace {
+        const IBaseNode* node;
+        TraceStage stage;
+        int attempt;
+        std::uint64_t start;
+        bool finished = false;
+    public:
+        StageTrace(const IBaseNode* tracedNode, TraceStage tracedStage, int attemptIndex = 0)
+            : node(Tracer::instance().isEnabled() ? tracedNode : nullptr), stage(tracedStage),
+              attempt(attemptIndex), start(node ? traceNow() : 0) {}
+        StageTrace(const StageTrace&) = delete;
+        StageTrace& operator=(const StageTrace&) = delete;
+        ~StageTrace() {
+            if (node && !finished) Tracer::instance().recordStage(node, stage, start, traceNow(), attempt, true);
+        }
+
+        void done() {
+            if (!node) return;
+            finished = true;
+            Tracer::instance().recordStage(node, stage, start, traceNow(), attempt);
+        }
+    };
+
+    inline void traceRetry(const IBaseNode* node) {
+        if (Tracer::instance().isEnabled()) Tracer::instance().recordRetry(node);
+    }
+
+    inline void traceMemo(const IBaseNode* node, MemoOutcome outcome) {
+        if (Tracer::instance().isEnabled()) Tracer::instance().recordMemo(node, outcome);
+    }
+#else
+    class NodeTrace {
+    public:
+        explicit NodeTrace(const IBaseNode*) {}
+        void stageDone(TraceStage) {}
+        void finish(const std::optional<std::string>&) {}
+        void finish(Action) {}
+    };
+
+    class StageTrace {
+    public:
+        StageTrace(const IBaseNode*, TraceStage, int = 0) {}
+        void done() {}
+    };
+
+    inline void traceRetry(const IBaseNode*) {}
+    inline void traceMemo(const IBaseNode*, MemoOutcome) {}
+#endif
+} // namespace detail
+
+
+// --- Base Node Template ---
+template <typename P, typename E>
+class BaseNode : public IBaseNode {
+protected:
+    Params params;
+    std::map<std::string, std::shared_ptr<IBaseNode>> successors;
+    std::string className = typeid(*this).name(); // Store class name approximation
+
+public:
+    virtual ~BaseNode() override = default;
+
+    // --- Configuration ---
+    // Returns *this reference to allow chaining like Java, but less common in C++
+    BaseNode<P, E>& setParams(const Params& newParams) {
+        params = newParams; // Shares the layers; copy-on-write
+        return *this;
+    }
+
+    // Override from IBaseNode
+    void setParamsInternal(const Params& newParams) override {
+        params = newParams;
+    }
+
+    // Inside a run frame this returns the per-run params rather than the member.
+    const Params& getParams() const override {
+        const RunFrame* frame = detail::currentFrame();
+        return frame ? frame->params() : params;
+    }
+
+    // --- Chaining ---
+    // Templated next for potential type checking at connection time if needed,
+    // but primarily delegates to the IBaseNode interface version.
+    template <typename NEXT_P, typename NEXT_E>
+    std::shared_ptr<BaseNode<NEXT_P, NEXT_E>> next(std::shared_ptr<BaseNode<NEXT_P, NEXT_E>> node, const std::string& action) {
+        if (!node) {
+            throw std::invalid_argument("Successor node cannot be null");
+        }
+        if (successors.count(action)) {
+            logWarn("Overwriting successor for action '" + action + "' in node " + getClassName());
+        }
+        successors[action] = node; // Implicit cast to shared_ptr<IBaseNode>
+        this->wiringChanged();
+        return node;
+    }
+
+    template <typename NEXT_P, typename NEXT_E>
+    std::shared_ptr<BaseNode<NEXT_P, NEXT_E>> next(std::shared_ptr<BaseNode<NEXT_P, NEXT_E>> node) {
+        // Use "" or a specific constant internally to represent the default action key
+        return next(node, ""); // Empty string as internal key for default
+    }
+
+    // IBaseNode implementation for next (needed for polymorphism)
+    std::shared_ptr<IBaseNode> next(std::shared_ptr<IBaseNode> node, const std::string& action) override {
+         if (!node) {
+            throw std::invalid_argument("Successor node cannot be null");
+        }
+        if (successors.count(action)) {
+            logWarn("Overwriting successor for action '" + action + "' in node " + getClassName());
+        }
+        successors[action] = node;
+        this->wiringChanged();
+        return node; // Return the base interface pointer
+    }
+
+    std::shared_ptr<IBaseNode> next(std::shared_ptr<IBaseNode> node) override {
+        return next(node, ""); // Empty string for default
+    }
+
+    // Successor for a token action; wired under the token's name
+    template <typename NEXT_P, typename NEXT_E>
+    std::shared_ptr<BaseNode<NEXT_P, NEXT_E>> next(std::shared_ptr<BaseNode<NEXT_P, NEXT_E>> node, Action action) {
+        return next(node, action.name());
+    }
+
+    std::shared_ptr<IBaseNode> next(std::shared_ptr<IBaseNode> node, Action action) {
+        return next(node, action.name());
+    }
+
+    // Runs the branches at the same time once this node finishes (default action).
+    // Chain ->join(node) on the result to continue after every branch has completed:
+    //     prepNode->fork({retrieve, moderate, embed})->join(merge);
+    std::shared_ptr<ParallelFlow> fork(std::vector<ForkBranch> branches);
+
+
+    // --- Core Methods (to be implemented by subclasses) ---
+    virtual P prep(Context& sharedContext) {
+        // Default implementation returns default-constructed P
+        // Handle void case explicitly if needed, though default works ok.
+        if constexpr (std::is_same_v<P, void>) {
+             return; // Or handle differently if void needs special logic
+        } else {
+            return P{};
+        }
+    }
+
+    virtual E exec(P prepResult) = 0; // Pure virtual
+
+    virtual std::optional<std::string> post(Context& sharedContext, const P& prepResult, const E& execResult) {
+        // Default implementation returns nullopt (default action)
+        return std::nullopt;
+    }
+
+    // Token form of post(). Returning anything but Action::unset() replaces post():
+    // compiled flows then route on the token's id without building a string.
+    virtual Action postAction(Context& /*sharedContext*/, const P& /*prepResult*/, const E& /*execResult*/) {
+        return Action::unset();
+    }
+
+    // --- Internal Execution Logic ---
+protected:
+    // Frame of the stateless run executing this node, or nullptr in stateful runs
+    RunFrame* currentFrame() const { return detail::currentFrame(); }
+
+    // This internal method allows Node<P,E> to override execution with retries.
+    // prepResult stays owned by internalRun so post() sees it intact; exec receives a
+    // copy, which is a pointer copy when P is a Payload.
+    virtual E internalExec(const P& prepResult) {
+        return exec(prepResult);
+    }
+
+public:
+    using IBaseNode::internalRun; // Keep the RunFrame overload visible
+
+    // IBaseNode implementation
+    std::optional<std::string> internalRun(Context& sharedContext) override {
+        detail::NodeTrace trace(this);
+        P prepRes = prep(sharedContext);
+        trace.stageDone(TraceStage::Prep);
+        E execRes = internalExec(prepRes); // prepRes is materialized once and reused by post
+        trace.stageDone(TraceStage::Exec);
+        // Need to handle void return type E potentially
+        std::optional<std::string> action;
+        Action token;
+        if constexpr (std::is_same_v<E, void>) {
+             token = postAction(sharedContext, prepRes, {});
+             if (token.isUnset()) action = post(sharedContext, prepRes, {}); // Pass dummy value for void E
+        } else {
+             token = postAction(sharedContext, prepRes, execRes);
+             if (token.isUnset()) action = post(sharedContext, prepRes, execRes);
+        }
+        trace.stageDone(TraceStage::Post);
+        if (token.isUnset()) {
+            trace.finish(action);
+            return action;
+        }
+        trace.finish(token);
+        detail::ActionChannel& channel = detail::actionChannel();
+        if (channel.expecting == this) { // A token-aware dispatcher is running this node
+            channel.expecting = nullptr;
+            channel.reporter = this;
+            channel.token = token;
+            return std::nullopt;
+        }
+        return token.toOptional();
+    }
+
+
+    // --- Standalone Run ---
+    // Note: Return type matches internalRun now. The Java version returned String.
+    // Returning optional<string> seems more consistent here.
+    std::optional<std::string> run(Context& sharedContext) {
+        if (!successors.empty()) {
+            static LogSite site;
+            logWarn(site, [&] { return "Node " + getClassName() + " has successors, but run() was called. Successors won't be executed. Use Flow."; });
+        }
+        return internalRun(sharedContext);
+    }
+
+    // --- Successor Retrieval (IBaseNode implementation) ---
+    std::shared_ptr<IBaseNode> getNextNode(const std::optional<std::string>& action) const override {
+        static const std::string defaultActionKey; // "" is the default action key
+        auto it = successors.find(action ? *action : defaultActionKey);
+        if (it != successors.end()) {
+            return it->second;
+        } else {
+            if (!successors.empty()) {
+                static LogSite site;
+                logWarn(site, [&] {
+                    std::string requestedAction = action.has_value() ? "'" + action.value() + "'" : "default";
+                    std::string availableActions;
+                    for(const auto& pair : successors) {
+                        availableActions += "'" + (pair.first.empty() ? "<default>" : pair.first) + "' ";
+                    }
+                    return "Flow might end: Action " + requestedAction + " not found in successors ["
+                           + availableActions + "] of node " + getClassName();
+                });
+            }
+            return nullptr; // No successor found
+        }
+    }
+
+    bool hasSuccessors() const override {
+        return !successors.empty();
+    }
+
+    const std::map<std::string, std::shared_ptr<IBaseNode>>& getSuccessors() const override {
+        return successors;
+    }
+
+    const std::string& getClassName() const override {
+        // Return a potentially mangled name. Provide a way to set a clean name if needed.
+        // For now, use the stored approximation.
+        // A better way: Add a virtual getName() method overridden by each concrete node.
+        return className;
+    }
+
+protected:
+     // Helper to safely get from map with default
+     template<typename T>
+     T getParamOrDefault(const std::string& key, T defaultValue) const {
+         if (const std::any* value = getParams().lookup(key)) {
+             try {
+                 return std::any_cast<T>(*value);
+             } catch (const std::bad_any_cast& e) {
+                 // Log or handle cast error - return default for now
+                 static LogSite site;
+                 logWarn(site, [&] { return "Bad any_cast for param '" + key + "' in node " + getClassName() + ". Expected different type."; });
+                 return defaultValue;
+             }
+         }
+         return defaultValue;
+     }
+};
+
+
+// --- Synchronous Node with Retries ---
+template <typename P, typename E>
+class Node : public BaseNode<P, E> {
+protected:
+    int maxRetries;
+    long long waitMillis; // Use long long for milliseconds
+    int currentRetry = 0;
+    std::chrono::milliseconds timeout{0}; // Per attempt; 0 = none
+    std::shared_ptr<RetryPolicy> retryPolicy;       // nullptr = wait waitMillis before every retry
+    std::shared_ptr<CircuitBreaker> circuitBreaker; // Usually shared by every node calling one downstream
+    std::shared_ptr<MemoCache<E>> memoCache; // Set by enableMemoization
+    std::vector<std::string> memoParamKeys;
+
+public:
+    Node(int retries = 1, long long waitMilliseconds = 0)
+        : maxRetries(retries), waitMillis(waitMilliseconds) {
+        if (maxRetries < 1) throw std::invalid_argument("maxRetries must be at least 1");
+        if (waitMillis < 0) throw std::invalid_argument("waitMillis cannot be negative");
+    }
+
+    virtual ~Node() override = default;
+
+    // Limits each exec attempt to `attemptTimeout` (0 = no limit); a run's deadline can
+    // shorten it further. An attempt that runs over fails with a TimeoutException and
+    // is retried like any failure. Timed attempts run on a shared, bounded thread pool
+    // (see setTimedAttemptLimits) with a snapshot of the run's params; a hung attempt is
+    // abandoned but keeps the node and its prep result alive until it returns, so exec
+    // must not write node members. Only nodes owned by a std::shared_ptr can be abandoned:
+    // for others (StaticFlow steps, nodes on the stack) attempts run inline, a hung exec
+    // still blocks the run, and an overrun only fails the attempt once it returns; each
+    // such attempt logs a warning. Configure before running flows.
+    Node<P, E>& setTimeout(std::chrono::milliseconds attemptTimeout) {
+        if (attemptTimeout.count() < 0) throw std::invalid_argument("timeout cannot be negative");
+        timeout = attemptTimeout;
+        return *this;
+    }
+
+    std::chrono::milliseconds getTimeout() const { return timeout; }
+
+    // Replaces the fixed waitMillis between attempts (and, for batch nodes, between an
+    // item's attempts) with `policy`; nullptr restores it. Configure before running flows.
+    Node<P, E>& setRetryPolicy(std::shared_ptr<RetryPolicy> policy) {
+        retryPolicy = std::move(policy);
+        return *this;
+    }
+
+    // Every attempt asks `breaker` first and reports its outcome to it. While the
+    // breaker is open, execs (or items) go straight to the fallback with a
+    // CircuitOpenException.
+    Node<P, E>& setCircuitBreaker(std::shared_ptr<CircuitBreaker> breaker) {
+        circuitBreaker = std::move(breaker);
+        return *this;
+    }
+
+    const std::shared_ptr<RetryPolicy>& getRetryPolicy() const { return retryPolicy; }
+    const std::shared_ptr<CircuitBreaker>& getCircuitBreaker() const { return circuitBreaker; }
+
+    // Attempt index of the running exec (0 = first try); frame-aware, unlike currentRetry
+    int getCurrentRetry() const {
+        const RunFrame* frame = detail::currentFrame();
+        return frame ? frame->currentRetry() : currentRetry;
+    }
+
+    // Non-throwing entry point of one attempt. Override to report expected, transient
+    // failures as ExecResult<E>::failure(...) instead of throwing; exceptions still work.
+    virtual ExecResult<E> tryExec(const P& prepResult) {
+        return this->exec(prepResult); // Copies P per attempt (exec takes it by value); Payload<T> makes that a pointer copy
+    }
+
+    // Fallback method to be overridden if needed. lastException is the exception the
+    // last attempt threw (its original type), or a CognitoFlowException with the reason.
+    virtual E execFallback(P prepResult, const std::exception& lastException) {
+        // Default behavior is to re-throw the last exception
+        throw CognitoFlowException("Node execution failed after " + std::to_string(maxRetries) + " retries, and fallback was not implemented or also failed.", lastException);
+    }
+
+    // --- Memoization ---
+    // Serves exec results from a cache keyed by memoKey(prepResult): only for nodes whose
+    // exec (retries included) depends on nothing but the prep result and the listed
+    // params. Only a successful attempt's result is cached; when every attempt fails,
+    // execFallback runs for that call and its value is not stored. Configure before
+    // running flows. Cached results are copied out on every hit, so E must be copyable.
+    Node<P, E>& enableMemoization(MemoOptions options = {}, std::vector<std::string> paramKeys = {}) {
+        static_assert(std::is_copy_constructible_v<E>, "enableMemoization needs a copy-constructible exec result type");
+        memoCache = std::make_shared<MemoCache<E>>(options);
+        memoParamKeys = std::move(paramKeys);
+        return *this;
+    }
+
+    void disableMemoization() { memoCache.reset(); }
+
+    // The node's cache (nullptr when memoization is off), e.g. for stats() or clear()
+    MemoCache<E>* getMemoCache() const { return memoCache.get(); }
+
+    // Cache key hash for a prep result; std::nullopt runs exec without the cache. The
+    // default hashes prepResult with std::hash plus the memo params, and gives up on
+    // types it cannot hash. Override for other P types. When P has operator==, entries
+    // also keep the prep result and memo param values and a hit needs them to be equal,
+    // so the hash only has to spread keys; without it equal hashes must mean equal results.
+    virtual std::optional<std::uint64_t> memoKey(const P& prepResult) const {
+        if constexpr (detail::IsStdHashable<P>::value) {
+            std::uint64_t key = detail::mixHash(std::hash<P>{}(prepResult));
+            for (const auto& paramKey : memoParamKeys) {
+                key = detail::combineMemoHash(key, std::hash<std::string>{}(paramKey));
+                if (const std::any* value = this->getParams().lookup(paramKey)) {
+                    std::optional<std::uint64_t> valueHash = detail::hashParamValue(*value);
+                    if (!valueHash) {
+                        static LogSite site;
+                        logWarn(site, [&] { return "Memo param '" + paramKey + "' of node " + this->getClassName() + " has a type memoKey cannot hash; exec is not memoized."; });
+                        return std::nullopt;
+                    }
+                    key = detail::combineMemoHash(key, *valueHash);
+                }
+            }
+            return key;
+        } else {
+            static LogSite site;
+            logWarn(site, [&] { return "Node " + this->getClassName() + " enables memoization but its prep type has no std::hash; override memoKey."; });
+            return std::nullopt;
+        }
+    }
+
+protected:
+    E internalExec(const P& prepResult) override {
+        if constexpr (std::is_copy_constructible_v<E>) {
+            if (memoCache) return memoizedExec(prepResult);
+        }
+        return execWithRetries(prepResult);
+    }
+
+    // Cache lookup for internalExec; only instantiated for copyable E
+    E memoizedExec(const P& prepResult) {
+        if (std::optional<std::uint64_t> key = memoKey(prepResult)) {
+            MemoOutcome outcome = MemoOutcome::Miss;
+            auto compute = [&] {
+                ExecFailure lastFailure;
+                std::optional<E> result = runAttempts(prepResult, lastFailure);
+                if (!result) throw detail::ExecAttemptsFailed{lastFailure}; // Not cached; shared with waiters
+                return std::move(*result);
+            };
+            try {
+                if constexpr (detail::IsEqualityComparable<P>::value) {
+                    std::vector<const std::any*> paramValues;
+                    paramValues.reserve(memoParamKeys.size());
+                    for (const auto& paramKey : memoParamKeys) paramValues.push_back(this->getParams().lookup(paramKey));
+                    detail::MemoPrepIdentity<P> identity(prepResult, std::move(paramValues)); // Copied only on a miss
+                    E result = memoCache->getOrCompute(*key, &identity, compute, &outcome);
+                    detail::traceMemo(this, outcome);
+                    return result;
+                } else {
+                    E result = memoCache->getOrCompute(*key, compute, &outcome);
+                    detail::traceMemo(this, outcome);
+                    return result;
+                }
+            } catch (const detail::ExecAttemptsFailed& failed) {
+                detail::traceMemo(this, outcome);
+                return runFallback(prepResult, failed.failure);
+            }
+        }
+        return execWithRetries(prepResult);
+    }
+
+    // Time the next attempt may take: the timeout, cut to what is left of the deadline
+    std::chrono::steady_clock::duration attemptLimit() const {
+        std::chrono::steady_clock::duration limit = timeout;
+        if (auto left = DeadlineScope::remaining()) limit = std::min(limit, *left);
+        return limit;
+    }
+
+    detail::RetrySettings retrySettings() const {
+        return detail::RetrySettings{maxRetries, waitMillis, retryPolicy.get(), circuitBreaker.get()};
+    }
+
+    // One timed attempt on the attempt pool; it shares timedPrep rather than copying it
+    ExecResult<E> runTimedAttempt(const std::shared_ptr<const P>& timedPrep, int attempt) {
+        return detail::runWithTimeout<E>(*this, attempt, [this, timedPrep] { return tryExec(*timedPrep); }, attemptLimit());
+    }
+
+    // Retry logic; every attempt and the fallback reuse prepResult. prep runs once, but
+    // exec and execFallback take P by value, so each attempt and the fallback copy it
+    // (plus the one timedPrep copy below): a plain P is copied, a Payload<T> is not.
+    E execWithRetries(const P& prepResult) {
+        ExecFailure lastFailure;
+        std::optional<E> result = runAttempts(prepResult, lastFailure);
+        if (result) return std::move(*result);
+        return runFallback(prepResult, lastFailure);
+    }
+
+    // The attempt loop: the first successful result, or nullopt with lastFailure set
+    std::optional<E> runAttempts(const P& prepResult, ExecFailure& lastFailure) {
+        // With a timeout the prep result is copied once into shared ownership, so an
+        // abandoned attempt can outlive this call
+        std::shared_ptr<const P> timedPrep = timeout.count() > 0 ? std::make_shared<const P>(prepResult) : nullptr;
+        // Stateless runs keep their attempt count in the frame
+        RunFrame* frame = detail::currentFrame();
+        int& attempt = frame ? frame->retryCounter() : currentRetry;
+        const detail::RetrySettings settings = retrySettings();
+        detail::RetrySchedule schedule(settings);
+
+        for (attempt = 0; attempt < maxRetries; ++attempt) {
+            if (attempt > 0) {
+                std::optional<std::chrono::milliseconds> delay = schedule.nextDelay(attempt);
+                if (!delay) break;
+                detail::traceRetry(this);
+                if (delay->count() > 0) std::this_thread::sleep_for(*delay);
+            }
+            if (!schedule.admit(lastFailure, [this] { return this->getClassName(); })) break; // Open breaker: straight to the fallback
+            detail::StageTrace attemptTrace(this, TraceStage::Attempt, attempt);
+            schedule.attemptStarted();
+            try {
+                ExecResult<E> outcome = timedPrep ? runTimedAttempt(timedPrep, attempt) : tryExec(prepResult);
+                if (outcome.ok()) {
+                    schedule.record(true);
+                    attemptTrace.done();
+                    return std::move(outcome).value();
+                }
+                lastFailure = outcome.error();
+            } catch (...) {
+                lastFailure = ExecFailure{{}, std::current_exception()}; // Keeps the original exception, no copy
+            }
+            schedule.record(false);
+        }
+        return std::nullopt; // All retries failed
+    }
+
+    E runFallback(const P& prepResult, const ExecFailure& lastFailure) {
+        try {
+            detail::StageTrace fallbackTrace(this, TraceStage::Fallback);
+            E result = detail::callWithFailure(lastFailure, [&](const std::exception& lastException) {
+                return execFallback(prepResult, lastException);
+            });
+            fallbackTrace.done();
+            return result;
+        } catch (const std::exception& fallbackException) {
+            // If fallback fails, throw appropriate exception
+             throw CognitoFlowException("Fallback execution failed after main exec retries failed.", fallbackException);
+        } catch (...) {
+             throw CognitoFlowException("Fallback execution failed with non-standard exception.", std::runtime_error("Unknown fallback error"));
+        }
+    }
+};
+
+
+// --- Async Node with Timer-Based Retries ---
+// Counterpart of Node for I/O-bound work. Override execAsync (or exec for a
+// synchronous body) and complete the returned AsyncResult from any thread; the
+// remaining stages and retries continue on the EventLoop. Between attempts the
+// node schedules a timer instead of sleeping; retry policies and circuit breakers
+// work as in Node.
+template <typename P, typename E>
+class AsyncNode : public BaseNode<P, E>, public IAsyncNode {
+protected:
+    int maxRetries;
+    long long waitMillis;
+    std::shared_ptr<RetryPolicy> retryPolicy;       // nullptr = wait waitMillis before every retry
+    std::shared_ptr<CircuitBreaker> circuitBreaker; // Usually shared by every node calling one downstream
+
+public:
+    AsyncNode(int retries = 1, long long waitMilliseconds = 0)
+        : maxRetries(retries), waitMillis(waitMilliseconds) {
+        if (maxRetries < 1) throw std::invalid_argument("maxRetries must be at least 1");
+        if (waitMillis < 0) throw std::invalid_argument("waitMillis cannot be negative");
+    }
+
+    virtual ~AsyncNode() override = default;
+
+    // Same as Node::setRetryPolicy; the wait between attempts is a loop timer
+    AsyncNode<P, E>& setRetryPolicy(std::shared_ptr<RetryPolicy> policy) {
+        retryPolicy = std::move(policy);
+        return *this;
+    }
+
+    // Same as Node::setCircuitBreaker
+    AsyncNode<P, E>& setCircuitBreaker(std::shared_ptr<CircuitBreaker> breaker) {
+        circuitBreaker = std::move(breaker);
+        return *this;
+    }
+
+    const std::shared_ptr<RetryPolicy>& getRetryPolicy() const { return retryPolicy; }
+    const std::shared_ptr<CircuitBreaker>& getCircuitBreaker() const { return circuitBreaker; }
+
+    // --- Async stages (defaults wrap the synchronous methods) ---
+    virtual AsyncResult<P> prepAsync(Context& sharedContext) {
+        return AsyncResult<P>::invoke([&] { return this->prep(sharedContext); });
+    }
+
+    E exec(P /*prepResult*/) override {
+        throw std::logic_error("AsyncNode subclasses must override exec() or execAsync().");
+    }
+
+    virtual AsyncResult<E> execAsync(P prepResult) {
+        return AsyncResult<E>::invoke([&] { return this->exec(std::move(prepResult)); });
+    }
+
+    virtual AsyncResult<E> execFallbackAsync(P /*prepResult*/, const std::exception& lastException) {
+        return AsyncResult<E>::fromException(std::make_exception_ptr(CognitoFlowException(
+            "Node execution failed after " + std::to_string(maxRetries) + " retries, and fallback was not implemented or also failed.", lastException)));
+    }
+
+    virtual AsyncResult<std::optional<std::string>> postAsync(Context& sharedContext, const P& prepResult, const E& execResult) {
+        return AsyncResult<std::optional<std::string>>::invoke([&] { return this->post(sharedContext, prepResult, execResult); });
+    }
+
+    IAsyncNode* asAsyncNode() override { return this; }
+
+    // Standalone async run, the counterpart of BaseNode::run
+    AsyncResult<std::optional<std::string>> runAsync(Context& sharedContext, EventLoop& loop) {
+        if (this->hasSuccessors()) {
+            static LogSite site;
+            logWarn(site, [&] { return "Node " + this->getClassName() + " has successors, but runAsync() was called. Successors won't be executed. Use AsyncFlow."; });
+        }
+        return internalRunAsync(sharedContext, loop);
+    }
+
+    // Blocking entry point used when the node sits in a synchronous Flow
+    std::optional<std::string> internalRun(Context& sharedContext) override {
+        EventLoop loop;
+        auto result = internalRunAsync(sharedContext, loop);
+        loop.runUntil(result);
+        return result.get();
+    }
+
+    AsyncResult<std::optional<std::string>> internalRunAsync(Context& sharedContext, EventLoop& loop) override {
+        auto op = std::make_shared<Operation>(this, sharedContext, loop);
+        startPrep(op);
+        return op->promise.result();
+    }
+
+private:
+    // Per-run state; the node itself must outlive the run
+    struct Operation {
+        Context& sharedContext;
+        EventLoop& loop;
+        RunFrame* frame; // Frame active when the run started, restored for each stage
+        detail::DeadlineClock::time_point deadline; // Likewise the run's deadline
+        AsyncPromise<std::optional<std::string>> promise;
+        std::optional<P> prepResult;
+        int attempt = 0;
+        detail::RetrySettings retrySettings;
+        std::optional<detail::RetrySchedule> schedule; // Refers to retrySettings; set once prep is done
+        std::exception_ptr lastError;
+        detail::NodeTrace trace; // Stage times span the asynchronous waits; no per-attempt spans
+
+        Operation(const IBaseNode* node, Context& ctx, EventLoop& eventLoop)
+            : sharedContext(ctx), loop(eventLoop), frame(detail::currentFrame()), deadline(detail::currentDeadline()), trace(node) {}
+    };
+    using OperationPtr = std::shared_ptr<Operation>;
+
+    // Resumes `next` on the loop once `result` completes, with the run's frame active
+    template <typename T, typename F>
+    static void continueOnLoop(const OperationPtr& op, AsyncResult<T> result, F next) {
+        result.onReady([op, result, next]() {
+            op->loop.post([op, result, next]() {
+                detail::ScopedFrame scope(op->frame);
+                detail::ScopedDeadline deadlineScope(op->deadline);
+                next(result);
+            });
+        });
+    }
+
+    void startPrep(const OperationPtr& op) {
+        AsyncResult<P> prepResult = wrapStage([&] { return prepAsync(op->sharedContext); });
+        continueOnLoop(op, prepResult, [this, op](const AsyncResult<P>& ready) {
+            try {
+                op->prepResult.emplace(ready.get());
+            } catch (...) {
+                op->promise.setException(std::current_exception());
+                return;
+            }
+            op->trace.stageDone(TraceStage::Prep);
+            op->retrySettings = detail::RetrySettings{maxRetries, waitMillis, retryPolicy.get(), circuitBreaker.get()};
+            op->schedule.emplace(op->retrySettings);
+            startAttempt(op);
+        });
+    }
+
+    void startAttempt(const OperationPtr& op) {
+        if (op->frame) op->frame->retryCounter() = op->attempt;
+        ExecFailure refused;
+        if (!op->schedule->admit(refused, [this] { return this->getClassName(); })) { // Open breaker: straight to the fallback
+            op->lastError = refused.exception;
+            startFallback(op);
+            return;
+        }
+        op->schedule->attemptStarted();
+        AsyncResult<E> attemptResult = wrapStage([&] { return execAsync(*op->prepResult); });
+        continueOnLoop(op, attemptResult, [this, op](const AsyncResult<E>& ready) {
+            try {
+                const E& execResult = ready.get();
+                op->schedule->record(true);
+                startPost(op, execResult);
+                return;
+            } catch (...) {
+                op->lastError = std::current_exception();
+            }
+            op->schedule->record(false);
+            // No retry once the policy gives up or the wait plus another attempt overruns the deadline
+            std::optional<std::chrono::milliseconds> delay;
+            if (++op->attempt < maxRetries) delay = op->schedule->nextDelay(op->attempt);
+            if (!delay) {
+                startFallback(op);
+                return;
+            }
+            detail::traceRetry(this);
+            if (delay->count() > 0) {
+                op->loop.schedule(*delay, [this, op]() {
+                    detail::ScopedFrame scope(op->frame);
+                    detail::ScopedDeadline deadlineScope(op->deadline);
+                    startAttempt(op);
+                });
+            } else {
+                startAttempt(op);
+            }
+        });
+    }
+
+    void startFallback(const OperationPtr& op) {
+        AsyncResult<E> fallbackResult = wrapStage([&]() -> AsyncResult<E> {
+            try {
+                std::rethrow_exception(op->lastError);
+            } catch (const std::exception& lastException) {
+                return execFallbackAsync(*op->prepResult, lastException);
+            } catch (...) {
+                return execFallbackAsync(*op->prepResult, std::runtime_error("Non-standard exception caught during exec"));
+            }
+        });
+        continueOnLoop(op, fallbackResult, [this, op](const AsyncResult<E>& ready) {
+            try {
+                const E& execResult = ready.get();
+                startPost(op, execResult);
+            } catch (const std::exception& fallbackException) {
+                op->promise.setException(std::make_exception_ptr(
+                    CognitoFlowException("Fallback execution failed after main exec retries failed.", fallbackException)));
+            } catch (...) {
+                op->promise.setException(std::make_exception_ptr(
+                    CognitoFlowException("Fallback execution failed with non-standard exception.", std::runtime_error("Unknown fallback error"))));
+            }
+        });
+    }
+
+    void startPost(const OperationPtr& op, const E& execResult) {
+        op->trace.stageDone(TraceStage::Exec);
+        auto postResult = wrapStage([&] { return postAsync(op->sharedContext, *op->prepResult, execResult); });
+        continueOnLoop(op, postResult, [op](const AsyncResult<std::optional<std::string>>& ready) {
+            try {
+                const std::optional<std::string>& action = ready.get();
+                op->trace.stageDone(TraceStage::Post);
+                op->trace.finish(action);
+                op->promise.setValue(action);
+            } catch (...) {
+                op->promise.setException(std::current_exception());
+            }
+        });
+    }
+
+    // Converts an exception thrown while *starting* a stage into a failed result
+    template <typename F>
+    static auto wrapStage(F&& start) -> decltype(start()) {
+        using Result = decltype(start());
+        try {
+            return start();
+        } catch (...) {
+            return Result::fromException(std::current_exception());
+        }
+    }
+};
+
+
+// --- Item Retries ---
+namespace detail {
+    // Per-item retry loop shared by the batch node types: attempt() until it succeeds,
+    // maxRetries attempts have failed, the retry policy gives up, the circuit breaker
+    // is open or the run's deadline leaves no room for another, then
+    // fallback(lastException) with the last failure.
+    template <typename T, typename Attempt, typename Fallback>
+    T retryItem(const IBaseNode* node, const RetrySettings& settings, int& retryCounter,
+                Attempt&& attempt, Fallback&& fallback) {
+        ExecFailure lastFailure;
+        RetrySchedule schedule(settings);
+
+        for (retryCounter = 0; retryCounter < settings.maxRetries; ++retryCounter) {
+            if (retryCounter > 0) {
+                std::optional<std::chrono::milliseconds> delay = schedule.nextDelay(retryCounter);
+                if (!delay) break;
+                traceRetry(node);
+                if (delay->count() > 0) std::this_thread::sleep_for(*delay);
+            }
+            if (!schedule.admit(lastFailure, [node] { return node->getClassName(); })) break;
+            schedule.attemptStarted();
+            try {
+                ExecResult<T> outcome = attempt();
+                if (outcome.ok()) {
+                    schedule.record(true);
+                    return std::move(outcome).value();
+                }
+                lastFailure = outcome.error();
+            } catch (...) {
+                lastFailure = ExecFailure{{}, std::current_exception()};
+            }
+            schedule.record(false);
+        } // End retry loop for item
+
+        try {
+            StageTrace fallbackTrace(node, TraceStage::Fallback);
+            T result = callWithFailure(lastFailure, fallback); // Call user fallback
+            fallbackTrace.done();
+            return result;
+        } catch (const std::exception& fallbackEx) {
+             throw CognitoFlowException("Item fallback execution failed.", fallbackEx); // Add item info if possible
+        } catch (...) {
+             throw CognitoFlowException("Item fallback failed with non-standard exception.", std::runtime_error("Unknown item fallback error"));
+        }
+    }
+} // namespace detail
+
+
+// --- Synchronous Batch Node ---
+template <typename IN_ITEM, typename OUT_ITEM>
+class BatchNode : public Node<std::vector<IN_ITEM>, std::vector<OUT_ITEM>> {
+public:
+    BatchNode(int retries = 1, long long waitMilliseconds = 0)
+        : Node<std::vector<IN_ITEM>, std::vector<OUT_ITEM>>(retries, waitMilliseconds) {}
+
+    virtual ~BatchNode() override = default;
+
+    // --- Methods for subclasses to implement ---
+    virtual OUT_ITEM execItem(const IN_ITEM& item) = 0; // Process a single item
+
+    // Non-throwing form of execItem; return ExecResult<OUT_ITEM>::failure(...) to retry the item
+    virtual ExecResult<OUT_ITEM> tryExecItem(const IN_ITEM& item) {
+        return execItem(item);
+    }
+
+    virtual OUT_ITEM execItemFallback(const IN_ITEM& item, const std::exception& lastException) {
+        // Default fallback re-throws
+         throw CognitoFlowException("Batch item execution failed after retries, and fallback was not implemented or also failed.", lastException);
+    }
+
+    // Result for an item not started because the run's deadline had passed. The default
+    // throws DeadlineExceededException, ending the batch; return a placeholder instead
+    // to keep partial results.
+    virtual OUT_ITEM execItemPastDeadline(const IN_ITEM& /*item*/) {
+        throw DeadlineExceededException("Run deadline passed before batch node " + this->getClassName() + " finished its items");
+    }
+
+    // --- Base class methods that MUST NOT be overridden by user ---
+    // Make exec final to prevent accidental override. User should implement execItem.
+    std::vector<OUT_ITEM> exec(std::vector<IN_ITEM> prepResult) final {
+        // This method is conceptually hidden by internalExec override below.
+        // We override internalExec directly.
+        throw std::logic_error("BatchNode::exec should not be called directly.");
+    }
+
+     // Fallback for the whole batch (rarely needed if item fallback exists)
+     std::vector<OUT_ITEM> execFallback(std::vector<IN_ITEM> prepResult, const std::exception& lastException) final {
+         // This fallback applies if the *looping* itself fails, not individual items.
+         throw CognitoFlowException("BatchNode internal execution loop failed.", lastException);
+     }
+
+
+protected:
+    // Runs execItem for one item with the node's retry settings and falls back to
+    // execItemFallback once every attempt has failed. The attempt counter is passed in
+    // so several items can be processed at the same time. With a timeout, `item` should
+    // be an element of `timedBatch` (see shareForTimedAttempts), which timed attempts
+    // share instead of copying the item.
+    OUT_ITEM execItemWithRetries(const IN_ITEM& item, int& retryCounter,
+                                 const std::shared_ptr<const std::vector<IN_ITEM>>& timedBatch = nullptr) {
+        if (DeadlineScope::expired()) return execItemPastDeadline(item);
+        std::shared_ptr<const IN_ITEM> timedItem;
+        if (this->timeout.count() > 0) {
+            timedItem = timedBatch ? std::shared_ptr<const IN_ITEM>(timedBatch, &item) : std::make_shared<const IN_ITEM>(item);
+        }
+        return detail::retryItem<OUT_ITEM>(this, this->retrySettings(), retryCounter,
+            [&]() -> ExecResult<OUT_ITEM> {
+                if (!timedItem) return tryExecItem(item);
+                return detail::runWithTimeout<OUT_ITEM>(*this, retryCounter, [this, timedItem] { return tryExecItem(*timedItem); },
+                                                        this->attemptLimit());
+            },
+            [&](const std::exception& lastException) { return execItemFallback(item, lastException); });
+    }
+
+    // The batch in shared ownership when the node has a timeout (one copy per exec, not
+    // per attempt), else nullptr
+    std::shared_ptr<const std::vector<IN_ITEM>> shareForTimedAttempts(const std::vector<IN_ITEM>& batch) const {
+        return this->timeout.count() > 0 ? std::make_shared<const std::vector<IN_ITEM>>(batch) : nullptr;
+    }
+
+
+    // Override internalExec for batch processing logic
+    std::vector<OUT_ITEM> internalExec(const std::vector<IN_ITEM>& batchPrepResult) override {
+        if (batchPrepResult.empty()) {
+            return {};
+        }
+
+        std::vector<OUT_ITEM> results;
+        results.reserve(batchPrepResult.size());
+
+        RunFrame* frame = detail::currentFrame();
+        int& retryCounter = frame ? frame->retryCounter() : this->currentRetry;
+        std::shared_ptr<const std::vector<IN_ITEM>> timedBatch = this->shareForTimedAttempts(batchPrepResult);
+        const std::vector<IN_ITEM>& items = timedBatch ? *timedBatch : batchPrepResult;
+        for (const auto& item : items) {
+             results.emplace_back(execItemWithRetries(item, retryCounter, timedBatch)); // Moved in, never default-constructed
+        } // End loop over items
+
+        return results;
+    }
+};
+
+
+// --- Parallel Batch Node ---
+// Same contract as BatchNode, but execItem calls are spread over an Executor.
+// Output order matches input order, and each item keeps its own retry/fallback
+// sequence. execItem and execItemFallback must be safe to call concurrently;
+// currentRetry is not updated for parallel items.
+template <typename IN_ITEM, typename OUT_ITEM>
+class ParallelBatchNode : public BatchNode<IN_ITEM, OUT_ITEM> {
+protected:
+    std::shared_ptr<Executor> executor;
+    std::size_t maxConcurrency;
+
+public:
+    // maxConcurrency caps how many items run at once (0 = every executor thread plus the
+    // caller). Without an explicit executor, the enclosing flow's or the default one is used.
+    ParallelBatchNode(int retries = 1, long long waitMilliseconds = 0, std::size_t maxConcurrentItems = 0)
+        : BatchNode<IN_ITEM, OUT_ITEM>(retries, waitMilliseconds), maxConcurrency(maxConcurrentItems) {}
+
+    virtual ~ParallelBatchNode() override = default;
+
+    ParallelBatchNode<IN_ITEM, OUT_ITEM>& setExecutor(std::shared_ptr<Executor> newExecutor) {
+        executor = std::move(newExecutor);
+        return *this;
+    }
+
+    ParallelBatchNode<IN_ITEM, OUT_ITEM>& setMaxConcurrency(std::size_t maxConcurrentItems) {
+        maxConcurrency = maxConcurrentItems;
+        return *this;
+    }
+
+    std::size_t getMaxConcurrency() const { return maxConcurrency; }
+
+protected:
+    std::vector<OUT_ITEM> internalExec(const std::vector<IN_ITEM>& batchPrepResult) override {
+        if (batchPrepResult.empty()) {
+            return {};
+        }
+        std::shared_ptr<Executor> runExecutor = Executor::resolve(executor);
+
+        // optional<> slots so OUT_ITEM need not be default constructible; only the caller allocates
+        std::pmr::vector<std::optional<OUT_ITEM>> slots(batchPrepResult.size(), RunArena::currentResource());
+        RunFrame* callerFrame = detail::currentFrame(); // Give each item a child frame with the run's params
+        const bool runHasArena = detail::currentArena() != nullptr;
+        std::shared_ptr<const std::vector<IN_ITEM>> timedBatch = this->shareForTimedAttempts(batchPrepResult);
+        const std::vector<IN_ITEM>& items = timedBatch ? *timedBatch : batchPrepResult;
+        runExecutor->parallelFor(items.size(), maxConcurrency, [&](std::size_t index) {
+            // Items on other threads cannot share the run's arena; they get one of their own
+            std::optional<RunArena> itemArena;
+            if (runHasArena && !detail::currentArena()) itemArena.emplace(RunArena::ITEM_BLOCK);
+            detail::ScopedArena arenaScope(itemArena ? &*itemArena : detail::currentArena());
+            std::optional<RunFrame> itemFrame;
+            if (callerFrame) itemFrame.emplace(callerFrame->params(), callerFrame);
+            detail::ScopedFrame scope(itemFrame ? &*itemFrame : nullptr);
+            int retryCounter = 0;
+            slots[index].emplace(this->execItemWithRetries(items[index], retryCounter, timedBatch));
+        });
+
+        std::vector<OUT_ITEM> results;
+        results.reserve(slots.size());
+        for (auto& slot : slots) {
+            results.push_back(std::move(*slot));
+        }
+        return results;
+    }
+};
+
+
+// --- Item Sources ---
+// Pull-based input for StreamingBatchNode. pull() appends up to maxItems items to
+// chunk and returns how many it added; returning 0 ends the stream. A source is only
+// ever pulled from one thread at a time, but not always the same thread.
+template <typename T>
+class ItemSource {
+public:
+    virtual ~ItemSource() = default;
+
+    virtual std::size_t pull(std::vector<T>& chunk, std::size_t maxItems) = 0;
+
+    // Source over a generator that returns std::nullopt once it is exhausted
+    static std::shared_ptr<ItemSource<T>> generate(std::function<std::optional<T>()> generator) {
+        class GeneratorSource : public ItemSource<T> {
+            std::function<std::optional<T>()> next;
+        public:
+            explicit GeneratorSource(std::function<std::optional<T>()> generatorFn) : next(std::move(generatorFn)) {}
+            std::size_t pull(std::vector<T>& chunk, std::size_t maxItems) override {
+                std::size_t added = 0;
+                for (; added < maxItems; ++added) {
+                    std::optional<T> item = next();
+                    if (!item) break;
+                    chunk.push_back(std::move(*item));
+                }
+                return added;
+            }
+        };
+        return std::make_shared<GeneratorSource>(std::move(generator));
+    }
+
+    // Source copying items out of [begin, end); the range must outlive the run
+    template <typename It>
+    static std::shared_ptr<ItemSource<T>> fromRange(It begin, It end) {
+        class RangeSource : public ItemSource<T> {
+            It current, last;
+        public:
+            RangeSource(It first, It past) : current(first), last(past) {}
+            std::size_t pull(std::vector<T>& chunk, std::size_t maxItems) override {
+                std::size_t added = 0;
+                for (; added < maxItems && current != last; ++added, ++current) {
+                    chunk.push_back(*current);
+                }
+                return added;
+            }
+        };
+        return std::make_shared<RangeSource>(begin, end);
+    }
+};
+
+namespace detail {
+    // Hands out a source's chunks in order. With depth > 0, up to depth chunks are read
+    // ahead on the executor while the caller works on the current one; reading pauses
+    // when that many are waiting (backpressure), and drained buffers are reused.
+    template <typename T>
+    class ChunkReader {
+        struct State {
+            std::shared_ptr<ItemSource<T>> source;
+            std::size_t chunkSize = 0;
+            std::size_t depth = 0;
+            std::mutex mutex;
+            std::condition_variable cv;
+            std::deque<std::vector<T>> ready;  // Chunks read ahead, oldest first
+            std::vector<std::vector<T>> spare; // Consumed buffers kept for their capacity
+            bool reading = false;              // A read-ahead task is queued or running
+            bool exhausted = false;
+            bool cancelled = false;
+            std::exception_ptr error;
+        };
+
+        std::shared_ptr<State> state;
+        std::shared_ptr<Executor> executor;
+
+        static void readAhead(const std::shared_ptr<State>& st) {
+            for (;;) {
+                std::vector<T> buffer;
+                {
+                    std::lock_guard<std::mutex> lock(st->mutex);
+                    if (st->cancelled || st->exhausted || st->ready.size() >= st->depth) {
+                        st->reading = false;
+                        st->cv.notify_all();
+                        return;
+                    }
+                    if (!st->spare.empty()) {
+                        buffer = std::move(st->spare.back());
+                        st->spare.pop_back();
+                    }
+                }
+                buffer.clear();
+                std::size_t added = 0;
+                std::exception_ptr error;
+                try {
+                    added = st->source->pull(buffer, st->chunkSize);
+                } catch (...) {
+                    error = std::current_exception();
+                }
+                std::lock_guard<std::mutex> lock(st->mutex);
+                if (error) st->error = error;
+                if (error || added == 0) {
+                    st->exhausted = true;
+                } else {
+                    st->ready.push_back(std::move(buffer));
+                }
+                st->cv.notify_all();
+            }
+        }
+
+        // Caller holds the state lock
+        void startReading() {
+            if (state->reading || state->exhausted || state->ready.size() >= state->depth) return;
+            state->reading = true;
+            std::shared_ptr<State> st = state;
+            executor->submit([st] { readAhead(st); });
+        }
+
+    public:
+        ChunkReader(std::shared_ptr<ItemSource<T>> source, std::size_t chunkSize, std::size_t depth,
+                    std::shared_ptr<Executor> readExecutor)
+            : state(std::make_shared<State>()), executor(std::move(readExecutor)) {
+            state->source = std::move(source);
+            state->chunkSize = chunkSize;
+            state->depth = depth;
+            if (!state->source) state->exhausted = true;
+            if (depth > 0) {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                startReading();
+            }
+        }
+
+        ChunkReader(const ChunkReader&) = delete;
+        ChunkReader& operator=(const ChunkReader&) = delete;
+
+        // Waits for an in-flight read so the source is never pulled after the run returns
+        ~ChunkReader() {
+            std::unique_lock<std::mutex> lock(state->mutex);
+            state->cancelled = true;
+            while (state->reading) {
+                lock.unlock();
+                bool ran = executor && executor->tryRunOne();
+                lock.lock();
+                if (!ran) state->cv.wait_for(lock, std::chrono::microseconds(200), [&] { return !state->reading; });
+            }
+        }
+
+        // Replaces chunk with the next one; returns false at the end of the stream.
+        // The previous contents of chunk are discarded and its buffer reused.
+        bool next(std::vector<T>& chunk) {
+            if (state->depth == 0) {
+                chunk.clear();
+                if (state->exhausted) return false;
+                if (state->source->pull(chunk, state->chunkSize) > 0) return true;
+                state->exhausted = true;
+                return false;
+            }
+
+            std::unique_lock<std::mutex> lock(state->mutex);
+            if (chunk.capacity() > 0) {
+                chunk.clear();
+                state->spare.push_back(std::move(chunk));
+            }
+            startReading(); // The consumer freed a slot
+            while (state->ready.empty() && !state->exhausted) {
+                lock.unlock();
+                bool ran = executor->tryRunOne(); // Runs the read itself if no worker took it
+                lock.lock();
+                if (!ran) {
+                    state->cv.wait_for(lock, std::chrono::microseconds(200),
+                                       [&] { return !state->ready.empty() || state->exhausted; });
+                }
+            }
+            if (state->ready.empty()) {
+                if (state->error) std::rethrow_exception(state->error);
+                chunk = std::vector<T>();
+                return false;
+            }
+            chunk = std::move(state->ready.front());
+            state->ready.pop_front();
+            startReading(); // Overlap the next read with the caller's work on this chunk
+            return true;
+        }
+    };
+} // namespace detail
+
+// Totals StreamingBatchNode passes to post() once the stream has been drained
+struct StreamStats {
+    std::size_t items = 0;
+    std::size_t chunks = 0;
+};
+
+
+// --- Streaming Batch Node ---
+// BatchNode for inputs that do not fit in memory. prep returns an ItemSource, items
+// are pulled chunkSize at a time, and postChunk consumes each chunk's results before
+// the next chunk runs, so at most (prefetchChunks + 1) input chunks and one result
+// chunk are alive at once. execItem retries and fallbacks work as in BatchNode.
+// post() runs after the last chunk with the stream totals.
+template <typename IN_ITEM, typename OUT_ITEM>
+class StreamingBatchNode : public Node<std::shared_ptr<ItemSource<IN_ITEM>>, StreamStats> {
+public:
+    using Source = std::shared_ptr<ItemSource<IN_ITEM>>;
+
+    static constexpr std::size_t DEFAULT_CHUNK_SIZE = 1024;
+
+protected:
+    std::size_t chunkSize;
+    std::size_t prefetchChunks = 1;
+    std::shared_ptr<Executor> executor;
+
+public:
+    StreamingBatchNode(int retries = 1, long long waitMilliseconds = 0, std::size_t itemsPerChunk = DEFAULT_CHUNK_SIZE)
+        : Node<Source, StreamStats>(retries, waitMilliseconds), chunkSize(itemsPerChunk) {
+        if (chunkSize == 0) throw std::invalid_argument("chunkSize must be at least 1");
+    }
+
+    virtual ~StreamingBatchNode() override = default;
+
+    StreamingBatchNode<IN_ITEM, OUT_ITEM>& setChunkSize(std::size_t itemsPerChunk) {
+        if (itemsPerChunk == 0) throw std::invalid_argument("chunkSize must be at least 1");
+        chunkSize = itemsPerChunk;
+        return *this;
+    }
+
+    // Chunks read ahead on the executor while the current one runs (0 = read on the
+    // calling thread between chunks). The source must then tolerate being pulled from
+    // an executor thread.
+    StreamingBatchNode<IN_ITEM, OUT_ITEM>& setPrefetchChunks(std::size_t chunks) {
+        prefetchChunks = chunks;
+        return *this;
+    }
+
+    StreamingBatchNode<IN_ITEM, OUT_ITEM>& setExecutor(std::shared_ptr<Executor> newExecutor) {
+        executor = std::move(newExecutor);
+        return *this;
+    }
+
+    std::size_t getChunkSize() const { return chunkSize; }
+    std::size_t getPrefetchChunks() const { return prefetchChunks; }
+
+    // --- Methods for subclasses to implement ---
+    virtual OUT_ITEM execItem(const IN_ITEM& item) = 0;
+
+    virtual ExecResult<OUT_ITEM> tryExecItem(const IN_ITEM& item) {
+        return execItem(item);
+    }
+
+    virtual OUT_ITEM execItemFallback(const IN_ITEM& item, const std::exception& lastException) {
+         throw CognitoFlowException("Streaming item execution failed after retries, and fallback was not implemented or also failed.", lastException);
+    }
+
+    // Consumes one chunk: results[i] belongs to items[i]. Both buffers are reused for the
+    // next chunk, so move out whatever must be kept.
+    virtual void postChunk(Context& sharedContext, const std::vector<IN_ITEM>& items, std::vector<OUT_ITEM>& results) = 0;
+
+    StreamStats exec(Source) final {
+        throw std::logic_error("StreamingBatchNode::exec should not be called directly.");
+    }
+
+    StreamStats execFallback(Source, const std::exception& lastException) final {
+        throw CognitoFlowException("StreamingBatchNode internal execution loop failed.", lastException);
+    }
+
+    using Node<Source, StreamStats>::internalRun;
+
+    // prep, then exec and postChunk chunk by chunk, then post. The Exec stage in
+    // traces covers the whole stream, postChunk included.
+    std::optional<std::string> internalRun(Context& sharedContext) override {
+        detail::NodeTrace trace(this);
+        Source source = this->prep(sharedContext);
+        trace.stageDone(TraceStage::Prep);
+        StreamStats stats = streamItems(sharedContext, source);
+        trace.stageDone(TraceStage::Exec);
+        std::optional<std::string> action = this->post(sharedContext, source, stats);
+        trace.stageDone(TraceStage::Post);
+        trace.finish(action);
+        return action;
+    }
+
+protected:
+    StreamStats streamItems(Context& sharedContext, const Source& source) {
+        StreamStats stats;
+        RunFrame* frame = detail::currentFrame();
+        int& retryCounter = frame ? frame->retryCounter() : this->currentRetry;
+
+        detail::ChunkReader<IN_ITEM> reader(source, chunkSize, prefetchChunks,
+                                            prefetchChunks > 0 ? Executor::resolve(executor) : nullptr);
+        std::vector<IN_ITEM> items;
+        std::vector<OUT_ITEM> results;
+        while (reader.next(items)) {
+            if (DeadlineScope::expired()) {
+                throw DeadlineExceededException("Run deadline passed after " + std::to_string(stats.items) + " items of stream node " + this->getClassName());
+            }
+            results.clear();
+            results.reserve(items.size());
+            for (const auto& item : items) {
+                results.emplace_back(detail::retryItem<OUT_ITEM>(this, this->retrySettings(), retryCounter,
+                    [&] { return tryExecItem(item); },
+                    [&](const std::exception& lastException) { return execItemFallback(item, lastException); }));
+            }
+            postChunk(sharedContext, items, results);
+            stats.items += items.size();
+            ++stats.chunks;
+        }
+        return stats;
+    }
+};
+
+
+// --- Coalescing Node ---
+// Node whose exec calls from concurrently running flows are gathered into one
+// execBatch call. The first caller to arrive leads a batch: it waits until
+// maxBatchSize inputs are queued or the oldest queued input has waited maxWait, runs
+// execBatch on its own thread and hands every caller its result. One batch runs at a
+// time; the next one fills up meanwhile. Retries and
+// execFallback stay per caller: a failed batch entry is retried in a later batch.
+// Batches can only be as large as the number of flows inside exec at once, e.g. the
+// concurrency of a ParallelBatchFlow; a lone caller runs after maxWait with a batch
+// of one. Configure the batching before running flows.
+template <typename P, typename E>
+class CoalescingNode : public Node<P, E> {
+    struct Request {
+        const P* input;
+        std::chrono::steady_clock::time_point arrival;
+        std::optional<ExecResult<E>> outcome;
+        bool claimed = false;
+    };
+
+    std::mutex queueMutex;
+    std::condition_variable queueCv;
+    std::deque<Request*> pending; // Oldest first; callers' stack objects
+    bool leaderActive = false;
+    bool dispatching = false; // An execBatch call is running
+    std::atomic<std::size_t> batchCount{0};
+    std::atomic<std::size_t> itemCount{0};
+
+protected:
+    std::size_t maxBatchSize;
+    std::chrono::microseconds maxWait;
+
+public:
+    CoalescingNode(int retries = 1, long long waitMilliseconds = 0, std::size_t maxBatchItems = 32,
+                   std::chrono::microseconds maxBatchWait = std::chrono::microseconds(1000))
+        : Node<P, E>(retries, waitMilliseconds), maxBatchSize(maxBatchItems), maxWait(maxBatchWait) {
+        if (maxBatchSize == 0) throw std::invalid_argument("maxBatchSize must be at least 1");
+        if (maxWait.count() < 0) throw std::invalid_argument("maxWait cannot be negative");
+    }
+
+    virtual ~CoalescingNode() override = default;
+
+    CoalescingNode<P, E>& setMaxBatchSize(std::size_t maxBatchItems) {
+        if (maxBatchItems == 0) throw std::invalid_argument("maxBatchSize must be at least 1");
+        maxBatchSize = maxBatchItems;
+        return *this;
+    }
+
+    CoalescingNode<P, E>& setMaxWait(std::chrono::microseconds maxBatchWait) {
+        if (maxBatchWait.count() < 0) throw std::invalid_argument("maxWait cannot be negative");
+        maxWait = maxBatchWait;
+        return *this;
+    }
+
+    std::size_t getMaxBatchSize() const { return maxBatchSize; }
+    std::chrono::microseconds getMaxWait() const { return maxWait; }
+
+    // Batches dispatched and inputs they carried, for tuning maxBatchSize/maxWait
+    std::size_t batchesDispatched() const { return batchCount.load(std::memory_order_relaxed); }
+    std::size_t itemsDispatched() const { return itemCount.load(std::memory_order_relaxed); }
+
+    // --- Methods for subclasses to implement ---
+    // Vectorized exec: results[i] belongs to inputs[i]. Called on one of the callers'
+    // threads, never concurrently with itself.
+    virtual std::vector<E> execBatch(const std::vector<P>& inputs) = 0;
+
+    // Non-throwing form of execBatch that can fail single entries with
+    // ExecResult<E>::failure(...); a throw fails every entry of the batch.
+    virtual std::vector<ExecResult<E>> tryExecBatch(const std::vector<P>& inputs) {
+        std::vector<E> results = execBatch(inputs);
+        return std::vector<ExecResult<E>>(std::make_move_iterator(results.begin()), std::make_move_iterator(results.end()));
+    }
+
+    E exec(P prepResult) final {
+        throw std::logic_error("CoalescingNode::exec should not be called directly; implement execBatch.");
+    }
+
+    // Joins the current batch and waits for this input's result
+    ExecResult<E> tryExec(const P& prepResult) final {
+        Request request{&prepResult, std::chrono::steady_clock::now(), std::nullopt};
+        std::unique_lock<std::mutex> lock(queueMutex);
+        pending.push_back(&request);
+        if (pending.size() >= maxBatchSize) queueCv.notify_all(); // Wake the leader early
+
+        while (!request.outcome) {
+            if (!leaderActive && !request.claimed) {
+                leadBatch(lock);
+            } else {
+                queueCv.wait(lock);
+            }
+        }
+        return std::move(*request.outcome);
+    }
+
+private:
+    // Called with the queue lock held; returns with it held
+    void leadBatch(std::unique_lock<std::mutex>& lock) {
+        leaderActive = true;
+        queueCv.wait_until(lock, pending.front()->arrival + maxWait,
+                           [&] { return pending.size() >= maxBatchSize; });
+        queueCv.wait(lock, [&] { return !dispatching; }); // Keeps filling while the previous batch runs
+
+        std::vector<Request*> batch;
+        std::size_t take = std::min(maxBatchSize, pending.size());
+        batch.reserve(take);
+        for (std::size_t i = 0; i < take; ++i) {
+            pending.front()->claimed = true;
+            batch.push_back(pending.front());
+            pending.pop_front();
+        }
+        leaderActive = false;
+        dispatching = true;
+        if (!pending.empty()) queueCv.notify_all(); // A waiting caller leads the next batch
+        lock.unlock();
+
+        std::vector<ExecResult<E>> outcomes;
+        std::exception_ptr batchError;
+        try {
+            std::vector<P> inputs;
+            inputs.reserve(batch.size());
+            for (Request* request : batch) inputs.push_back(*request->input);
+            outcomes = tryExecBatch(inputs);
+            if (outcomes.size() != batch.size()) {
+                throw CognitoFlowException("execBatch returned " + std::to_string(outcomes.size())
+                                           + " results for " + std::to_string(batch.size()) + " inputs");
+            }
+        } catch (...) {
+            batchError = std::current_exception();
+        }
+        batchCount.fetch_add(1, std::memory_order_relaxed);
+        itemCount.fetch_add(batch.size(), std::memory_order_relaxed);
+
+        lock.lock();
+        dispatching = false;
+        for (std::size_t i = 0; i < batch.size(); ++i) {
+            if (batchError) {
+                batch[i]->outcome.emplace(ExecResult<E>::failure(batchError));
+            } else {
+                batch[i]->outcome.emplace(std::move(outcomes[i]));
+            }
+        }
+        queueCv.notify_all();
+    }
+};
+
+
+// --- Inference Buffers and Kernels ---
+// Dense float storage for InferenceBatchNode: rows x cols values, row-major,
+// contiguous and 64-byte aligned so SIMD loads never straddle a cache line at the
+// start of the buffer. Copies share the buffer (like Payload); use clone() before
+// writing to a batch that others still read.
+class FloatBatch {
+public:
+    static constexpr std::size_t ALIGNMENT = 64;
+
+private:
+    struct AlignedDelete {
+        void operator()(float* data) const { ::operator delete(data, std::align_val_t(ALIGNMENT)); }
+    };
+    std::shared_ptr<float> storage;
+    std::size_t rowCount = 0;
+    std::size_t colCount = 0;
+
+public:
+    FloatBatch() = default;
+
+    // Zero-initialized rows x cols batch
+    FloatBatch(std::size_t rows, std::size_t cols) : rowCount(rows), colCount(cols) {
+        std::size_t count = rows * cols;
+        if (count == 0) return;
+        float* data = static_cast<float*>(::operator new(count * sizeof(float), std::align_val_t(ALIGNMENT)));
+        std::fill(data, data + count, 0.0f);
+        storage = std::shared_ptr<float>(data, AlignedDelete{});
+    }
+
+    static FloatBatch copyOf(const float* values, std::size_t rows, std::size_t cols) {
+        FloatBatch batch(rows, cols);
+        if (rows * cols > 0) std::copy(values, values + rows * cols, batch.data());
+        return batch;
+    }
+
+    FloatBatch clone() const { return copyOf(data(), rowCount, colCount); }
+
+    std::size_t rows() const { return rowCount; }
+    std::size_t cols() const { return colCount; }
+    std::size_t size() const { return rowCount * colCount; }
+    bool empty() const { return size() == 0; }
+
+    float* data() { return storage.get(); }
+    const float* data() const { return storage.get(); }
+    float* row(std::size_t index) { return storage.get() + index * colCount; }
+    const float* row(std::size_t index) const { return storage.get() + index * colCount; }
+};
+
+enum class SimdLevel { Scalar, Neon, Avx2, Avx512 };
+
+inline const char* simdLevelName(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::Scalar: return "scalar";
+        case SimdLevel::Neon: return "neon";
+        case SimdLevel::Avx2: return "avx2";
+        case SimdLevel::Avx512: return "avx512";
+    }
+    return "unknown";
+}
+
+// Vector primitives the CPU layers are written in, resolved once per instruction set
+struct SimdKernels {
+    SimdLevel level = SimdLevel::Scalar;
+    void (*axpy)(float a, const float* x, float* y, std::size_t n) = nullptr; // y += a * x
+    float (*dot)(const float* x, const float* y, std::size_t n) = nullptr;
+};
+
+namespace detail {
+    inline void axpyScalar(float a, const float* x, float* y, std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) y[i] += a * x[i];
+    }
+
+    inline float dotScalar(const float* x, const float* y, std::size_t n) {
+        float sum = 0.0f;
+        for (std::size_t i = 0; i < n; ++i) sum += x[i] * y[i];
+        return sum;
+    }
+
+#if COGNITOFLOW_X86_SIMD
+    // Compiled for their instruction set regardless of -march; only called after detection
+    __attribute__((target("avx2,fma"))) inline void axpyAvx2(float a, const float* x, float* y, std::size_t n) {
+        const __m256 scale = _mm256_set1_ps(a);
+        std::size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            _mm256_storeu_ps(y + i, _mm256_fmadd_ps(scale, _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i)));
+        }
+        for (; i < n; ++i) y[i] += a * x[i];
+    }
+
+    __attribute__((target("avx2,fma"))) inline float dotAvx2(const float* x, const float* y, std::size_t n) {
+        __m256 sum = _mm256_setzero_ps();
+        std::size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            sum = _mm256_fmadd_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i), sum);
+        }
+        __m128 half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+        half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+        half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+        float total = _mm_cvtss_f32(half);
+        for (; i < n; ++i) total += x[i] * y[i];
+        return total;
+    }
+
+    __attribute__((target("avx512f"))) inline void axpyAvx512(float a, const float* x, float* y, std::size_t n) {
+        const __m512 scale = _mm512_set1_ps(a);
+        std::size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            _mm512_storeu_ps(y + i, _mm512_fmadd_ps(scale, _mm512_loadu_ps(x + i), _mm512_loadu_ps(y + i)));
+        }
+        if (i < n) {
+            const __mmask16 tail = static_cast<__mmask16>((1u << (n - i)) - 1);
+            __m512 result = _mm512_fmadd_ps(scale, _mm512_maskz_loadu_ps(tail, x + i), _mm512_maskz_loadu_ps(tail, y + i));
+            _mm512_mask_storeu_ps(y + i, tail, result);
+        }
+    }
+
+    __attribute__((target("avx512f"))) inline float dotAvx512(const float* x, const float* y, std::size_t n) {
+        __m512 sum = _mm512_setzero_ps();
+        std::size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            sum = _mm512_fmadd_ps(_mm512_loadu_ps(x + i), _mm512_loadu_ps(y + i), sum);
+        }
+        if (i < n) {
+            const __mmask16 tail = static_cast<__mmask16>((1u << (n - i)) - 1);
+            sum = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(tail, x + i), _mm512_maskz_loadu_ps(tail, y + i), sum);
+        }
+        return _mm512_reduce_add_ps(sum);
+    }
+#endif
+
+#if COGNITOFLOW_NEON_SIMD
+    inline void axpyNeon(float a, const float* x, float* y, std::size_t n) {
+        const float32x4_t scale = vdupq_n_f32(a);
+        std::size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            vst1q_f32(y + i, vmlaq_f32(vld1q_f32(y + i), scale, vld1q_f32(x + i)));
+        }
+        for (; i < n; ++i) y[i] += a * x[i];
+    }
+
+    inline float dotNeon(const float* x, const float* y, std::size_t n) {
+        float32x4_t sum = vdupq_n_f32(0.0f);
+        std::size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            sum = vmlaq_f32(sum, vld1q_f32(x + i), vld1q_f32(y + i));
+        }
+        float lanes[4];
+        vst1q_f32(lanes, sum);
+        float total = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+        for (; i < n; ++i) total += x[i] * y[i];
+        return total;
+    }
+#endif
+} // namespace detail
+
+// Best instruction set the running CPU supports
+inline SimdLevel detectSimdLevel() {
+#if COGNITOFLOW_X86_SIMD
+    static const SimdLevel level = [] {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f")) return SimdLevel::Avx512;
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return SimdLevel::Avx2;
+        return SimdLevel::Scalar;
+    }();
+    return level;
+#elif COGNITOFLOW_NEON_SIMD
+    return SimdLevel::Neon;
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+// Kernels for level, stepping down to AVX2 or scalar where the CPU lacks it
+inline SimdKernels simdKernels(SimdLevel level = detectSimdLevel()) {
+    const SimdLevel best = detectSimdLevel();
+    if (level == SimdLevel::Avx512 && best != SimdLevel::Avx512) level = SimdLevel::Avx2;
+    if (level == SimdLevel::Avx2 && best != SimdLevel::Avx2 && best != SimdLevel::Avx512) level = SimdLevel::Scalar;
+    if (level == SimdLevel::Neon && best != SimdLevel::Neon) level = SimdLevel::Scalar;
+    switch (level) {
+#if COGNITOFLOW_X86_SIMD
+        case SimdLevel::Avx512: return {level, detail::axpyAvx512, detail::dotAvx512};
+        case SimdLevel::Avx2: return {level, detail::axpyAvx2, detail::dotAvx2};
+#endif
+#if COGNITOFLOW_NEON_SIMD
+        case SimdLevel::Neon: return {level, detail::axpyNeon, detail::dotNeon};
+#endif
+        default: return {SimdLevel::Scalar, detail::axpyScalar, detail::dotScalar};
+    }
+}
+
+
+// --- Inference Layers ---
+enum class Activation { None, ReLU, SiLU, Tanh };
+
+// One layer of an InferenceBatchNode model. Subclass per function; forward maps
+// rows x inputSize() values to rows x outputSize() values, both contiguous.
+// Layers are immutable once built and may be shared by several nodes.
+class InferenceLayer {
+public:
+    virtual ~InferenceLayer() = default;
+    virtual std::size_t inputSize() const = 0;
+    virtual std::size_t outputSize() const = 0;
+    virtual void forward(const float* input, float* output, std::size_t rows, const SimdKernels& kernels) const = 0;
+
+protected:
+    static void activate(Activation activation, float* values, std::size_t count) {
+        switch (activation) {
+            case Activation::None: break;
+            case Activation::ReLU:
+                for (std::size_t i = 0; i < count; ++i) values[i] = values[i] > 0.0f ? values[i] : 0.0f;
+                break;
+            case Activation::SiLU:
+                for (std::size_t i = 0; i < count; ++i) values[i] = values[i] / (1.0f + std::exp(-values[i]));
+                break;
+            case Activation::Tanh:
+                for (std::size_t i = 0; i < count; ++i) values[i] = std::tanh(values[i]);
+                break;
+        }
+    }
+};
+
+// Fully connected layer: out = activation(in * W + bias). weights are
+// inputs x outputs, row-major (row i holds input i's contribution to every output).
+class DenseLayer : public InferenceLayer {
+    std::size_t inputs;
+    std::size_t outputs;
+    FloatBatch weightData;
+    FloatBatch biasData;
+    Activation activation;
+
+public:
+    DenseLayer(std::size_t inputCount, std::size_t outputCount, const std::vector<float>& weights,
+               const std::vector<float>& bias = {}, Activation layerActivation = Activation::None)
+        : inputs(inputCount), outputs(outputCount), biasData(1, outputCount), activation(layerActivation) {
+        if (inputs == 0 || outputs == 0) throw std::invalid_argument("DenseLayer needs at least one input and output");
+        if (weights.size() != inputs * outputs) throw std::invalid_argument("DenseLayer weights must hold inputs * outputs values");
+        if (!bias.empty() && bias.size() != outputs) throw std::invalid_argument("DenseLayer bias must hold one value per output");
+        weightData = FloatBatch::copyOf(weights.data(), inputs, outputs);
+        if (!bias.empty()) std::copy(bias.begin(), bias.end(), biasData.data());
+    }
+
+    std::size_t inputSize() const override { return inputs; }
+    std::size_t outputSize() const override { return outputs; }
+    const FloatBatch& weights() const { return weightData; }
+    const FloatBatch& bias() const { return biasData; }
+    Activation getActivation() const { return activation; }
+
+    void forward(const float* input, float* output, std::size_t rows, const SimdKernels& kernels) const override {
+        for (std::size_t r = 0; r < rows; ++r) {
+            const float* in = input + r * inputs;
+            float* out = output + r * outputs;
+            std::copy(biasData.data(), biasData.data() + outputs, out);
+            for (std::size_t i = 0; i < inputs; ++i) {
+                kernels.axpy(in[i], weightData.row(i), out, outputs);
+            }
+        }
+        activate(activation, output, rows * outputs);
+    }
+};
+
+// Kolmogorov-Arnold layer: out[j] = sum_i (base[i][j] * silu(x_i) + spline_ij(x_i)),
+// each spline_ij a uniform cubic B-spline over [gridMin, gridMax] with gridSize
+// intervals (gridSize + 3 coefficients). coefficients are laid out
+// [input][basis][output] and baseWeights [input][output]; inputs outside the grid
+// are clamped to it. This is the layout pykan-style exporters produce after a transpose.
+class KanLayer : public InferenceLayer {
+    std::size_t inputs;
+    std::size_t outputs;
+    std::size_t gridSize;
+    float gridMin;
+    float gridStep;
+    FloatBatch coefficientData; // (inputs * (gridSize + 3)) x outputs
+    FloatBatch baseData;        // inputs x outputs, empty when there is no base term
+
+public:
+    KanLayer(std::size_t inputCount, std::size_t outputCount, std::size_t intervals, float minValue, float maxValue,
+             const std::vector<float>& coefficients, const std::vector<float>& baseWeights = {})
+        : inputs(inputCount), outputs(outputCount), gridSize(intervals), gridMin(minValue) {
+        if (inputs == 0 || outputs == 0) throw std::invalid_argument("KanLayer needs at least one input and output");
+        if (gridSize == 0 || !(maxValue > minValue)) throw std::invalid_argument("KanLayer needs a non-empty grid");
+        if (coefficients.size() != inputs * (gridSize + 3) * outputs) {
+            throw std::invalid_argument("KanLayer coefficients must hold inputs * (gridSize + 3) * outputs values");
+        }
+        if (!baseWeights.empty() && baseWeights.size() != inputs * outputs) {
+            throw std::invalid_argument("KanLayer baseWeights must hold inputs * outputs values");
+        }
+        gridStep = (maxValue - minValue) / static_cast<float>(gridSize);
+        coefficientData = FloatBatch::copyOf(coefficients.data(), inputs * (gridSize + 3), outputs);
+        if (!baseWeights.empty()) baseData = FloatBatch::copyOf(baseWeights.data(), inputs, outputs);
+    }
+
+    std::size_t inputSize() const override { return inputs; }
+    std::size_t outputSize() const override { return outputs; }
+    std::size_t getGridSize() const { return gridSize; }
+    float getGridMin() const { return gridMin; }
+    float getGridMax() const { return gridMin + gridStep * static_cast<float>(gridSize); }
+    const FloatBatch& coefficients() const { return coefficientData; }
+    const FloatBatch& baseWeights() const { return baseData; }
+
+    void forward(const float* input, float* output, std::size_t rows, const SimdKernels& kernels) const override {
+        const std::size_t basisCount = gridSize + 3;
+        for (std::size_t r = 0; r < rows; ++r) {
+            const float* in = input + r * inputs;
+            float* out = output + r * outputs;
+            std::fill(out, out + outputs, 0.0f);
+            for (std::size_t i = 0; i < inputs; ++i) {
+                const float x = in[i];
+                if (!baseData.empty()) kernels.axpy(x / (1.0f + std::exp(-x)), baseData.row(i), out, outputs);
+
+                // Only four basis functions are non-zero at x: those of interval k
+                float t = (x - gridMin) / gridStep;
+                t = std::min(std::max(t, 0.0f), static_cast<float>(gridSize));
+                std::size_t k = std::min(static_cast<std::size_t>(t), gridSize - 1);
+                const float u = t - static_cast<float>(k);
+                const float u2 = u * u, u3 = u2 * u;
+                const float basis[4] = {
+                    (1.0f - 3.0f * u + 3.0f * u2 - u3) / 6.0f,
+                    (4.0f - 6.0f * u2 + 3.0f * u3) / 6.0f,
+                    (1.0f + 3.0f * u + 3.0f * u2 - 3.0f * u3) / 6.0f,
+                    u3 / 6.0f,
+                };
+                for (std::size_t b = 0; b < 4; ++b) {
+                    kernels.axpy(basis[b], coefficientData.row(i * basisCount + k + b), out, outputs);
+                }
+            }
+        }
+    }
+};
+
+
+// --- Inference Backends ---
+// Runs an InferenceBatchNode's layers. A batch is fed through in micro-batches over two
+// slots: enqueue(slot, ...) starts one micro-batch and collect(slot, ...) waits for it,
+// and the node always enqueues micro-batch m before collecting m - 1. A device backend
+// (e.g. Dawn/WebGPU compute) therefore uploads batch m while batch m - 1 is still
+// computing, and downloads m - 1 while m runs. Backends are used by one run at a time.
+class InferenceBackend {
+public:
+    virtual ~InferenceBackend() = default;
+
+    virtual std::string name() const = 0;
+
+    // Called once before the first batch, e.g. to upload the weights
+    virtual void load(const std::vector<std::shared_ptr<const InferenceLayer>>& layers) = 0;
+
+    // Starts rows x inputSize values (slot is 0 or 1); input only has to stay valid
+    // until the call returns
+    virtual void enqueue(int slot, const float* input, std::size_t rows) = 0;
+
+    // Waits for the slot's micro-batch and writes its rows x outputSize values
+    virtual void collect(int slot, float* output) = 0;
+
+    // Drops uncollected work after a failure so the next batch starts clean
+    virtual void discard() {}
+};
+
+// Runs the layers' forward() with the SIMD kernels for the current CPU. enqueue does
+// the work; collect copies out the slot's result.
+class CpuInferenceBackend : public InferenceBackend {
+    SimdKernels kernels;
+    std::vector<std::shared_ptr<const InferenceLayer>> layers;
+    std::vector<float> scratch[2];     // Ping-pong buffers between layers
+    std::vector<float> slotOutput[2];
+
+public:
+    explicit CpuInferenceBackend(SimdLevel level = detectSimdLevel()) : kernels(simdKernels(level)) {}
+
+    std::string name() const override { return std::string("cpu-") + simdLevelName(kernels.level); }
+    SimdLevel simdLevel() const { return kernels.level; }
+
+    void load(const std::vector<std::shared_ptr<const InferenceLayer>>& modelLayers) override {
+        layers = modelLayers;
+    }
+
+    void enqueue(int slot, const float* input, std::size_t rows) override {
+        const float* current = input;
+        for (std::size_t l = 0; l < layers.size(); ++l) {
+            const bool last = l + 1 == layers.size();
+            std::vector<float>& target = last ? slotOutput[slot] : scratch[l % 2];
+            target.resize(rows * layers[l]->outputSize());
+            layers[l]->forward(current, target.data(), rows, kernels);
+            current = target.data();
+        }
+    }
+
+    void collect(int slot, float* output) override {
+        std::copy(slotOutput[slot].begin(), slotOutput[slot].end(), output);
+    }
+};
+
+using InferenceBackendFactory = std::function<std::unique_ptr<InferenceBackend>()>;
+
+// Process-wide list of backends InferenceBatchNode can pick from at runtime. A factory
+// may return nullptr when its device is unavailable; selection then falls through to
+// the next-highest priority. "cpu" (priority 0) is always present.
+class InferenceBackends {
+    struct Entry {
+        std::string name;
+        int priority;
+        InferenceBackendFactory factory;
+    };
+
+    static std::mutex& registryMutex() {
+        static std::mutex mutex;
+        return mutex;
+    }
+
+    static std::vector<Entry>& entries() {
+        static std::vector<Entry> registered{{"cpu", 0, [] { return std::make_unique<CpuInferenceBackend>(); }}};
+        return registered;
+    }
+
+public:
+    // Registers or replaces a backend, e.g. add("webgpu", 10, makeDawnBackend)
+    static void add(const std::string& name, int priority, InferenceBackendFactory factory) {
+        std::lock_guard<std::mutex> lock(registryMutex());
+        auto& registered = entries();
+        registered.erase(std::remove_if(registered.begin(), registered.end(),
+                                        [&](const Entry& entry) { return entry.name == name; }),
+                         registered.end());
+        registered.push_back({name, priority, std::move(factory)});
+        std::stable_sort(registered.begin(), registered.end(),
+                         [](const Entry& a, const Entry& b) { return a.priority > b.priority; });
+    }
+
+    static std::vector<std::string> names() {
+        std::lock_guard<std::mutex> lock(registryMutex());
+        std::vector<std::string> result;
+        for (const auto& entry : entries()) result.push_back(entry.name);
+        return result;
+    }
+
+    // The named backend, or with an empty name the highest-priority one that is available
+    static std::unique_ptr<InferenceBackend> create(const std::string& name = "") {
+        std::vector<Entry> candidates;
+        {
+            std::lock_guard<std::mutex> lock(registryMutex());
+            candidates = entries();
+        }
+        for (const auto& entry : candidates) {
+            if (!name.empty() && entry.name != name) continue;
+            if (std::unique_ptr<InferenceBackend> backend = entry.factory()) return backend;
+            if (!name.empty()) break;
+        }
+        throw CognitoFlowException(name.empty() ? std::string("No inference backend is available")
+                                                : "Inference backend '" + name + "' is not available");
+    }
+};
+
+
+// --- Inference Batch Node ---
+// Batch node for model inference over contiguous float rows instead of a vector of
+// item objects. prep returns a FloatBatch of rows x inputSize, exec runs it through
+// the layers on the chosen backend in micro-batches of microBatchRows (double
+// buffered, see InferenceBackend), and post receives rows x outputSize. Retries and
+// execFallback apply to the whole batch as in Node. The backend is created on the
+// first run; runs of one node are serialized on it.
+class InferenceBatchNode : public Node<FloatBatch, FloatBatch> {
+protected:
+    std::vector<std::shared_ptr<const InferenceLayer>> layers;
+    std::string backendName; // Empty = best available
+    std::size_t microBatchRows = 256;
+
+private:
+    std::mutex backendMutex;
+    std::unique_ptr<InferenceBackend> backend;
+
+public:
+    explicit InferenceBatchNode(std::vector<std::shared_ptr<const InferenceLayer>> modelLayers,
+                                int retries = 1, long long waitMilliseconds = 0)
+        : Node<FloatBatch, FloatBatch>(retries, waitMilliseconds), layers(std::move(modelLayers)) {
+        if (layers.empty()) throw std::invalid_argument("InferenceBatchNode needs at least one layer");
+        for (std::size_t l = 0; l < layers.size(); ++l) {
+            if (!layers[l]) throw std::invalid_argument("Inference layer cannot be null");
+            if (l > 0 && layers[l - 1]->outputSize() != layers[l]->inputSize()) {
+                throw std::invalid_argument("Inference layer " + std::to_string(l) + " expects "
+                                            + std::to_string(layers[l]->inputSize()) + " inputs but the previous layer produces "
+                                            + std::to_string(layers[l - 1]->outputSize()));
+            }
+        }
+    }
+
+    virtual ~InferenceBatchNode() override = default;
+
+    // Backend to run on ("" = highest-priority available); takes effect on the next run
+    InferenceBatchNode& setBackend(const std::string& name) {
+        std::lock_guard<std::mutex> lock(backendMutex);
+        backendName = name;
+        backend.reset();
+        return *this;
+    }
+
+    InferenceBatchNode& setMicroBatchRows(std::size_t rows) {
+        if (rows == 0) throw std::invalid_argument("microBatchRows must be at least 1");
+        microBatchRows = rows;
+        return *this;
+    }
+
+    std::size_t getMicroBatchRows() const { return microBatchRows; }
+    std::size_t inputSize() const { return layers.front()->inputSize(); }
+    std::size_t outputSize() const { return layers.back()->outputSize(); }
+
+    // Name of the backend runs use, creating it if needed
+    std::string getBackendName() {
+        std::lock_guard<std::mutex> lock(backendMutex);
+        return ensureBackend().name();
+    }
+
+    FloatBatch exec(FloatBatch input) override {
+        if (!input.empty() && input.cols() != inputSize()) {
+            throw std::invalid_argument("InferenceBatchNode expects " + std::to_string(inputSize())
+                                        + " values per row, got " + std::to_string(input.cols()));
+        }
+        FloatBatch output(input.rows(), outputSize());
+        if (input.rows() == 0) return output;
+
+        std::lock_guard<std::mutex> lock(backendMutex);
+        InferenceBackend& runner = ensureBackend();
+        const std::size_t batches = (input.rows() + microBatchRows - 1) / microBatchRows;
+        try {
+            for (std::size_t m = 0; m <= batches; ++m) {
+                if (m < batches) {
+                    std::size_t rows = std::min(microBatchRows, input.rows() - m * microBatchRows);
+                    runner.enqueue(static_cast<int>(m % 2), input.row(m * microBatchRows), rows);
+                }
+                if (m > 0) {
+                    runner.collect(static_cast<int>((m - 1) % 2), output.row((m - 1) * microBatchRows));
+                }
+            }
+        } catch (...) {
+            runner.discard();
+            throw;
+        }
+        return output;
+    }
+
+private:
+    // Caller holds backendMutex
+    InferenceBackend& ensureBackend() {
+        if (!backend) {
+            std::unique_ptr<InferenceBackend> created = InferenceBackends::create(backendName);
+            created->load(layers);
+            backend = std::move(created);
+        }
+        return *backend;
+    }
+};
+
+
+// --- Serialization ---
+// Binary form of Context and Params values. std::any carries no serializer, so each
+// value type registers a codec with TypeRegistry under a stable name; common scalar,
+// string, vector and FloatBatch types are built in. A snapshot lays the values out
+// FlatBuffers-style so it can be read in place, e.g. straight from a mapped file:
+//     header   "CFSNAP\0\1" | u32 entry count | u32 0 | u64 total size
+//     table    per entry: u64 key hash | u64 type id | u64 key offset | u64 value offset
+//                         | u32 key length | u32 value length     (sorted by key hash)
+//     data     keys and values; values start 8-byte aligned
+// Opening a SnapshotView only checks the header; lookups binary-search the table and
+// typed accessors read the bytes where they are. Header and table integers are
+// little-endian; value bytes are host order, so snapshots move between little-endian
+// hosts. Values whose type has no codec make encoding fail with every offending key.
+namespace detail {
+    inline void putU32(std::string& out, std::uint32_t value) {
+        for (int i = 0; i < 4; ++i) out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+
+    inline void putU64(std::string& out, std::uint64_t value) {
+        for (int i = 0; i < 8; ++i) out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+
+    inline void putBytes(std::string& out, std::string_view bytes) {
+        putU32(out, static_cast<std::uint32_t>(bytes.size()));
+        out.append(bytes.data(), bytes.size());
+    }
+
+    // Bounds-checked reader over a record; ok() turns false on the first overrun
+    class ByteReader {
+        std::string_view data;
+        std::size_t offset = 0;
+        bool valid = true;
+
+        bool need(std::size_t count) {
+            if (!valid || data.size() - offset < count) valid = false;
+            return valid;
+        }
+
+    public:
+        explicit ByteReader(std::string_view bytes) : data(bytes) {}
+
+        bool ok() const { return valid; }
+        bool atEnd() const { return offset == data.size(); }
+        std::size_t remaining() const { return valid ? data.size() - offset : 0; }
+
+        // Element count that is checked before anything is allocated for it: each element
+        // takes at least minElementBytes, so a count the remaining bytes cannot hold is
+        // malformed (and read as 0)
+        std::uint32_t count(std::size_t minElementBytes) {
+            std::uint32_t value = u32();
+            if (valid && minElementBytes > 0 && value > remaining() / minElementBytes) valid = false;
+            return valid ? value : 0;
+        }
+
+        std::uint8_t u8() {
+            return need(1) ? static_cast<std::uint8_t>(data[offset++]) : 0;
+        }
+
+        std::uint32_t u32() {
+            if (!need(4)) return 0;
+            std::uint32_t value = 0;
+            for (int i = 0; i < 4; ++i) value |= static_cast<std::uint32_t>(static_cast<std::uint8_t>(data[offset++])) << (8 * i);
+            return value;
+        }
+
+        std::uint64_t u64() {
+            if (!need(8)) return 0;
+            std::uint64_t value = 0;
+            for (int i = 0; i < 8; ++i) value |= static_cast<std::uint64_t>(static_cast<std::uint8_t>(data[offset++])) << (8 * i);
+            return value;
+        }
+
+        std::string_view bytes() {
+            std::uint32_t size = u32();
+            if (!need(size)) return {};
+            std::string_view result = data.substr(offset, size);
+            offset += size;
+            return result;
+        }
+    };
+
+
+    template <typename T>
+    void putRaw(std::string& out, const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>, "putRaw needs a trivially copyable type");
+        out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template <typename T>
+    T getRaw(const char* data) {
+        T value;
+        std::memcpy(&value, data, sizeof(T));
+        return value;
+    }
+} // namespace detail
+
+// Codec of one registered value type
+struct ValueCodec {
+    std::string name;     // Stable across builds, e.g. "int32" or "my.Embedding"
+    std::uint64_t typeId; // hashKey(name); what snapshots store
+    std::type_index type;
+    std::function<void(const std::any&, std::string&)> encode; // Appends the value's bytes
+    std::function<std::any(std::string_view)> decode;
+};
+
+class TypeRegistry {
+    mutable std::shared_mutex mutex;
+    std::unordered_map<std::type_index, std::shared_ptr<const ValueCodec>> byType;
+    std::unordered_map<std::uint64_t, std::shared_ptr<const ValueCodec>> byId;
+
+public:
+    static TypeRegistry& instance() {
+        static TypeRegistry* registry = new TypeRegistry(); // Leaked: usable from static destructors
+        return *registry;
+    }
+
+    // Registers T under name. encode appends T's bytes; decode gets exactly those bytes.
+    // Registering a name twice for different types throws.
+    template <typename T>
+    void add(const std::string& name, std::function<void(const T&, std::string&)> encode,
+             std::function<T(std::string_view)> decode) {
+        auto codec = std::make_shared<ValueCodec>(ValueCodec{
+            name, detail::hashKey(name), std::type_index(typeid(T)),
+            [encode](const std::any& value, std::string& out) { encode(*std::any_cast<T>(&value), out); },
+            [decode](std::string_view bytes) { return std::any(decode(bytes)); }});
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        auto existing = byId.find(codec->typeId);
+        if (existing != byId.end() && existing->second->type != codec->type) {
+            throw std::invalid_argument("Type name '" + name + "' is already registered for another type");
+        }
+        byType[codec->type] = codec;
+        byId[codec->typeId] = codec;
+    }
+
+    // Codec for trivially copyable T stored as its raw bytes
+    template <typename T>
+    void addTrivial(const std::string& name) {
+        static_assert(std::is_trivially_copyable_v<T>, "addTrivial needs a trivially copyable type");
+        add<T>(name, [](const T& value, std::string& out) { detail::putRaw(out, value); },
+               [name](std::string_view bytes) {
+                   if (bytes.size() != sizeof(T)) throw CognitoFlowException("Malformed '" + name + "' value in snapshot");
+                   return detail::getRaw<T>(bytes.data());
+               });
+    }
+
+    std::shared_ptr<const ValueCodec> find(std::type_index type) const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        auto it = byType.find(type);
+        return it == byType.end() ? nullptr : it->second;
+    }
+
+    std::shared_ptr<const ValueCodec> find(std::uint64_t typeId) const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        auto it = byId.find(typeId);
+        return it == byId.end() ? nullptr : it->second;
+    }
+
+    template <typename T>
+    std::uint64_t typeIdOf() const {
+        std::shared_ptr<const ValueCodec> codec = find(std::type_index(typeid(T)));
+        if (!codec) throw CognitoFlowException(std::string("Type ") + typeid(T).name() + " has no registered codec");
+        return codec->typeId;
+    }
+
+private:
+    template <typename T>
+    void addTrivialVector(const std::string& name) {
+        add<std::vector<T>>(name,
+            [](const std::vector<T>& values, std::string& out) {
+                out.append(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+            },
+            [name](std::string_view bytes) {
+                if (bytes.size() % sizeof(T) != 0) throw CognitoFlowException("Malformed '" + name + "' value in snapshot");
+                std::vector<T> values(bytes.size() / sizeof(T));
+                if (!values.empty()) std::memcpy(values.data(), bytes.data(), bytes.size());
+                return values;
+            });
+    }
+
+    TypeRegistry() {
+        addTrivial<bool>("bool");
+        addTrivial<int>("int32");
+        addTrivial<unsigned>("uint32");
+        addTrivial<long>("long");
+        addTrivial<unsigned long>("ulong");
+        addTrivial<long long>("int64");
+        addTrivial<unsigned long long>("uint64");
+        addTrivial<float>("float32");
+        addTrivial<double>("float64");
+        add<std::string>("string", [](const std::string& value, std::string& out) { out += value; },
+                         [](std::string_view bytes) { return std::string(bytes); });
+        addTrivialVector<float>("vector<float32>");
+        addTrivialVector<double>("vector<float64>");
+        addTrivialVector<int>("vector<int32>");
+        addTrivialVector<long long>("vector<int64>");
+        add<std::vector<std::string>>("vector<string>",
+            [](const std::vector<std::string>& values, std::string& out) {
+                detail::putU32(out, static_cast<std::uint32_t>(values.size()));
+                for (const auto& value : values) detail::putBytes(out, value);
+            },
+            [](std::string_view bytes) {
+                detail::ByteReader reader(bytes);
+                std::vector<std::string> values(reader.count(4)); // Each string has a 4-byte length
+                for (auto& value : values) value = std::string(reader.bytes());
+                if (!reader.ok() || !reader.atEnd()) throw CognitoFlowException("Malformed 'vector<string>' value in snapshot");
+                return values;
+            });
+        add<FloatBatch>("FloatBatch",
+            [](const FloatBatch& batch, std::string& out) {
+                detail::putU64(out, batch.rows());
+                detail::putU64(out, batch.cols());
+                out.append(reinterpret_cast<const char*>(batch.data()), batch.size() * sizeof(float));
+            },
+            [](std::string_view bytes) {
+                detail::ByteReader reader(bytes);
+                std::uint64_t rows = reader.u64();
+                std::uint64_t cols = reader.u64();
+                // Divides instead of multiplying, so huge rows * cols cannot wrap around to the payload size
+                std::uint64_t floats = reader.remaining() / sizeof(float);
+                bool fits = reader.ok() && reader.remaining() % sizeof(float) == 0
+                         && (rows == 0 || cols == 0 ? floats == 0 : cols <= floats && rows == floats / cols && floats % cols == 0);
+                if (!fits) {
+                    throw CognitoFlowException("Malformed 'FloatBatch' value in snapshot");
+                }
+                FloatBatch batch(rows, cols);
+                if (!batch.empty()) std::memcpy(batch.data(), bytes.data() + 16, batch.size() * sizeof(float));
+                return batch;
+            });
+    }
+};
+
+// Contiguous values of a snapshot entry, read in place
+template <typename T>
+struct ArrayView {
+    const T* data = nullptr;
+    std::size_t size = 0;
+    const T* begin() const { return data; }
+    const T* end() const { return data + size; }
+    const T& operator[](std::size_t index) const { return data[index]; }
+};
+
+// Read-only view of an encoded snapshot; the bytes must outlive it
+class SnapshotView {
+public:
+    static constexpr char MAGIC[8] = {'C', 'F', 'S', 'N', 'A', 'P', '\0', '\1'};
+    static constexpr std::uint32_t FORMAT_VERSION = 0; // Header word after the entry count; bump on layout changes
+    static constexpr std::size_t HEADER_SIZE = 24;
+    static constexpr std::size_t ENTRY_SIZE = 40;
+
+    struct Value {
+        std::string_view key;
+        std::uint64_t typeId = 0; // 0 = empty std::any
+        std::string_view bytes;
+    };
+
+private:
+    const char* base = nullptr;
+    std::size_t length = 0;
+    std::size_t count = 0;
+
+public:
+    SnapshotView() = default;
+
+    // Checks the header and that the table fits; entries are bounds-checked on access
+    SnapshotView(const void* data, std::size_t size) : base(static_cast<const char*>(data)), length(size) {
+        if (size < HEADER_SIZE || std::memcmp(base, MAGIC, sizeof(MAGIC)) != 0) {
+            throw CognitoFlowException("Not a CognitoFlow snapshot");
+        }
+        detail::ByteReader header(std::string_view(base + 8, HEADER_SIZE - 8));
+        count = header.u32();
+        std::uint32_t version = header.u32();
+        if (version != FORMAT_VERSION) {
+            throw CognitoFlowException("Unsupported CognitoFlow snapshot format version " + std::to_string(version));
+        }
+        std::uint64_t total = header.u64();
+        if (total != size || (size - HEADER_SIZE) / ENTRY_SIZE < count) {
+            throw CognitoFlowException("Truncated or corrupt CognitoFlow snapshot");
+        }
+    }
+
+    explicit SnapshotView(std::string_view bytes) : SnapshotView(bytes.data(), bytes.size()) {}
+
+    std::size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    // Entry in table order (ascending key hash)
+    Value at(std::size_t index) const {
+        if (index >= count) throw std::out_of_range("Snapshot entry index out of range");
+        const char* entry = base + HEADER_SIZE + index * ENTRY_SIZE;
+        detail::ByteReader reader(std::string_view(entry, ENTRY_SIZE));
+        reader.u64();
+        Value value;
+        value.typeId = reader.u64();
+        std::uint64_t keyOffset = reader.u64();
+        std::uint64_t valueOffset = reader.u64();
+        std::uint32_t keyLength = reader.u32();
+        std::uint32_t valueLength = reader.u32();
+        if (keyOffset > length || length - keyOffset < keyLength || valueOffset > length || length - valueOffset < valueLength) {
+            throw CognitoFlowException("Corrupt CognitoFlow snapshot entry");
+        }
+        value.key = std::string_view(base + keyOffset, keyLength);
+        value.bytes = std::string_view(base + valueOffset, valueLength);
+        return value;
+    }
+
+    std::optional<Value> find(std::string_view key) const {
+        const std::uint64_t hash = detail::hashKey(key);
+        std::size_t low = 0, high = count;
+        while (low < high) { // First entry with hash >= key's
+            std::size_t mid = low + (high - low) / 2;
+            if (hashAt(mid) < hash) low = mid + 1; else high = mid;
+        }
+        for (; low < count && hashAt(low) == hash; ++low) {
+            Value value = at(low);
+            if (value.key == key) return value;
+        }
+        return std::nullopt;
+    }
+
+    bool contains(std::string_view key) const { return find(key).has_value(); }
+
+    // Decoded copy of key's value; nullopt if absent, throws if it holds another type
+    template <typename T>
+    std::optional<T> get(std::string_view key) const {
+        std::optional<Value> value = find(key);
+        if (!value) return std::nullopt;
+        std::uint64_t expected = TypeRegistry::instance().typeIdOf<T>();
+        if (value->typeId != expected) throw CognitoFlowException("Snapshot value '" + std::string(key) + "' has a different type");
+        if constexpr (std::is_trivially_copyable_v<T>) {
+            if (value->bytes.size() == sizeof(T)) return detail::getRaw<T>(value->bytes.data());
+        }
+        return std::any_cast<T>(decode(*value));
+    }
+
+    // A std::string value without copying it
+    std::string_view getString(std::string_view key) const {
+        return typedBytes(key, TypeRegistry::instance().typeIdOf<std::string>());
+    }
+
+    // A std::vector<T> value (T arithmetic) read in place
+    template <typename T>
+    ArrayView<T> getArray(std::string_view key) const {
+        static_assert(std::is_arithmetic_v<T>, "getArray reads vectors of arithmetic types");
+        std::string_view bytes = typedBytes(key, TypeRegistry::instance().typeIdOf<std::vector<T>>());
+        if (reinterpret_cast<std::uintptr_t>(bytes.data()) % alignof(T) != 0) {
+            throw CognitoFlowException("Snapshot value '" + std::string(key) + "' is not aligned for in-place reads");
+        }
+        return ArrayView<T>{reinterpret_cast<const T*>(bytes.data()), bytes.size() / sizeof(T)};
+    }
+
+    // The entry as std::any through its registered codec
+    std::any decode(const Value& value) const {
+        if (value.typeId == 0) return std::any();
+        std::shared_ptr<const ValueCodec> codec = TypeRegistry::instance().find(value.typeId);
+        if (!codec) {
+            throw CognitoFlowException("Snapshot value '" + std::string(value.key) + "' has type id "
+                                       + std::to_string(value.typeId) + ", which is not registered in this process");
+        }
+        return codec->decode(value.bytes);
+    }
+
+    // Decodes every entry into context, replacing existing keys
+    void loadInto(Context& context) const {
+        context.reserve(context.size() + count);
+        for (std::size_t i = 0; i < count; ++i) {
+            Value value = at(i);
+            context.insert_or_assign(std::string(value.key), decode(value));
+        }
+    }
+
+    Params toParams() const {
+        Params::Map values;
+        for (std::size_t i = 0; i < count; ++i) {
+            Value value = at(i);
+            values.emplace(std::string(value.key), decode(value));
+        }
+        return Params(std::move(values));
+    }
+
+private:
+    std::uint64_t hashAt(std::size_t index) const {
+        return detail::ByteReader(std::string_view(base + HEADER_SIZE + index * ENTRY_SIZE, 8)).u64();
+    }
+
+    std::string_view typedBytes(std::string_view key, std::uint64_t typeId) const {
+        std::optional<Value> value = find(key);
+        if (!value) throw std::out_of_range("Snapshot has no value '" + std::string(key) + "'");
+        if (value->typeId != typeId) throw CognitoFlowException("Snapshot value '" + std::string(key) + "' has a different type");
+        return value->bytes;
+    }
+};
+
+namespace detail {
+    // Writes (key, std::any) pairs from entries as a snapshot appended to out
+    template <typename Entries>
+    void encodeSnapshotEntries(const Entries& entries, std::string& out) {
+        struct Pending {
+            std::uint64_t hash;
+            const std::string* key;
+            const std::any* value;
+        };
+        std::vector<Pending> pending;
+        for (const auto& entry : entries) pending.push_back({hashKey(entry.first), &entry.first, &entry.second});
+        std::sort(pending.begin(), pending.end(), [](const Pending& a, const Pending& b) {
+            return a.hash != b.hash ? a.hash < b.hash : *a.key < *b.key;
+        });
+
+        const TypeRegistry& registry = TypeRegistry::instance();
+        std::vector<std::shared_ptr<const ValueCodec>> codecs(pending.size());
+        std::string missing;
+        for (std::size_t i = 0; i < pending.size(); ++i) {
+            if (!pending[i].value->has_value()) continue;
+            codecs[i] = registry.find(std::type_index(pending[i].value->type()));
+            if (!codecs[i]) missing += (missing.empty() ? "'" : ", '") + *pending[i].key + "' (" + pending[i].value->type().name() + ")";
+        }
+        if (!missing.empty()) {
+            throw CognitoFlowException("Cannot serialize values without a registered codec: " + missing);
+        }
+
+        const std::size_t start = out.size();
+        out.append(SnapshotView::MAGIC, sizeof(SnapshotView::MAGIC));
+        putU32(out, static_cast<std::uint32_t>(pending.size()));
+        putU32(out, SnapshotView::FORMAT_VERSION);
+        putU64(out, 0); // Total size, patched below
+        const std::size_t table = out.size();
+        out.append(pending.size() * SnapshotView::ENTRY_SIZE, '\0');
+
+        std::string entry;
+        for (std::size_t i = 0; i < pending.size(); ++i) {
+            const std::uint64_t keyOffset = out.size() - start;
+            out += *pending[i].key;
+            out.append((8 - (out.size() - start) % 8) % 8, '\0');
+            const std::uint64_t valueOffset = out.size() - start;
+            if (codecs[i]) codecs[i]->encode(*pending[i].value, out);
+            const std::uint64_t valueLength = out.size() - start - valueOffset;
+            if (valueLength > UINT32_MAX) throw CognitoFlowException("Snapshot value '" + *pending[i].key + "' exceeds 4 GiB");
+
+            entry.clear();
+            putU64(entry, pending[i].hash);
+            putU64(entry, codecs[i] ? codecs[i]->typeId : 0);
+            putU64(entry, keyOffset);
+            putU64(entry, valueOffset);
+            putU32(entry, static_cast<std::uint32_t>(pending[i].key->size()));
+            putU32(entry, static_cast<std::uint32_t>(valueLength));
+            out.replace(table + i * SnapshotView::ENTRY_SIZE, SnapshotView::ENTRY_SIZE, entry);
+        }
+        std::string total;
+        putU64(total, out.size() - start);
+        out.replace(start + 16, 8, total);
+    }
+} // namespace detail
+
+// Appends a snapshot of context (or params) to out
+inline void encodeSnapshot(const Context& context, std::string& out) { detail::encodeSnapshotEntries(context, out); }
+inline void encodeSnapshot(const Params& params, std::string& out) { detail::encodeSnapshotEntries(params, out); }
+
+inline std::string encodeSnapshot(const Context& context) {
+    std::string out;
+    encodeSnapshot(context, out);
+    return out;
+}
+
+inline std::string encodeSnapshot(const Params& params) {
+    std::string out;
+    encodeSnapshot(params, out);
+    return out;
+}
+
+// Snapshot file opened for in-place reads: memory-mapped on POSIX systems, read into
+// memory elsewhere
+class MappedSnapshot {
+    const void* mapped = nullptr;
+    std::size_t mappedSize = 0;
+    std::string buffer; // Non-POSIX fallback
+    SnapshotView snapshot;
+
+public:
+    explicit MappedSnapshot(const std::string& path) {
+#if COGNITOFLOW_HAS_MMAP
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw CognitoFlowException("Cannot open snapshot '" + path + "'");
+        struct stat info;
+        if (::fstat(fd, &info) != 0 || info.st_size <= 0) {
+            ::close(fd);
+            throw CognitoFlowException("Cannot read snapshot '" + path + "'");
+        }
+        mappedSize = static_cast<std::size_t>(info.st_size);
+        void* address = ::mmap(nullptr, mappedSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (address == MAP_FAILED) throw CognitoFlowException("Cannot map snapshot '" + path + "'");
+        mapped = address;
+        try {
+            snapshot = SnapshotView(mapped, mappedSize);
+        } catch (...) {
+            ::munmap(const_cast<void*>(mapped), mappedSize);
+            throw;
+        }
+#else
+        std::FILE* in = std::fopen(path.c_str(), "rb");
+        if (!in) throw CognitoFlowException("Cannot open snapshot '" + path + "'");
+        char chunk[64 * 1024];
+        std::size_t read;
+        while ((read = std::fread(chunk, 1, sizeof(chunk), in)) > 0) buffer.append(chunk, read);
+        std::fclose(in);
+        snapshot = SnapshotView(buffer);
+#endif
+    }
+
+    MappedSnapshot(const MappedSnapshot&) = delete;
+    MappedSnapshot& operator=(const MappedSnapshot&) = delete;
+
+    ~MappedSnapshot() {
+#if COGNITOFLOW_HAS_MMAP
+        if (mapped) ::munmap(const_cast<void*>(mapped), mappedSize);
+#endif
+    }
+
+    const SnapshotView& view() const { return snapshot; }
+    const SnapshotView* operator->() const { return &snapshot; }
+};
+
+inline void writeSnapshot(const std::string& path, const Context& context) {
+    std::string bytes = encodeSnapshot(context);
+    std::FILE* out = std::fopen(path.c_str(), "wb");
+    if (!out) throw CognitoFlowException("Cannot create snapshot '" + path + "'");
+    bool written = std::fwrite(bytes.data(), 1, bytes.size(), out) == bytes.size();
+    written = std::fclose(out) == 0 && written;
+    if (!written) throw CognitoFlowException("Cannot write snapshot '" + path + "'");
+}
+
+
+// --- Checkpoints ---
+// Append-only binary log that lets an interrupted Flow or BatchFlow resume instead of
+// starting over (Flow::setCheckpoint). Every record is framed as
+//     u32 payload length | u32 checksum | u8 type | fields...
+// with little-endian integers and length-prefixed strings. A run writes RunStart
+// (graph fingerprint), then Step (node index, action, context) after each node or
+// Batch (index, context) after each parameter set; finishing the run truncates the
+// log, so a non-empty log always describes an unfinished run. Records are queued
+// and written by a background thread every flushInterval, so a step only pays for
+// encoding its record; after a crash the last interval may be lost and is recomputed.
+// A torn tail is dropped when the log is reopened. A run that throws leaves its state
+// in memory too, so running the flow again in the same process resumes it. One run at
+// a time per log.
+
+// Turns a Context into bytes and back, for checkpoint snapshots
+class ContextCodec {
+public:
+    virtual ~ContextCodec() = default;
+    virtual void encode(const Context& context, std::string& out) const = 0;
+    virtual void decode(std::string_view data, Context& into) const = 0; // into starts empty
+};
+
+// ContextCodec writing snapshots through the TypeRegistry codecs
+class SnapshotContextCodec : public ContextCodec {
+public:
+    void encode(const Context& context, std::string& out) const override { encodeSnapshot(context, out); }
+    void decode(std::string_view data, Context& into) const override { SnapshotView(data).loadInto(into); }
+};
+
+struct CheckpointOptions {
+    std::shared_ptr<const ContextCodec> contextCodec; // E.g. SnapshotContextCodec; required for Flow steps
+    std::chrono::milliseconds flushInterval{5};
+};
+
+// What an unfinished run left in the log
+struct CheckpointState {
+    bool active = false; // A run started and has not ended
+    std::uint64_t fingerprint = 0;
+    std::int32_t lastNode = -1; // Compiled index of the last finished node, -1 = none
+    std::optional<std::string> lastAction;
+    std::string context; // Context after lastNode, encoded
+    std::map<std::uint64_t, std::string> completedBatches; // Batch index -> encoded context ("" without codec)
+};
+
+namespace detail {
+    inline std::uint32_t recordChecksum(std::string_view payload) {
+        std::uint64_t hash = hashKey(payload);
+        return static_cast<std::uint32_t>(hash ^ (hash >> 32));
+    }
+} // namespace detail
+
+class CheckpointLog {
+    enum RecordType : std::uint8_t { RunStart = 1, Step = 2, Batch = 3 };
+
+    std::string filePath;
+    CheckpointOptions options;
+    std::FILE* file = nullptr;
+    CheckpointState recovered; // Parsed on open or left by a failed run, handed to the next beginRun
+    CheckpointState live;      // What the log holds for the run in progress
+
+    std::mutex mutex;
+    std::condition_variable wakeCv;
+    std::condition_variable writtenCv;
+    std::string queued;
+    std::size_t truncateAt = std::string::npos; // Queued bytes before this offset belong to finished runs
+    std::uint64_t queuedRecords = 0;
+    std::uint64_t writtenRecords = 0;
+    std::exception_ptr writeError;
+    bool stopping = false;
+    std::thread writer;
+
+public:
+    // Opens (or creates) the log at path and reads any unfinished run from it
+    explicit CheckpointLog(std::string path, CheckpointOptions checkpointOptions = {})
+        : filePath(std::move(path)), options(std::move(checkpointOptions)) {
+        std::size_t validBytes = recover();
+        file = std::fopen(filePath.c_str(), validBytes > 0 ? "r+b" : "wb");
+        if (!file) throw CognitoFlowException("Cannot open checkpoint log '" + filePath + "'");
+        if (validBytes > 0) {
+            // Drop a torn tail so new records follow the last complete one
+            std::fseek(file, 0, SEEK_END);
+            if (static_cast<std::size_t>(std::ftell(file)) != validBytes) {
+                std::fclose(file);
+                std::filesystem::resize_file(filePath, validBytes);
+                file = std::fopen(filePath.c_str(), "r+b");
+                if (!file) throw CognitoFlowException("Cannot reopen checkpoint log '" + filePath + "'");
+            }
+            std::fseek(file, 0, SEEK_END);
+        }
+        writer = std::thread([this] { writeLoop(); });
+    }
+
+    CheckpointLog(const CheckpointLog&) = delete;
+    CheckpointLog& operator=(const CheckpointLog&) = delete;
+
+    // Writes everything still queued
+    ~CheckpointLog() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeCv.notify_all();
+        writer.join();
+        if (file) std::fclose(file);
+    }
+
+    const std::string& path() const { return filePath; }
+    const CheckpointOptions& getOptions() const { return options; }
+    const ContextCodec* contextCodec() const { return options.contextCodec.get(); }
+
+    // True while the log holds a run that has not finished and no run has claimed it
+    bool hasUnfinishedRun() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return recovered.active;
+    }
+
+    // Blocks until every queued record is in the file (handed to the OS, not fsynced).
+    // Rethrows a write failure of the background thread.
+    void flush() {
+        std::unique_lock<std::mutex> lock(mutex);
+        std::uint64_t target = queuedRecords;
+        wakeCv.notify_all();
+        writtenCv.wait(lock, [&] { return writtenRecords >= target || writeError; });
+        if (writeError) std::rethrow_exception(writeError);
+    }
+
+    // --- Used by flows ---
+    // Hands a run that did not reach endRun() back as unfinished, so the next beginRun
+    // resumes it. Flows hold one per checkpointed run.
+    class RunScope {
+        CheckpointLog* log;
+
+    public:
+        explicit RunScope(CheckpointLog* checkpointLog) : log(checkpointLog) {}
+        ~RunScope() {
+            if (log) log->abandonRun();
+        }
+        RunScope(const RunScope&) = delete;
+        RunScope& operator=(const RunScope&) = delete;
+    };
+
+    // Starts a run of a graph with this fingerprint. Returns the unfinished run to resume
+    // when it has the same fingerprint; otherwise a fresh run begins.
+    CheckpointState beginRun(std::uint64_t fingerprint) {
+        CheckpointState resume;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            resume = std::move(recovered);
+            recovered = CheckpointState();
+        }
+        if (resume.active && resume.fingerprint == fingerprint) {
+            std::lock_guard<std::mutex> lock(mutex);
+            live = resume;
+            return resume;
+        }
+        if (resume.active) {
+            static LogSite site;
+            logWarn(site, [&] { return "Checkpoint log '" + filePath + "' holds a run of a different graph; starting over."; });
+        }
+        std::string payload;
+        payload.push_back(static_cast<char>(RunStart));
+        detail::putU64(payload, fingerprint);
+        append(payload);
+        std::lock_guard<std::mutex> lock(mutex);
+        live = CheckpointState();
+        live.active = true;
+        live.fingerprint = fingerprint;
+        return CheckpointState();
+    }
+
+    void recordStep(std::int32_t node, const std::optional<std::string>& action, std::string_view context) {
+        std::string payload;
+        payload.push_back(static_cast<char>(Step));
+        detail::putU32(payload, static_cast<std::uint32_t>(node));
+        payload.push_back(action ? 1 : 0);
+        detail::putBytes(payload, action ? std::string_view(*action) : std::string_view());
+        detail::putBytes(payload, context);
+        append(payload);
+        std::lock_guard<std::mutex> lock(mutex);
+        live.lastNode = node;
+        live.lastAction = action;
+        live.context.assign(context.data(), context.size());
+    }
+
+    void recordBatch(std::uint64_t index, std::string_view context) {
+        std::string payload;
+        payload.push_back(static_cast<char>(Batch));
+        detail::putU64(payload, index);
+        detail::putBytes(payload, context);
+        append(payload);
+        std::lock_guard<std::mutex> lock(mutex);
+        live.completedBatches[index].assign(context.data(), context.size());
+    }
+
+    // Marks the run finished; the log is truncated once the marker would be written
+    void endRun() {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++queuedRecords;
+        truncateAt = queued.size();
+        live = CheckpointState();
+    }
+
+    // Keeps the run in progress as the unfinished one; no-op once it has ended
+    void abandonRun() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!live.active) return;
+        recovered = std::move(live);
+        live = CheckpointState();
+    }
+
+private:
+    void append(const std::string& payload) {
+        std::lock_guard<std::mutex> lock(mutex);
+        detail::putU32(queued, static_cast<std::uint32_t>(payload.size()));
+        detail::putU32(queued, detail::recordChecksum(payload));
+        queued += payload;
+        ++queuedRecords;
+        if (queued.size() >= 64 * 1024) wakeCv.notify_one();
+    }
+
+    void writeLoop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            wakeCv.wait_for(lock, options.flushInterval, [&] { return stopping || queued.size() >= 64 * 1024; });
+            if (queued.empty() && truncateAt == std::string::npos) {
+                writtenRecords = queuedRecords;
+                writtenCv.notify_all();
+                if (stopping) return;
+                continue;
+            }
+            std::string batch;
+            batch.swap(queued);
+            std::size_t truncateBefore = truncateAt;
+            truncateAt = std::string::npos;
+            std::uint64_t target = queuedRecords;
+            lock.unlock();
+
+            std::exception_ptr error;
+            try {
+                std::string_view pendingBytes(batch);
+                if (truncateBefore != std::string::npos) {
+                    // A run ended: nothing before the marker needs to survive
+                    std::fclose(file);
+                    file = std::fopen(filePath.c_str(), "wb");
+                    if (!file) throw CognitoFlowException("Cannot truncate checkpoint log '" + filePath + "'");
+                    pendingBytes.remove_prefix(truncateBefore);
+                }
+                if (!pendingBytes.empty() && std::fwrite(pendingBytes.data(), 1, pendingBytes.size(), file) != pendingBytes.size()) {
+                    throw CognitoFlowException("Write to checkpoint log '" + filePath + "' failed");
+                }
+                std::fflush(file);
+            } catch (...) {
+                error = std::current_exception();
+            }
+
+            lock.lock();
+            if (error && !writeError) writeError = error;
+            writtenRecords = target;
+            writtenCv.notify_all();
+        }
+    }
+
+    // Parses the existing file into `recovered`; returns the length of its valid prefix
+    std::size_t recover() {
+        std::FILE* in = std::fopen(filePath.c_str(), "rb");
+        if (!in) return 0;
+        std::string contents;
+        char buffer[64 * 1024];
+        std::size_t read;
+        while ((read = std::fread(buffer, 1, sizeof(buffer), in)) > 0) contents.append(buffer, read);
+        std::fclose(in);
+
+        std::size_t offset = 0;
+        while (contents.size() - offset >= 8) {
+            detail::ByteReader header(std::string_view(contents).substr(offset, 8));
+            std::uint32_t length = header.u32();
+            std::uint32_t checksum = header.u32();
+            if (contents.size() - offset - 8 < length) break;
+            std::string_view payload = std::string_view(contents).substr(offset + 8, length);
+            if (detail::recordChecksum(payload) != checksum || !applyRecord(payload)) break;
+            offset += 8 + length;
+        }
+        return offset;
+    }
+
+    bool applyRecord(std::string_view payload) {
+        detail::ByteReader record(payload);
+        switch (record.u8()) {
+            case RunStart:
+                recovered = CheckpointState();
+                recovered.active = true;
+                recovered.fingerprint = record.u64();
+                break;
+            case Step: {
+                std::int32_t node = static_cast<std::int32_t>(record.u32());
+                bool hasAction = record.u8() != 0;
+                std::string_view action = record.bytes();
+                std::string_view context = record.bytes();
+                if (!record.ok()) return false;
+                recovered.lastNode = node;
+                recovered.lastAction = hasAction ? std::optional<std::string>(std::string(action)) : std::nullopt;
+                recovered.context.assign(context.data(), context.size());
+                break;
+            }
+            case Batch: {
+                std::uint64_t index = record.u64();
+                std::string_view context = record.bytes();
+                if (!record.ok()) return false;
+                recovered.completedBatches[index].assign(context.data(), context.size());
+                break;
+            }
+            default:
+                return false;
+        }
+        return record.ok() && record.atEnd();
+    }
+};
+
+
+// --- Compiled Flow Graph ---
+// Frozen form of a flow graph produced by Flow::compile(). Nodes are numbered
+// densely from the start node, every distinct action gets a small integer id, and
+// each node carries a successor table indexed by action id plus a short list of its
+// own action edges. A step is then a raw-pointer call and an index jump: no map
+// search and no shared_ptr copies. The graph keeps the nodes alive.
+// Nested flows that allow it (IBaseNode::inlineSubflow) are spliced in: the flow
+// keeps an index but is never run; entering it jumps to its start node, and an action
+// its nodes have no successor for is routed by the flow's own successors, which is
+// where the nested run would have returned it.
+class CompiledGraph {
+public:
+    static constexpr std::int32_t NO_NODE = -1;
+    static constexpr std::int32_t DEFAULT_ACTION = 0; // Action id of the default ("") action
+
+    struct ActionEdge {
+        std::string action;
+        std::int32_t actionId;
+        std::int32_t next;
+    };
+
+    struct CompiledNode {
+        IBaseNode* node = nullptr;
+        std::int32_t defaultNext = NO_NODE;
+        std::vector<ActionEdge> edges;              // Named actions only; usually one or two
+        std::vector<std::int32_t> nextByToken;      // Dense, indexed by Action::id()
+        std::int32_t parent = NO_NODE;  // Inlined flow this node runs in; routes the actions it has no successor for
+        std::int32_t entry = NO_NODE;   // For an inlined flow: index of its start node
+        std::string keyNamespace;       // Context namespace of the enclosing inlined flows
+    };
+
+private:
+    std::vector<std::shared_ptr<IBaseNode>> owners;
+    std::vector<CompiledNode> nodes;
+    std::vector<std::string> actionNames{""};
+    std::shared_ptr<std::atomic<bool>> stale = std::make_shared<std::atomic<bool>>(false); // Raised by the owners' watchers
+    std::uint64_t shape = 0;
+    bool namespaced = false; // Some inlined flow has a context namespace
+
+public:
+    // Walks every node reachable from `start` and validates declared actions
+    explicit CompiledGraph(const std::shared_ptr<IBaseNode>& start) {
+        if (!start) throw std::invalid_argument("Cannot compile a flow without a start node");
+
+        // A node inside an inlined flow is a different step than the same node elsewhere
+        std::map<std::pair<const IBaseNode*, std::int32_t>, std::int32_t> indexOf;
+        std::map<std::string, std::int32_t, std::less<>> actionIds{{"", DEFAULT_ACTION}};
+        std::vector<std::int32_t> parents;
+        std::vector<std::string> namespaces;
+        auto indexFor = [&](const std::shared_ptr<IBaseNode>& node, std::int32_t parent, const std::string& keyNamespace) {
+            auto inserted = indexOf.emplace(std::make_pair(node.get(), parent), static_cast<std::int32_t>(owners.size()));
+            if (inserted.second) {
+                node->watchWiring(stale); // Before its successors are read, so no change is missed
+                owners.push_back(node);
+                parents.push_back(parent);
+                namespaces.push_back(keyNamespace);
+            }
+            return inserted.first->second;
+        };
+        indexFor(start, NO_NODE, std::string());
+
+        std::string errors;
+        std::vector<std::int32_t> entries;
+        for (std::size_t i = 0; i < owners.size(); ++i) {
+            std::int32_t entry = NO_NODE;
+            if (std::optional<InlineSubflow> subflow = owners[i]->inlineSubflow()) {
+                bool recursive = false;
+                for (std::int32_t p = parents[i]; p != NO_NODE; p = parents[static_cast<std::size_t>(p)]) {
+                    recursive = recursive || owners[static_cast<std::size_t>(p)] == owners[i];
+                }
+                if (subflow->start && !recursive) {
+                    std::string innerNamespace = namespaces[i] + subflow->keyNamespace;
+                    namespaced = namespaced || !innerNamespace.empty();
+                    entry = indexFor(subflow->start, static_cast<std::int32_t>(i), innerNamespace);
+                }
+            }
+            entries.push_back(entry);
+            for (const auto& successor : owners[i]->getSuccessors()) {
+                if (!successor.second) {
+                    errors += "null successor for action '" + successor.first + "' in node " + owners[i]->getClassName() + "; ";
+                    continue;
+                }
+                indexFor(successor.second, parents[i], namespaces[i]);
+                if (actionIds.emplace(successor.first, static_cast<std::int32_t>(actionNames.size())).second) {
+                    actionNames.push_back(successor.first);
+                }
+            }
+            std::vector<std::string> declared = owners[i]->declaredActions();
+            if (!declared.empty()) {
+                for (const auto& successor : owners[i]->getSuccessors()) {
+                    if (!successor.first.empty() && std::find(declared.begin(), declared.end(), successor.first) == declared.end()) {
+                        errors += "node " + owners[i]->getClassName() + " has a successor for action '" + successor.first
+                                + "' but never returns it; ";
+                    }
+                }
+            }
+        }
+        if (!errors.empty()) {
+            throw CognitoFlowException("Flow compilation failed: " + errors);
+        }
+
+        nodes.resize(owners.size());
+        for (std::size_t i = 0; i < owners.size(); ++i) {
+            CompiledNode& compiled = nodes[i];
+            compiled.node = owners[i].get();
+            compiled.parent = parents[i];
+            compiled.entry = entries[i];
+            compiled.keyNamespace = namespaces[i];
+            for (const auto& successor : owners[i]->getSuccessors()) {
+                std::int32_t target = indexOf.at(std::make_pair(successor.second.get(), parents[i]));
+                std::int32_t actionId = actionIds.find(successor.first)->second;
+                std::size_t token = Action(successor.first).id();
+                if (token >= compiled.nextByToken.size()) compiled.nextByToken.resize(token + 1, NO_NODE);
+                compiled.nextByToken[token] = target;
+                if (successor.first.empty()) {
+                    compiled.defaultNext = target;
+                } else {
+                    compiled.edges.push_back(ActionEdge{successor.first, actionId, target});
+                }
+            }
+        }
+
+        shape = detail::hashKey("graph");
+        for (const CompiledNode& compiled : nodes) {
+            shape = detail::combineHash(shape, detail::hashKey(compiled.node->getClassName()));
+            shape = detail::combineHash(shape, static_cast<std::uint64_t>(compiled.defaultNext + 1));
+            for (const ActionEdge& edge : compiled.edges) {
+                shape = detail::combineHash(shape, detail::hashKey(edge.action));
+                shape = detail::combineHash(shape, static_cast<std::uint64_t>(edge.next + 1));
+            }
+            if (compiled.parent != NO_NODE || compiled.entry != NO_NODE) {
+                shape = detail::combineHash(shape, static_cast<std::uint64_t>(compiled.parent + 1));
+                shape = detail::combineHash(shape, static_cast<std::uint64_t>(compiled.entry + 1));
+                shape = detail::combineHash(shape, detail::hashKey(compiled.keyNamespace));
+            }
+        }
+    }
+
+    // Hash of the node types, their numbering and the wiring; equal for the same graph
+    // built by the same binary, so checkpointed node indices can be trusted across runs
+    std::uint64_t fingerprint() const { return shape; }
+
+    using StepCallback = std::function<void(std::int32_t nodeIndex, const std::optional<std::string>& action)>;
+
+    // False once the successors of one of this graph's nodes (or the inlining settings
+    // of one of its flows) changed after compilation
+    bool isCurrent() const {
+        return !stale->load(std::memory_order_acquire);
+    }
+
+    std::size_t nodeCount() const { return nodes.size(); }
+    std::size_t actionCount() const { return actionNames.size(); }
+    const std::string& actionName(std::int32_t actionId) const { return actionNames.at(static_cast<std::size_t>(actionId)); }
+    const CompiledNode& node(std::int32_t index) const { return nodes[static_cast<std::size_t>(index)]; }
+
+    bool isNamespaced() const { return namespaced; }
+
+    // Whether both graphs number the same node objects the same way and wire them alike
+    bool sameSteps(const CompiledGraph& other) const {
+        if (shape != other.shape || nodes.size() != other.nodes.size()) return false;
+        for (std::size_t i = 0; i < nodes.size(); ++i) {
+            if (nodes[i].node != other.nodes[i].node) return false;
+        }
+        return true;
+    }
+
+    // Successor of `current` for `action`, looked up through the enclosing inlined flows
+    std::int32_t nextIndex(std::int32_t current, const std::optional<std::string>& action) const {
+        for (std::int32_t at = current; at != NO_NODE; at = nodes[static_cast<std::size_t>(at)].parent) {
+            const CompiledNode& compiled = nodes[static_cast<std::size_t>(at)];
+            if (!action) {
+                if (compiled.defaultNext != NO_NODE) return compiled.defaultNext;
+                continue;
+            }
+            for (const ActionEdge& edge : compiled.edges) {
+                if (edge.action == *action) return edge.next;
+            }
+        }
+        return NO_NODE;
+    }
+
+    std::int32_t nextIndex(std::int32_t current, Action action) const {
+        for (std::int32_t at = current; at != NO_NODE; at = nodes[static_cast<std::size_t>(at)].parent) {
+            const CompiledNode& compiled = nodes[static_cast<std::size_t>(at)];
+            std::int32_t next = action.isDefault() ? compiled.defaultNext
+                              : action.id() < compiled.nextByToken.size() ? compiled.nextByToken[action.id()] : NO_NODE;
+            if (next != NO_NODE) return next;
+        }
+        return NO_NODE;
+    }
+
+    // The node that actually runs when control reaches `index`: inlined flows are
+    // entered instead of run
+    std::int32_t enter(std::int32_t index) const {
+        while (index != NO_NODE && nodes[static_cast<std::size_t>(index)].entry != NO_NODE) {
+            index = nodes[static_cast<std::size_t>(index)].entry;
+        }
+        return index;
+    }
+
+    // Switches the context to each step's namespace, relative to the one the run
+    // started in, and restores that one when the run ends
+    class StepNamespace {
+        Context& context;
+        bool active;
+        std::string base;
+        const std::string* applied = nullptr; // nullptr = base
+    public:
+        StepNamespace(Context& sharedContext, const CompiledGraph& graph)
+            : context(sharedContext), active(graph.isNamespaced()) {
+            if (active) base = context.keyNamespace();
+        }
+        ~StepNamespace() {
+            if (applied) context.setKeyNamespace(base);
+        }
+        StepNamespace(const StepNamespace&) = delete;
+        StepNamespace& operator=(const StepNamespace&) = delete;
+
+        void enter(const CompiledNode& step) {
+            if (!active) return;
+            if (applied ? *applied == step.keyNamespace : step.keyNamespace.empty()) return;
+            context.setKeyNamespace(base + step.keyNamespace);
+            applied = &step.keyNamespace;
+        }
+    };
+
+    // Runs the graph from node `startIndex`. With a frame the shared nodes read their
+    // params from it; otherwise each node receives `runParams` via setParamsInternal.
+    // onStep, if given, is called after every node with its index and action.
+    std::optional<std::string> run(Context& sharedContext, const Params& runParams, RunFrame* frame,
+                                   std::int32_t startIndex = 0, const StepCallback* onStep = nullptr) const {
+        std::optional<std::string> lastAction;
+        Action lastToken = Action::unset();
+        StepNamespace keyNamespace(sharedContext, *this);
+        std::int32_t current = enter(startIndex);
+        while (current != NO_NODE) {
+            const CompiledNode& step = nodes[static_cast<std::size_t>(current)];
+            IBaseNode* node = step.node;
+            keyNamespace.enter(step);
+            detail::checkDeadline(node);
+            if (!frame) node->setParamsInternal(runParams);
+            lastToken = detail::runForToken(node, lastAction, [&] {
+                return frame ? node->internalRun(sharedContext, *frame) : node->internalRun(sharedContext);
+            });
+            std::int32_t next;
+            if (lastToken.isUnset()) {
+                next = nextIndex(current, lastAction);
+            } else {
+                next = nextIndex(current, lastToken);
+                if (onStep || next == NO_NODE) lastAction = lastToken.toOptional(); // Strings only where they are seen
+            }
+            if (onStep) (*onStep)(current, lastAction);
+            if (next == NO_NODE && node->hasSuccessors()) {
+                node->getNextNode(lastAction); // Exit path only: emits the usual "flow might end" warning
+            }
+            current = enter(next);
+        }
+        return lastAction;
+    }
+};
+
+
+// --- Incremental Runs ---
+// Bookkeeping for Flow::setIncremental. Each step of a run records the context keys
+// and params its node read (with the entry's version and, for hashable values, a
+// hash), the keys it wrote (with the value and version left behind) and its action.
+// When a later run reaches the same node at the same step and every recorded input
+// still matches, by version or else by hash, the writes and the action are replayed
+// instead of running the node. A replayed write restores the recorded version, so the
+// nodes after it see their inputs unchanged too.
+struct IncrementalStats {
+    std::uint64_t executed = 0; // Steps that ran their node
+    std::uint64_t replayed = 0; // Steps answered from their record
+};
+
+namespace detail {
+    // What one step of a recorded run read and wrote
+    struct StepRecord {
+        struct ContextInput {
+            std::string key;
+            bool present;
+            std::uint64_t version;
+            std::optional<std::uint64_t> hash;
+        };
+        struct ParamInput {
+            std::string key;
+            bool present;
+            std::optional<std::uint64_t> hash;
+            const std::any* value; // Compared by identity if unhashable; kept alive by `params`
+        };
+        struct ContextWrite {
+            std::string key;
+            bool present; // False if the step erased the key
+            std::any value;
+            std::uint64_t version;
+        };
+
+        std::int32_t node = CompiledGraph::NO_NODE;
+        bool replayable = true;
+        std::vector<ContextInput> inputs;
+        std::vector<ParamInput> paramInputs;
+        std::vector<ContextWrite> writes;
+        Params params; // The node's params when it ran
+        std::optional<std::string> action;
+    };
+
+    // Collects one node's accesses to `target` while it is installed
+    class StepRecorder final : public AccessTap {
+        const Context& target;
+        AccessTap* parent;
+        StepRecord& record;
+        std::map<std::string, bool, std::less<>> seenKeys; // true = written
+        std::map<std::string, bool, std::less<>> seenParams;
+
+    public:
+        StepRecorder(const Context& context, StepRecord& stepRecord)
+            : target(context), parent(accessTap()), record(stepRecord) {
+            accessTap() = this;
+        }
+        ~StepRecorder() override { accessTap() = parent; }
+        StepRecorder(const StepRecorder&) = delete;
+        StepRecorder& operator=(const StepRecorder&) = delete;
+
+        void contextRead(const Context& context, std::string_view key, const std::any* value, std::uint64_t version) override {
+            if (parent) parent->contextRead(context, key, value, version);
+            if (&context != &target || seenKeys.count(key)) return;
+            seenKeys.emplace(std::string(key), false);
+            record.inputs.push_back({std::string(key), value != nullptr, version, value ? hashParamValue(*value) : std::nullopt});
+        }
+
+        void contextWrite(const Context& context, std::string_view key) override {
+            if (parent) parent->contextWrite(context, key);
+            if (&context != &target) return;
+            auto seen = seenKeys.find(key);
+            if (seen == seenKeys.end()) {
+                seenKeys.emplace(std::string(key), true);
+            } else {
+                seen->second = true;
+            }
+        }
+
+        void contextWhole(const Context& context) override {
+            if (parent) parent->contextWhole(context);
+            if (&context == &target) record.replayable = false;
+        }
+
+        void paramRead(std::string_view key, const std::any* value) override {
+            if (parent) parent->paramRead(key, value);
+            if (seenParams.count(key)) return;
+            seenParams.emplace(std::string(key), true);
+            record.paramInputs.push_back({std::string(key), value != nullptr, value ? hashParamValue(*value) : std::nullopt, value});
+        }
+
+        void paramsWhole() override {
+            if (parent) parent->paramsWhole();
+            record.replayable = false;
+        }
+
+        const std::map<std::string, bool, std::less<>>& keys() const { return seenKeys; }
+    };
+
+    // Per-flow step records; runs of one incremental flow are serialized on `mutex`
+    class IncrementalState {
+    public:
+        std::mutex mutex;
+        std::shared_ptr<const CompiledGraph> graph; // Records are only valid for this graph
+        std::vector<StepRecord> steps;
+        IncrementalStats stats;
+
+        // Whether `record`'s inputs still hold. Keys are full names, so the context's
+        // namespace is bypassed; an enclosing recorder still learns them as inputs.
+        static bool matches(const StepRecord& record, const Context& context, const Params& params) {
+            if (!record.replayable) return false;
+            AccessTap* tap = accessTap();
+            for (const StepRecord::ContextInput& input : record.inputs) {
+                std::size_t index = context.lookup(input.key, hashKey(input.key));
+                bool present = index != Context::npos();
+                if (tap) tap->contextRead(context, input.key, present ? &context.entries[index].second : nullptr, present ? context.versions[index] : 0);
+                if (present != input.present) return false;
+                if (!present || context.versions[index] == input.version) continue;
+                if (!input.hash || hashParamValue(context.entries[index].second) != input.hash) return false;
+            }
+            for (const StepRecord::ParamInput& input : record.paramInputs) {
+                const std::any* current = params.lookup(input.key);
+                if ((current != nullptr) != input.present) return false;
+                if (!input.present) continue;
+                if (input.hash) {
+                    if (hashParamValue(*current) != input.hash) return false;
+                } else if (current != input.value || record.params.findValue(input.key) != input.value) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // Applies the recorded writes and returns the recorded action
+        static std::optional<std::string> replay(const StepRecord& record, Context& context) {
+            for (const StepRecord::ContextWrite& write : record.writes) {
+                std::uint64_t hash = hashKey(write.key);
+                if (AccessTap* tap = accessTap()) tap->contextWrite(context, write.key);
+                if (!write.present) {
+                    std::size_t index = context.lookup(write.key, hash);
+                    if (index != Context::npos()) context.eraseAt(index, hash);
+                    continue;
+                }
+                std::size_t index = context.findOrInsert(write.key, hash);
+                context.entries[index].second = write.value;
+                context.versions[index] = write.version;
+            }
+            return record.action;
+        }
+
+        // Captures the values the recorded node left behind for the keys it wrote
+        static void captureWrites(StepRecord& record, const StepRecorder& recorder, const Context& context) {
+            for (const auto& key : recorder.keys()) {
+                if (!key.second) continue;
+                std::size_t index = context.lookup(key.first, hashKey(key.first));
+                if (index == Context::npos()) {
+                    record.writes.push_back({key.first, false, std::any{}, 0});
+                } else {
+                    record.writes.push_back({key.first, true, context.entries[index].second, context.versions[index]});
+                }
+            }
+        }
+    };
+} // namespace detail
+
+
+// --- Flow Orchestrator ---
+// Inherits from BaseNode with dummy types for consistency, but overrides run logic.
+// Using std::nullptr_t for unused P type.
+// How a flow hands per-run state to its nodes
+enum class ExecutionMode {
+    Stateful,  // setParamsInternal on each node, members hold run state (original behavior)
+    Stateless  // run state lives in a RunFrame; nodes are never written, runs may overlap
+};
+
+class Flow : public BaseNode<std::nullptr_t, std::optional<std::string>> {
+protected:
+    std::shared_ptr<IBaseNode> startNode = nullptr;
+    ExecutionMode executionMode = ExecutionMode::Stateful;
+    std::shared_ptr<Executor> executor; // Used by parallel nodes inside this flow's runs
+    std::shared_ptr<const CompiledGraph> compiledGraph; // Set by compile(); read with std::atomic_load
+    std::mutex compileMutex;
+    std::size_t runArenaBytes = 0; // 0 = no per-run arena
+    std::chrono::milliseconds runTimeout{0}; // 0 = no deadline of its own
+    std::shared_ptr<CheckpointLog> checkpoint;
+    std::shared_ptr<detail::IncrementalState> incremental; // Set by setIncremental(true)
+    std::string contextNamespace; // Prefix for the keys this flow's nodes use; "" = the caller's
+    bool inlinable = true;
+
+public:
+    Flow() = default;
+    explicit Flow(std::shared_ptr<IBaseNode> start) { this->start(std::move(start)); }
+    virtual ~Flow() override = default;
 
     template <typename SN_P, typename SN_E>
     std::shared_ptr<BaseNode<SN_P, SN_E>> start(std::shared_ptr<BaseNode<SN_P, SN_E>> node) {
         if (!node) {
             throw std::invalid_argument("Start node cannot be null");
         }
-        startNode = node; // Implicit cast to shared_ptr<IBaseNode>
+        startNode = node; // Implicit cast to shared_ptr<IBaseNode>
+        std::atomic_store(&compiledGraph, std::shared_ptr<const CompiledGraph>());
+        inliningChanged();
+        return node;
+    }
+     // Overload for IBaseNode pointer directly
+     std::shared_ptr<IBaseNode> start(std::shared_ptr<IBaseNode> node) {
+         if (!node) {
+             throw std::invalid_argument("Start node cannot be null");
+         }
+         startNode = node;
+         std::atomic_store(&compiledGraph, std::shared_ptr<const CompiledGraph>());
+         inliningChanged();
+         return node;
+     }
+
+    // Freezes the graph reachable from the start node into a CompiledGraph that later
+    // runs use instead of per-step successor map lookups. Throws CognitoFlowException
+    // if a node has a null successor or a successor on an action it does not declare.
+    // Rewiring any node afterwards makes the next run recompile.
+    Flow& compile() {
+        if (!startNode) throw std::invalid_argument("Cannot compile a flow without a start node");
+        std::lock_guard<std::mutex> lock(compileMutex);
+        std::atomic_store(&compiledGraph, std::shared_ptr<const CompiledGraph>(std::make_shared<CompiledGraph>(startNode)));
+        return *this;
+    }
+
+    bool isCompiled() const { return std::atomic_load(&compiledGraph) != nullptr; }
+
+    // In Stateless mode a (preferably compiled) flow may be run from several threads
+    // at once, provided its nodes keep per-run data in the frame or the context.
+    // Flows nested in a stateless run are always run statelessly.
+    Flow& setExecutionMode(ExecutionMode mode) {
+        executionMode = mode;
+        inliningChanged();
+        return *this;
+    }
+
+    ExecutionMode getExecutionMode() const { return executionMode; }
+
+    // Parallel nodes (and nested flows) without their own executor run on this one
+    // during this flow's runs; otherwise they use the enclosing one or the default.
+    Flow& setExecutor(std::shared_ptr<Executor> newExecutor) {
+        executor = std::move(newExecutor);
+        inliningChanged();
+        return *this;
+    }
+
+    const std::shared_ptr<Executor>& getExecutor() const { return executor; }
+
+    // Gives each run a RunArena of at least initialBytes (0 disables it). Frame scratch
+    // stores and framework temporaries then come from the arena, as do allocations nodes
+    // make through currentFrame()->arena() or RunArena::currentResource(); all of it is
+    // released when the run returns. Nested flows share the outermost run's arena.
+    Flow& setRunArena(std::size_t initialBytes = RunArena::DEFAULT_BLOCK) {
+        if (initialBytes > 0) requireRunRecords("setRunArena");
+        runArenaBytes = initialBytes;
+        inliningChanged();
+        return *this;
+    }
+
+    std::size_t getRunArenaBytes() const { return runArenaBytes; }
+
+    // Gives each orchestration (one per parameter set in BatchFlows) a deadline of
+    // `timeout` from its start; 0 disables it. An enclosing deadline that ends earlier
+    // still applies. Nodes not yet started when it passes throw DeadlineExceededException.
+    Flow& setRunTimeout(std::chrono::milliseconds timeout) {
+        if (timeout.count() < 0) throw std::invalid_argument("runTimeout cannot be negative");
+        runTimeout = timeout;
+        inliningChanged();
+        return *this;
+    }
+
+    std::chrono::milliseconds getRunTimeout() const { return runTimeout; }
+
+    // Records progress in `log` so a run that fails or is killed can be resumed by
+    // running the flow again with the same log. A Flow records the compiled index of
+    // each finished node with the encoded context (so the log needs a ContextCodec) and
+    // resumes after the last one; BatchFlows record finished parameter sets instead.
+    // Setting a log compiles the flow. nullptr turns checkpointing off.
+    Flow& setCheckpoint(std::shared_ptr<CheckpointLog> log) {
+        if (log) requireRunRecords("setCheckpoint");
+        if (log && checkpointsSteps() && !log->contextCodec()) {
+            throw std::invalid_argument("Flow checkpoints need a CheckpointLog with a ContextCodec");
+        }
+        inliningChanged();
+        if (log && !isCompiled()) compile();
+        checkpoint = std::move(log);
+        return *this;
+    }
+
+    const std::shared_ptr<CheckpointLog>& getCheckpoint() const { return checkpoint; }
+
+    // Re-runs skip the nodes whose inputs did not change since the previous run: each
+    // step records the context keys and params its node read and the keys it wrote,
+    // and a step whose inputs still match replays its writes and action instead of
+    // running. Only for nodes whose result depends on nothing but what they read from
+    // the context and params on the calling thread: work done on other threads, side
+    // effects and node member state are not tracked. Read with at(), find(), count()
+    // or the typed getters; operator[] counts as a write. Nodes that copy, iterate or
+    // clear the whole context always run. Runs of an incremental flow are serialized;
+    // a checkpoint log takes precedence. Enabling it compiles the flow.
+    Flow& setIncremental(bool enabled = true) {
+        if (enabled) requireRunRecords("setIncremental");
+        inliningChanged();
+        if (!enabled) {
+            incremental.reset();
+            return *this;
+        }
+        if (!isCompiled()) compile();
+        if (!incremental) incremental = std::make_shared<detail::IncrementalState>();
+        return *this;
+    }
+
+    bool isIncremental() const { return incremental != nullptr; }
+
+    // Forgets the recorded steps; the next run executes every node
+    void resetIncremental() {
+        if (!incremental) return;
+        std::lock_guard<std::mutex> lock(incremental->mutex);
+        incremental->steps.clear();
+    }
+
+    IncrementalStats getIncrementalStats() const {
+        if (!incremental) return {};
+        std::lock_guard<std::mutex> lock(incremental->mutex);
+        return incremental->stats;
+    }
+
+    // Runs this flow's nodes with every context key prefixed by `keyNamespace`
+    // ("search/" makes "query" refer to "search/query"), nested inside the caller's
+    // namespace. The context is not copied; see Context::setKeyNamespace.
+    Flow& setContextNamespace(std::string keyNamespace) {
+        contextNamespace = std::move(keyNamespace);
+        inliningChanged();
+        return *this;
+    }
+
+    const std::string& getContextNamespace() const { return contextNamespace; }
+
+    // A compiled parent splices a nested plain Flow into its own graph instead of
+    // running it as a node: no per-level prep/orchestrate/post, params layering or
+    // frame, and the nested nodes are numbered in the parent's graph. Flows with their
+    // own executor, arena, timeout, checkpoint, incremental records or Stateless mode,
+    // and subclasses, always run as nodes. Inlined flows get no trace span of their own.
+    Flow& setInlinable(bool enabled) {
+        inlinable = enabled;
+        inliningChanged();
+        return *this;
+    }
+
+    bool isInlinable() const { return inlinable; }
+
+    std::optional<InlineSubflow> inlineSubflow() const override {
+        if (!inlinable || typeid(*this) != typeid(Flow) || !startNode) return std::nullopt;
+        if (executor || runArenaBytes > 0 || runTimeout.count() > 0 || checkpoint || incremental
+            || executionMode != ExecutionMode::Stateful) {
+            return std::nullopt;
+        }
+        return InlineSubflow{startNode, contextNamespace};
+    }
+
+    std::shared_ptr<const CompiledGraph> getCompiledGraph() const { return std::atomic_load(&compiledGraph); }
+
+    // Prevent direct calls to Flow's exec - logic is in orchestrate/internalRun
+    std::optional<std::string> exec(std::nullptr_t /*prepResult*/) final override {
+        throw std::logic_error("Flow::exec() is internal and should not be called directly. Use run().");
+    }
+
+protected:
+    // The core orchestration logic
+    virtual std::optional<std::string> orchestrate(Context& sharedContext, const Params& initialParams) {
+        if (!startNode) {
+            static LogSite site;
+            logWarn(site, [] { return std::string("Flow started with no start node."); });
+            return std::nullopt;
+        }
+
+        std::shared_ptr<IBaseNode> currentNode = startNode;
+        std::optional<std::string> lastAction = std::nullopt;
+
+        detail::ScopedExecutor executorScope(executor.get());
+        std::optional<DeadlineScope> deadline;
+        if (runTimeout.count() > 0) deadline.emplace(runTimeout);
+        std::optional<ContextNamespace> keyScope;
+        if (!contextNamespace.empty()) keyScope.emplace(sharedContext, contextNamespace);
+
+        // Declared before the frame so the frame's scratch store goes first
+        std::optional<RunArena> arena;
+        if (runArenaBytes > 0 && !detail::currentArena()) arena.emplace(runArenaBytes);
+        detail::ScopedArena arenaScope(arena ? &*arena : detail::currentArena());
+
+        // Stack initial params on the flow's own params once for the whole run;
+        // each node then shares the same layers instead of receiving a map copy
+        const Params currentRunParams = Params::layered(getParams(), initialParams);
+
+        // Stateless runs (or any run nested in one) get a frame and leave the nodes untouched
+        std::optional<RunFrame> frame;
+        RunFrame* parentFrame = detail::currentFrame();
+        if (executionMode == ExecutionMode::Stateless || parentFrame) {
+            frame.emplace(currentRunParams, parentFrame);
+        }
+
+        if (checkpoint && checkpointsSteps()) {
+            return orchestrateWithCheckpoints(sharedContext, currentRunParams, frame ? &*frame : nullptr);
+        }
+
+        if (incremental) {
+            return orchestrateIncremental(sharedContext, currentRunParams, frame ? &*frame : nullptr);
+        }
+
+        if (std::shared_ptr<const CompiledGraph> graph = currentCompiledGraph()) {
+            return graph->run(sharedContext, currentRunParams, frame ? &*frame : nullptr);
+        }
+
+        if (frame) {
+            while (currentNode != nullptr) {
+                detail::checkDeadline(currentNode.get());
+                lastAction = currentNode->internalRun(sharedContext, *frame);
+                currentNode = currentNode->getNextNode(lastAction);
+            }
+            return lastAction;
+        }
+
+        while (currentNode != nullptr) {
+            detail::checkDeadline(currentNode.get());
+            currentNode->setParamsInternal(currentRunParams); // Set params for the current node
+            lastAction = currentNode->internalRun(sharedContext); // Execute the node
+            currentNode = currentNode->getNextNode(lastAction);   // Find the next node based on action
+        }
+
+        return lastAction; // Return the action that led to termination (or nullopt if last node had no action)
+    }
+
+    // Whether orchestrate records each node step; BatchFlows record whole runs instead
+    virtual bool checkpointsSteps() const { return true; }
+
+    // Whether runs honor setCheckpoint, setIncremental and setRunArena; on flows that
+    // would ignore them the setters throw instead
+    virtual bool supportsRunRecords() const { return true; }
+
+    void requireRunRecords(const char* setting) const {
+        if (!supportsRunRecords()) {
+            throw std::logic_error(std::string(setting) + " is not supported by this flow type; use a Flow");
+        }
+    }
+
+    // Compiled run that resumes after the log's last recorded step and records each new one
+    std::optional<std::string> orchestrateWithCheckpoints(Context& sharedContext, const Params& runParams, RunFrame* frame) {
+        std::shared_ptr<const CompiledGraph> graph = currentCompiledGraph();
+        if (!graph) {
+            compile();
+            graph = getCompiledGraph();
+        }
+        const ContextCodec& codec = *checkpoint->contextCodec();
+        CheckpointState resume = checkpoint->beginRun(graph->fingerprint());
+        CheckpointLog::RunScope runScope(checkpoint.get());
+        std::int32_t startIndex = 0;
+        if (resume.lastNode != CompiledGraph::NO_NODE) {
+            Context restored;
+            codec.decode(resume.context, restored);
+            sharedContext = std::move(restored);
+            startIndex = graph->nextIndex(resume.lastNode, resume.lastAction);
+            if (startIndex == CompiledGraph::NO_NODE) { // Only the end of the run was lost
+                checkpoint->endRun();
+                return resume.lastAction;
+            }
+        }
+
+        std::string snapshot;
+        CompiledGraph::StepCallback recordStep = [&](std::int32_t nodeIndex, const std::optional<std::string>& action) {
+            snapshot.clear();
+            codec.encode(sharedContext, snapshot);
+            checkpoint->recordStep(nodeIndex, action, snapshot);
+        };
+        std::optional<std::string> lastAction = graph->run(sharedContext, runParams, frame, startIndex, &recordStep);
+        checkpoint->endRun();
+        return lastAction;
+    }
+
+    // Compiled parents that inlined this flow (or may now) must check it again
+    void inliningChanged() {
+        this->wiringChanged();
+    }
+
+    // Compiled run that replays the steps whose recorded inputs still match
+    std::optional<std::string> orchestrateIncremental(Context& sharedContext, const Params& runParams, RunFrame* frame) {
+        std::shared_ptr<const CompiledGraph> graph = currentCompiledGraph();
+        if (!graph) {
+            compile();
+            graph = getCompiledGraph();
+        }
+        detail::IncrementalState& state = *incremental;
+        std::lock_guard<std::mutex> lock(state.mutex);
+        if (state.graph != graph) {
+            if (!state.graph || !state.graph->sameSteps(*graph)) state.steps.clear(); // Rewired: indices changed meaning
+            state.graph = graph;
+        }
+
+        std::optional<std::string> lastAction;
+        std::size_t step = 0;
+        CompiledGraph::StepNamespace keyNamespace(sharedContext, *graph);
+        std::int32_t current = graph->enter(0);
+        while (current != CompiledGraph::NO_NODE) {
+            IBaseNode* node = graph->node(current).node;
+            keyNamespace.enter(graph->node(current));
+            detail::checkDeadline(node);
+            if (!frame) node->setParamsInternal(runParams);
+            const Params* nodeParams;
+            {
+                detail::ScopedFrame scope(frame);
+                nodeParams = &node->getParams();
+            }
+
+            if (step < state.steps.size() && state.steps[step].node == current
+                && detail::IncrementalState::matches(state.steps[step], sharedContext, *nodeParams)) {
+                lastAction = detail::IncrementalState::replay(state.steps[step], sharedContext);
+                ++state.stats.replayed;
+            } else {
+                detail::StepRecord record;
+                record.node = current;
+                {
+                    detail::StepRecorder recorder(sharedContext, record);
+                    lastAction = frame ? node->internalRun(sharedContext, *frame) : node->internalRun(sharedContext);
+                    record.params = *nodeParams;
+                    record.action = lastAction;
+                    detail::IncrementalState::captureWrites(record, recorder, sharedContext);
+                }
+                if (step < state.steps.size()) {
+                    state.steps[step] = std::move(record);
+                } else {
+                    state.steps.push_back(std::move(record));
+                }
+                ++state.stats.executed;
+            }
+            ++step;
+
+            std::int32_t next = graph->nextIndex(current, lastAction);
+            if (next == CompiledGraph::NO_NODE && node->hasSuccessors()) {
+                node->getNextNode(lastAction); // Exit path only: emits the usual "flow might end" warning
+            }
+            current = graph->enter(next);
+        }
+        state.steps.resize(step);
+        return lastAction;
+    }
+
+    // Compiled graph for this run, rebuilt first if the wiring changed since compile()
+    std::shared_ptr<const CompiledGraph> currentCompiledGraph() {
+        std::shared_ptr<const CompiledGraph> graph = std::atomic_load(&compiledGraph);
+        if (!graph || graph->isCurrent()) return graph;
+        std::lock_guard<std::mutex> lock(compileMutex);
+        graph = std::atomic_load(&compiledGraph);
+        if (graph && !graph->isCurrent()) {
+            graph = std::make_shared<CompiledGraph>(startNode);
+            std::atomic_store(&compiledGraph, graph);
+        }
+        return graph;
+    }
+
+    // Override BaseNode's internal run
+     std::optional<std::string> internalRun(Context& sharedContext) override {
+        detail::NodeTrace trace(this); // Exec covers the whole orchestration
+        // Flow's prep is usually no-op unless overridden
+        [[maybe_unused]] std::nullptr_t prepRes = prep(sharedContext); // Call prep, ignore result
+        trace.stageDone(TraceStage::Prep);
+
+        // Orchestrate starting with empty initial params (can be overridden by BatchFlow)
+        std::optional<std::string> orchRes = orchestrate(sharedContext, {});
+        trace.stageDone(TraceStage::Exec);
+
+        // Flow's post processes the *result* of the orchestration
+        std::optional<std::string> action = post(sharedContext, nullptr, orchRes);
+        trace.stageDone(TraceStage::Post);
+        trace.finish(action);
+        return action;
+    }
+
+public:
+    // Override post for Flow. Default returns the final action from orchestration.
+    std::optional<std::string> post(Context& sharedContext, const std::nullptr_t& /*prepResult*/, const std::optional<std::string>& execResult) override {
+        return execResult; // Simply pass through the last action
+    }
+
+    // run() method inherited from BaseNode calls internalRun() correctly.
+};
+
+
+// --- Parallel Flow (Fork/Join) ---
+// Runs several sub-flows at the same time on an Executor, then continues with its
+// default successor (the join node). Each branch runs statelessly on its own copy
+// of the context; afterwards the branches' writes are merged back in branch order.
+// A write outside a branch's declared keys, or a key written by two branches,
+// fails the fork with CognitoFlowException. post() sees each branch's final action.
+class ParallelFlow : public BaseNode<std::nullptr_t, std::vector<std::optional<std::string>>> {
+protected:
+    std::vector<ForkBranch> branches;
+    std::vector<std::shared_ptr<Flow>> branchFlows;
+    std::shared_ptr<Executor> executor;
+    std::size_t maxConcurrency = 0;
+
+public:
+    explicit ParallelFlow(std::vector<ForkBranch> forkBranches, std::size_t maxConcurrentBranches = 0)
+        : branches(std::move(forkBranches)), maxConcurrency(maxConcurrentBranches) {
+        for (const auto& branch : branches) {
+            if (!branch.start) throw std::invalid_argument("Fork branch start node cannot be null");
+            auto branchFlow = std::make_shared<Flow>(branch.start);
+            branchFlow->setExecutionMode(ExecutionMode::Stateless);
+            branchFlows.push_back(std::move(branchFlow));
+        }
+    }
+    virtual ~ParallelFlow() override = default;
+
+    // Continues with `node` after all branches completed; returns `node` for chaining
+    template <typename NodeT>
+    std::shared_ptr<NodeT> join(std::shared_ptr<NodeT> node) {
+        next(std::shared_ptr<IBaseNode>(node));
         return node;
     }
-     // Overload for IBaseNode pointer directly
-     std::shared_ptr<IBaseNode> start(std::shared_ptr<IBaseNode> node) {
-         if (!node) {
-             throw std::invalid_argument("Start node cannot be null");
-         }
-         startNode = node;
-         return node;
-     }
 
-    // Prevent direct calls to Flow's exec - logic is in orchestrate/internalRun
-    std::optional<std::string> exec(std::nullptr_t /*prepResult*/) final override {
-        throw std::logic_error("Flow::exec() is internal and should not be called directly. Use run().");
+    ParallelFlow& setExecutor(std::shared_ptr<Executor> newExecutor) {
+        executor = std::move(newExecutor);
+        return *this;
+    }
+
+    ParallelFlow& setMaxConcurrency(std::size_t maxConcurrentBranches) {
+        maxConcurrency = maxConcurrentBranches;
+        return *this;
+    }
+
+    // Compiles every branch sub-flow
+    ParallelFlow& compile() {
+        for (auto& branchFlow : branchFlows) branchFlow->compile();
+        return *this;
+    }
+
+    const std::vector<ForkBranch>& getBranches() const { return branches; }
+
+    std::vector<std::optional<std::string>> exec(std::nullptr_t /*prepResult*/) final override {
+        throw std::logic_error("ParallelFlow::exec() is internal and should not be called directly. Use run().");
+    }
+
+    std::optional<std::string> internalRun(Context& sharedContext) override {
+        detail::NodeTrace trace(this);
+        [[maybe_unused]] std::nullptr_t prepRes = prep(sharedContext);
+        trace.stageDone(TraceStage::Prep);
+        std::vector<std::optional<std::string>> branchActions = runBranches(sharedContext);
+        trace.stageDone(TraceStage::Exec);
+        std::optional<std::string> action = post(sharedContext, nullptr, branchActions);
+        trace.stageDone(TraceStage::Post);
+        trace.finish(action);
+        return action;
+    }
+
+protected:
+    std::vector<std::optional<std::string>> runBranches(Context& sharedContext) {
+        std::vector<std::optional<std::string>> branchActions(branches.size());
+        if (branches.empty()) return branchActions;
+        std::shared_ptr<Executor> runExecutor = Executor::resolve(executor);
+
+        RunFrame* outerFrame = detail::currentFrame();
+        const Params forkParams = getParams();
+        std::pmr::vector<Context> branchContexts(branches.size(), RunArena::currentResource()); // Elements use the default resource
+
+        const bool runHasArena = detail::currentArena() != nullptr;
+        runExecutor->parallelFor(branches.size(), maxConcurrency, [&](std::size_t index) {
+            std::optional<RunArena> branchArena; // Branches on other threads get an arena of their own
+            if (runHasArena && !detail::currentArena()) branchArena.emplace(RunArena::ITEM_BLOCK);
+            detail::ScopedArena arenaScope(branchArena ? &*branchArena : detail::currentArena());
+            RunFrame branchFrame(forkParams, outerFrame);
+            branchContexts[index] = sharedContext; // Read-only while the branches run
+            IBaseNode& branchFlow = *branchFlows[index];
+            branchActions[index] = branchFlow.internalRun(branchContexts[index], branchFrame);
+        });
+
+        // Validate every branch before touching the shared context
+        std::pmr::map<std::string, std::size_t> writers(RunArena::currentResource());
+        std::string errors;
+        for (std::size_t i = 0; i < branches.size(); ++i) {
+            detail::forEachContextChange(sharedContext, branchContexts[i], [&](const std::string& key, std::any*) {
+                if (!branches[i].mayWrite(key)) {
+                    errors += "branch " + std::to_string(i) + " wrote undeclared key '" + key + "'; ";
+                }
+                auto inserted = writers.emplace(key, i);
+                if (!inserted.second) {
+                    errors += "key '" + key + "' written by branches " + std::to_string(inserted.first->second)
+                            + " and " + std::to_string(i) + "; ";
+                }
+            });
+        }
+        if (!errors.empty()) {
+            throw CognitoFlowException("ParallelFlow context partition violated: " + errors);
+        }
+
+        const Context baseContext = sharedContext;
+        for (std::size_t i = 0; i < branches.size(); ++i) {
+            detail::forEachContextChange(baseContext, branchContexts[i], [&](const std::string& key, std::any* value) {
+                if (value) {
+                    sharedContext[key] = std::move(*value);
+                } else {
+                    sharedContext.erase(key);
+                }
+            });
+        }
+        return branchActions;
+    }
+};
+
+template <typename P, typename E>
+std::shared_ptr<ParallelFlow> BaseNode<P, E>::fork(std::vector<ForkBranch> branches) {
+    auto forkNode = std::make_shared<ParallelFlow>(std::move(branches));
+    next(std::shared_ptr<IBaseNode>(forkNode));
+    return forkNode;
+}
+
+
+// --- Async Flow ---
+// Flow whose steps run on an EventLoop. Async nodes are awaited without blocking
+// the loop thread, so one thread can keep many runs of the same graph in flight;
+// plain nodes run inline on the loop thread. Each run carries its own RunFrame, so
+// concurrent runs never reconfigure the shared node instances. Runs follow the
+// successor maps step by step, so compile() does not speed them up, and checkpoints,
+// incremental re-runs and run arenas are not supported (their setters throw). A
+// context namespace stays applied to the context until the run completes.
+class AsyncFlow : public Flow, public IAsyncNode {
+public:
+    AsyncFlow() = default;
+    explicit AsyncFlow(std::shared_ptr<IBaseNode> start) : Flow(std::move(start)) {}
+    virtual ~AsyncFlow() override = default;
+
+    IAsyncNode* asAsyncNode() override { return this; }
+
+    // sharedContext must stay alive until the returned result is ready
+    AsyncResult<std::optional<std::string>> runAsync(Context& sharedContext, EventLoop& loop) {
+        if (hasSuccessors()) {
+            static LogSite site;
+            logWarn(site, [&] { return "Node " + getClassName() + " has successors, but runAsync() was called. Successors won't be executed. Use AsyncFlow."; });
+        }
+        return internalRunAsync(sharedContext, loop);
+    }
+
+    AsyncResult<std::optional<std::string>> internalRunAsync(Context& sharedContext, EventLoop& loop) override {
+        try {
+            [[maybe_unused]] std::nullptr_t prepRes = prep(sharedContext);
+        } catch (...) {
+            return AsyncResult<std::optional<std::string>>::fromException(std::current_exception());
+        }
+        AsyncPromise<std::optional<std::string>> promise;
+        auto orchestration = orchestrateAsync(sharedContext, {}, loop);
+        RunFrame* frame = detail::currentFrame();
+        orchestration.onReady([this, &sharedContext, &loop, orchestration, promise, frame]() mutable {
+            loop.post([this, &sharedContext, orchestration, promise, frame]() mutable {
+                detail::ScopedFrame scope(frame);
+                try {
+                    promise.setValue(post(sharedContext, nullptr, orchestration.get()));
+                } catch (...) {
+                    promise.setException(std::current_exception());
+                }
+            });
+        });
+        return promise.result();
+    }
+
+protected:
+    // Blocking entry point used by run() and by synchronous parent flows
+    std::optional<std::string> internalRun(Context& sharedContext) override {
+        EventLoop loop;
+        auto result = internalRunAsync(sharedContext, loop);
+        loop.runUntil(result);
+        return result.get();
+    }
+
+    bool supportsRunRecords() const override { return false; }
+
+    virtual AsyncResult<std::optional<std::string>> orchestrateAsync(Context& sharedContext, const Params& initialParams, EventLoop& loop) {
+        if (!startNode) {
+            static LogSite site;
+            logWarn(site, [] { return std::string("Flow started with no start node."); });
+            return AsyncResult<std::optional<std::string>>::fromValue(std::nullopt);
+        }
+        auto run = std::make_shared<AsyncRun>(sharedContext, loop,
+                                              Params::layered(getParams(), initialParams), // initialParams take precedence
+                                              detail::currentFrame());
+        run->deadline = detail::currentDeadline();
+        if (runTimeout.count() > 0) run->deadline = std::min(run->deadline, std::chrono::steady_clock::now() + runTimeout);
+        run->currentNode = startNode;
+        if (!contextNamespace.empty()) {
+            run->previousNamespace = sharedContext.keyNamespace();
+            sharedContext.setKeyNamespace(run->previousNamespace + contextNamespace);
+            run->namespaced = true;
+        }
+        step(run);
+        return run->promise.result();
+    }
+
+private:
+    struct AsyncRun {
+        Context& sharedContext;
+        EventLoop& loop;
+        RunFrame frame;
+        detail::DeadlineClock::time_point deadline; // Restored on the loop thread for every step
+        std::shared_ptr<IBaseNode> currentNode;
+        std::optional<std::string> lastAction;
+        AsyncPromise<std::optional<std::string>> promise;
+        std::string previousNamespace; // The caller's namespace, restored when the run completes
+        bool namespaced = false;
+
+        AsyncRun(Context& ctx, EventLoop& eventLoop, Params params, RunFrame* parentFrame)
+            : sharedContext(ctx), loop(eventLoop), frame(std::move(params), parentFrame) {}
+
+        void fail(std::exception_ptr error) {
+            leaveNamespace();
+            promise.setException(std::move(error));
+        }
+
+        void succeed() {
+            leaveNamespace();
+            promise.setValue(lastAction);
+        }
+
+        void leaveNamespace() {
+            if (!namespaced) return;
+            sharedContext.setKeyNamespace(std::move(previousNamespace));
+            namespaced = false;
+        }
+    };
+
+    // Advances the run until an async node is pending or the flow ends
+    static void step(const std::shared_ptr<AsyncRun>& run) {
+        detail::ScopedFrame scope(&run->frame);
+        detail::ScopedDeadline deadlineScope(run->deadline);
+        try {
+            while (run->currentNode != nullptr) {
+                detail::checkDeadline(run->currentNode.get());
+                if (IAsyncNode* asyncNode = run->currentNode->asAsyncNode()) {
+                    auto pending = asyncNode->internalRunAsync(run->sharedContext, run->loop);
+                    pending.onReady([run, pending]() {
+                        run->loop.post([run, pending]() {
+                            try {
+                                run->lastAction = pending.get();
+                                run->currentNode = run->currentNode->getNextNode(run->lastAction);
+                            } catch (...) {
+                                run->fail(std::current_exception());
+                                return;
+                            }
+                            step(run);
+                        });
+                    });
+                    return;
+                }
+                run->lastAction = run->currentNode->internalRun(run->sharedContext, run->frame);
+                run->currentNode = run->currentNode->getNextNode(run->lastAction);
+            }
+        } catch (...) {
+            run->fail(std::current_exception());
+            return;
+        }
+        run->succeed();
+    }
+};
+
+
+// --- Batch Flow ---
+class BatchFlow : public Flow {
+public:
+    BatchFlow() = default;
+    explicit BatchFlow(std::shared_ptr<IBaseNode> start) : Flow(std::move(start)) {}
+    virtual ~BatchFlow() override = default;
+
+    // --- Methods for subclasses to implement ---
+    virtual std::vector<Params> prepBatch(Context& sharedContext) = 0;
+
+    // Post method after all batches have run
+    virtual std::optional<std::string> postBatch(Context& sharedContext, const std::vector<Params>& batchPrepResult) = 0;
+
+protected:
+    // Override internalRun to handle batch execution
+    std::optional<std::string> internalRun(Context& sharedContext) override {
+        detail::NodeTrace trace(this);
+        std::vector<Params> batchParamsList = prepBatch(sharedContext);
+        trace.stageDone(TraceStage::Prep);
+
+        if (batchParamsList.empty()) {
+             static LogSite site;
+             logWarn(site, [] { return std::string("BatchFlow prepBatch returned empty list."); });
+             // Still call postBatch even if empty
+        }
+
+        const ContextCodec* codec = checkpoint ? checkpoint->contextCodec() : nullptr;
+        CheckpointState resume = beginBatchCheckpoint(batchParamsList.size());
+        CheckpointLog::RunScope runScope(checkpoint.get());
+        std::size_t firstIndex = 0;
+        if (!resume.completedBatches.empty()) {
+            // Runs are sequential, so the finished ones are a prefix; its last context is current
+            firstIndex = static_cast<std::size_t>(resume.completedBatches.rbegin()->first) + 1;
+            if (codec) {
+                Context restored;
+                codec->decode(resume.completedBatches.rbegin()->second, restored);
+                sharedContext = std::move(restored);
+            }
+        }
+
+        std::string snapshot;
+        for (std::size_t index = firstIndex; index < batchParamsList.size(); ++index) {
+            // Run the orchestration for each parameter set.
+            // Result of individual orchestrations is ignored here; focus is on side effects.
+            orchestrate(sharedContext, batchParamsList[index]);
+            if (checkpoint) {
+                snapshot.clear();
+                if (codec) codec->encode(sharedContext, snapshot);
+                checkpoint->recordBatch(index, snapshot);
+            }
+        }
+        if (checkpoint) checkpoint->endRun();
+        trace.stageDone(TraceStage::Exec);
+
+        // After all batches, call postBatch
+        std::optional<std::string> action = postBatch(sharedContext, batchParamsList);
+        trace.stageDone(TraceStage::Post);
+        trace.finish(action);
+        return action;
+    }
+
+    bool checkpointsSteps() const override { return false; }
+
+    // Opens the checkpointed run for this batch (no-op without a log). The fingerprint
+    // covers the batch size too, so a changed prepBatch starts over.
+    CheckpointState beginBatchCheckpoint(std::size_t batchSize) {
+        if (!checkpoint) return CheckpointState();
+        std::shared_ptr<const CompiledGraph> graph = currentCompiledGraph();
+        if (!graph) {
+            compile();
+            graph = getCompiledGraph();
+        }
+        return checkpoint->beginRun(detail::combineHash(graph->fingerprint(), batchSize));
+    }
+
+public:
+    // Prevent calling the regular post method directly for BatchFlow
+    std::optional<std::string> post(Context& /*sharedContext*/, const std::nullptr_t& /*prepResult*/, const std::optional<std::string>& /*execResult*/) final override {
+         throw std::logic_error("Use postBatch for BatchFlow, not post.");
+    }
+};
+
+
+// --- Parallel Batch Flow ---
+// Runs the flow once per parameter set like BatchFlow, but the runs execute at the
+// same time on an Executor. Each run gets its own copy of the shared context and
+// executes statelessly in its own RunFrame, so the shared node instances are never
+// reconfigured mid-run. Once every run has finished, mergeRunContext folds each run's
+// context back into the shared one in prepBatch order, then postBatch is called.
+// Nodes must not write `this->params` or other members during a run.
+class ParallelBatchFlow : public BatchFlow {
+protected:
+    std::size_t maxConcurrency = 0;
+
+public:
+    ParallelBatchFlow() = default;
+    explicit ParallelBatchFlow(std::shared_ptr<IBaseNode> start, std::size_t maxConcurrentRuns = 0)
+        : BatchFlow(std::move(start)), maxConcurrency(maxConcurrentRuns) {}
+    virtual ~ParallelBatchFlow() override = default;
+
+    // Caps how many parameter sets run at once (0 = every executor thread plus the caller).
+    // The runs use the flow's executor (Flow::setExecutor), else the default one.
+    ParallelBatchFlow& setMaxConcurrency(std::size_t maxConcurrentRuns) {
+        maxConcurrency = maxConcurrentRuns;
+        return *this;
+    }
+
+protected:
+    // Merges one run's context into the shared context. `baseContext` is the shared
+    // context as it was before any run started. The default writes back keys the run
+    // added or assigned and removes keys it erased; keys it never assigned are skipped
+    // whatever their type. Later runs win on conflicts. Runs restored from a checkpoint
+    // carry no version stamps, so each of their non-scalar keys counts as changed.
+    virtual void mergeRunContext(Context& sharedContext, const Context& baseContext, Context& runContext,
+                                 const Params& /*batchParams*/, std::size_t /*runIndex*/) {
+        detail::forEachContextChange(baseContext, runContext, [&](const std::string& key, std::any* value) {
+            if (value) {
+                sharedContext[key] = std::move(*value);
+            } else {
+                sharedContext.erase(key);
+            }
+        });
+    }
+
+    std::optional<std::string> internalRun(Context& sharedContext) override {
+        detail::NodeTrace trace(this);
+        std::vector<Params> batchParamsList = prepBatch(sharedContext);
+        trace.stageDone(TraceStage::Prep);
+
+        if (batchParamsList.empty()) {
+            static LogSite site;
+            logWarn(site, [] { return std::string("BatchFlow prepBatch returned empty list."); });
+            trace.stageDone(TraceStage::Exec);
+            std::optional<std::string> action = postBatch(sharedContext, batchParamsList);
+            trace.stageDone(TraceStage::Post);
+            trace.finish(action);
+            return action;
+        }
+        const Context baseContext = sharedContext;
+        RunFrame* outerFrame = detail::currentFrame();
+        const Params flowParams = getParams();
+        std::pmr::vector<Context> runContexts(batchParamsList.size(), RunArena::currentResource()); // Elements use the default resource
+
+        // Runs finished before an interruption are restored from the log instead of rerun;
+        // without a codec they are skipped and contribute nothing to the merge
+        const ContextCodec* codec = checkpoint ? checkpoint->contextCodec() : nullptr;
+        CheckpointState resume = beginBatchCheckpoint(batchParamsList.size());
+        CheckpointLog::RunScope runScope(checkpoint.get());
+        std::vector<std::size_t> pendingRuns;
+        for (std::size_t index = 0; index < batchParamsList.size(); ++index) {
+            auto done = resume.completedBatches.find(index);
+            if (done == resume.completedBatches.end()) {
+                pendingRuns.push_back(index);
+            } else if (codec) {
+                codec->decode(done->second, runContexts[index]);
+            } else {
+                runContexts[index] = baseContext;
+            }
+        }
+
+        Executor::resolve(executor)->parallelFor(pendingRuns.size(), maxConcurrency, [&](std::size_t pendingIndex) {
+            std::size_t index = pendingRuns[pendingIndex];
+            // An active frame makes orchestrate run statelessly, without touching the nodes
+            RunFrame runFrame(flowParams, outerFrame);
+            detail::ScopedFrame scope(&runFrame);
+            runContexts[index] = baseContext;
+            orchestrate(runContexts[index], batchParamsList[index]);
+            if (checkpoint) {
+                std::string snapshot;
+                if (codec) codec->encode(runContexts[index], snapshot);
+                checkpoint->recordBatch(index, snapshot);
+            }
+        });
+        if (checkpoint) checkpoint->endRun();
+
+        for (std::size_t i = 0; i < runContexts.size(); ++i) {
+            mergeRunContext(sharedContext, baseContext, runContexts[i], batchParamsList[i], i);
+        }
+        trace.stageDone(TraceStage::Exec);
+        std::optional<std::string> action = postBatch(sharedContext, batchParamsList);
+        trace.stageDone(TraceStage::Post);
+        trace.finish(action);
+        return action;
+    }
+};
+
+
+// --- Distributed Batch Flow ---
+// Runs a BatchFlow's parameter sets on workers, possibly other machines, that build the
+// same flow graph from FlowRegistry. The coordinator cuts prepBatch's list into shards
+// of shardSize entries, and each shard travels as one request message:
+//     u8 version | bytes flow name | bytes base context snapshot
+//     | u32 count | per entry: u64 index, bytes params snapshot
+// The worker answers with each entry's last action and context delta:
+//     u32 count | per entry: u64 index, u8 has action, bytes action,
+//                            bytes changed-keys snapshot, u32 erased count, bytes key...
+// The changed-keys snapshot holds only the keys the entry's run assigned: the worker
+// diffs each run against its own copy of the decoded base context, so version stamps
+// decide and never need to cross the wire. Every value crossing the wire needs a
+// TypeRegistry codec.
+
+// Factories for the flow graphs workers may be asked to run, by name
+class FlowRegistry {
+    std::mutex mutex;
+    std::map<std::string, std::function<std::shared_ptr<Flow>()>> factories;
+
+public:
+    static FlowRegistry& instance() {
+        static FlowRegistry* registry = new FlowRegistry(); // Leaked: usable from static destructors
+        return *registry;
     }
 
-protected:
-    // The core orchestration logic
-    virtual std::optional<std::string> orchestrate(Context& sharedContext, const Params& initialParams) {
-        if (!startNode) {
-            logWarn("Flow started with no start node.");
-            return std::nullopt;
+    void add(const std::string& name, std::function<std::shared_ptr<Flow>()> factory) {
+        std::lock_guard<std::mutex> lock(mutex);
+        factories[name] = std::move(factory);
+    }
+
+    std::shared_ptr<Flow> create(const std::string& name) {
+        std::function<std::shared_ptr<Flow>()> factory;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = factories.find(name);
+            if (it == factories.end()) throw CognitoFlowException("No flow registered as '" + name + "'");
+            factory = it->second;
         }
+        std::shared_ptr<Flow> flow = factory();
+        if (!flow) throw CognitoFlowException("Factory for flow '" + name + "' returned null");
+        return flow;
+    }
+};
 
-        std::shared_ptr<IBaseNode> currentNode = startNode;
-        std::optional<std::string> lastAction = std::nullopt;
+// Worker side of the protocol: decodes a shard request, runs each entry on a flow built
+// from FlowRegistry (one instance per flow name, reused for later shards) and encodes
+// the reply. Throws if the request is malformed, the flow is unknown or a run fails.
+// Not thread-safe; give each worker thread its own runner.
+class ShardRunner {
+    std::map<std::string, std::shared_ptr<Flow>, std::less<>> flows;
 
-        // Combine flow's base params with initial params for this run
-        Params currentRunParams = this->params; // Start with Flow's own params
-        currentRunParams.insert(initialParams.begin(), initialParams.end()); // Add/overwrite with initialParams
+public:
+    std::string handle(std::string_view request) {
+        detail::ByteReader reader(request);
+        if (reader.u8() != 1) throw CognitoFlowException("Unsupported shard request version");
+        std::string_view flowName = reader.bytes();
+        std::string_view baseBytes = reader.bytes();
+        std::uint32_t count = reader.u32();
+        if (!reader.ok()) throw CognitoFlowException("Malformed shard request");
 
+        auto it = flows.find(flowName);
+        if (it == flows.end()) it = flows.emplace(std::string(flowName), FlowRegistry::instance().create(std::string(flowName))).first;
+        Flow& flow = *it->second;
 
-        while (currentNode != nullptr) {
-            currentNode->setParamsInternal(currentRunParams); // Set params for the current node
-            lastAction = currentNode->internalRun(sharedContext); // Execute the node
-            currentNode = currentNode->getNextNode(lastAction);   // Find the next node based on action
-        }
+        Context base;
+        SnapshotView(baseBytes).loadInto(base);
+        std::string reply;
+        detail::putU32(reply, count);
+        std::string changedBytes;
+        for (std::uint32_t i = 0; i < count; ++i) {
+            std::uint64_t index = reader.u64();
+            std::string_view paramBytes = reader.bytes();
+            if (!reader.ok()) throw CognitoFlowException("Malformed shard request");
 
-        return lastAction; // Return the action that led to termination (or nullopt if last node had no action)
+            Context run = base; // Keeps base's version stamps for the diff below
+            flow.setParams(SnapshotView(paramBytes).toParams());
+            std::optional<std::string> action = flow.run(run);
+
+            Context changed;
+            std::vector<std::string> erased;
+            detail::forEachContextChange(base, run, [&](const std::string& key, std::any* value) {
+                if (value) {
+                    changed.insert_or_assign(key, std::move(*value));
+                } else {
+                    erased.push_back(key);
+                }
+            });
+            changedBytes.clear();
+            encodeSnapshot(changed, changedBytes);
+
+            detail::putU64(reply, index);
+            reply.push_back(action ? 1 : 0);
+            detail::putBytes(reply, action ? std::string_view(*action) : std::string_view());
+            detail::putBytes(reply, changedBytes);
+            detail::putU32(reply, static_cast<std::uint32_t>(erased.size()));
+            for (const auto& key : erased) detail::putBytes(reply, key);
+        }
+        return reply;
     }
+};
 
-    // Override BaseNode's internal run
-     std::optional<std::string> internalRun(Context& sharedContext) override {
-        // Flow's prep is usually no-op unless overridden
-        [[maybe_unused]] std::nullptr_t prepRes = prep(sharedContext); // Call prep, ignore result
+// Outcome of one shard request
+struct ShardReply {
+    bool ok = false;
+    bool workerLost = false; // The worker is unreachable; stop sending it shards
+    std::string data;        // Reply message when ok, else the error text
+};
 
-        // Orchestrate starting with empty initial params (can be overridden by BatchFlow)
-        std::optional<std::string> orchRes = orchestrate(sharedContext, {});
+// Coordinator's handle on one worker. send() must not block for the shard's duration:
+// it queues or transmits the request and calls done exactly once, from any thread.
+// A network transport implements this on top of its RPC layer and runs a ShardRunner
+// on the remote side.
+class ShardWorker {
+public:
+    virtual ~ShardWorker() = default;
+    virtual std::string name() const = 0;
+    virtual void send(std::string request, std::function<void(ShardReply)> done) = 0;
+};
 
-        // Flow's post processes the *result* of the orchestration
-        return post(sharedContext, nullptr, orchRes);
-    }
+// Worker in this process: a thread with its own ShardRunner and request queue
+class InProcessShardWorker : public ShardWorker {
+    struct Job {
+        std::string request;
+        std::function<void(ShardReply)> done;
+    };
+
+    std::string workerName;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<Job> jobs;
+    bool stopping = false;
+    std::thread thread;
 
 public:
-    // Override post for Flow. Default returns the final action from orchestration.
-    std::optional<std::string> post(Context& sharedContext, const std::nullptr_t& /*prepResult*/, const std::optional<std::string>& execResult) override {
-        return execResult; // Simply pass through the last action
+    explicit InProcessShardWorker(std::string name = "local") : workerName(std::move(name)) {
+        thread = std::thread([this] { workLoop(); });
     }
 
-    // run() method inherited from BaseNode calls internalRun() correctly.
+    InProcessShardWorker(const InProcessShardWorker&) = delete;
+    InProcessShardWorker& operator=(const InProcessShardWorker&) = delete;
+
+    // Finishes the queued shards first
+    ~InProcessShardWorker() override {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        cv.notify_all();
+        thread.join();
+    }
+
+    std::string name() const override { return workerName; }
+
+    void send(std::string request, std::function<void(ShardReply)> done) override {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(Job{std::move(request), std::move(done)});
+        }
+        cv.notify_one();
+    }
+
+private:
+    void workLoop() {
+        ShardRunner runner;
+        for (;;) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [&] { return stopping || !jobs.empty(); });
+                if (jobs.empty()) return;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            ShardReply reply;
+            try {
+                reply.data = runner.handle(job.request);
+                reply.ok = true;
+            } catch (const std::exception& e) {
+                reply.data = e.what();
+            } catch (...) {
+                reply.data = "Unknown error while running shard";
+            }
+            job.done(std::move(reply));
+        }
+    }
 };
 
+// BatchFlow whose parameter sets run on ShardWorkers instead of this flow's graph.
+// Workers pull work: each gets one shard at a time and the next when it answers, so
+// faster workers take more shards. Once no shard is left to hand out, idle workers
+// take over (duplicate) the longest-running unfinished shard and the first answer
+// wins, so a straggler cannot hold up the batch: the run returns once every shard has
+// an answer, without waiting for the copies still running. With setShardTimeout a
+// worker that does not answer in time counts as a failure. A failed shard is retried
+// on a worker that has not failed it, up to maxAttempts times; then the run throws. Changes are
+// merged into the shared context with mergeRunDelta in prepBatch order before
+// postBatch. The flow's params are layered under each entry's params, as in BatchFlow.
+class DistributedBatchFlow : public BatchFlow {
+protected:
+    std::string flowName;
+    std::vector<std::shared_ptr<ShardWorker>> workers;
+    std::size_t shardSize = 16;
+    int maxAttempts = 3;
+    bool speculative = true;
+    std::chrono::milliseconds shardTimeout{0};
+    std::vector<std::optional<std::string>> runActions;
 
-// --- Batch Flow ---
-class BatchFlow : public Flow {
 public:
-    BatchFlow() = default;
-    explicit BatchFlow(std::shared_ptr<IBaseNode> start) : Flow(std::move(start)) {}
-    virtual ~BatchFlow() override = default;
+    DistributedBatchFlow(std::string registeredFlow, std::vector<std::shared_ptr<ShardWorker>> shardWorkers)
+        : flowName(std::move(registeredFlow)), workers(std::move(shardWorkers)) {}
+    virtual ~DistributedBatchFlow() override = default;
 
-    // --- Methods for subclasses to implement ---
-    virtual std::vector<Params> prepBatch(Context& sharedContext) = 0;
+    DistributedBatchFlow& setShardSize(std::size_t entriesPerShard) {
+        if (entriesPerShard == 0) throw std::invalid_argument("shardSize must be at least 1");
+        shardSize = entriesPerShard;
+        return *this;
+    }
 
-    // Post method after all batches have run
-    virtual std::optional<std::string> postBatch(Context& sharedContext, const std::vector<Params>& batchPrepResult) = 0;
+    DistributedBatchFlow& setMaxAttempts(int attempts) {
+        if (attempts < 1) throw std::invalid_argument("maxAttempts must be at least 1");
+        maxAttempts = attempts;
+        return *this;
+    }
+
+    // A shard copy without a reply after `timeout` counts as a failed attempt and the
+    // shard is sent to another worker; the late worker gets no new shard from this run
+    // until it answers. 0 (the default) waits indefinitely.
+    DistributedBatchFlow& setShardTimeout(std::chrono::milliseconds timeout) {
+        if (timeout.count() < 0) throw std::invalid_argument("shard timeout cannot be negative");
+        shardTimeout = timeout;
+        return *this;
+    }
+
+    // Whether idle workers duplicate unfinished shards once none are left to hand out
+    DistributedBatchFlow& setSpeculativeShards(bool enabled) {
+        speculative = enabled;
+        return *this;
+    }
+
+    DistributedBatchFlow& setWorkers(std::vector<std::shared_ptr<ShardWorker>> shardWorkers) {
+        workers = std::move(shardWorkers);
+        return *this;
+    }
+
+    // Last action of each entry's run, in prepBatch order; valid in postBatch
+    const std::vector<std::optional<std::string>>& getRunActions() const { return runActions; }
 
 protected:
-    // Override internalRun to handle batch execution
+    // Applies one entry's changes: `changed` holds the keys its run added or assigned,
+    // `erased` the keys it removed; keys the run left alone are in neither. Later
+    // entries win on conflicts.
+    virtual void mergeRunDelta(Context& sharedContext, Context& changed, const std::vector<std::string>& erased,
+                               const Params& /*batchParams*/, std::size_t /*runIndex*/) {
+        for (auto& entry : changed) sharedContext[entry.first] = std::move(entry.second);
+        for (const auto& key : erased) sharedContext.erase(key);
+    }
+
     std::optional<std::string> internalRun(Context& sharedContext) override {
+        detail::NodeTrace trace(this);
         std::vector<Params> batchParamsList = prepBatch(sharedContext);
-
+        trace.stageDone(TraceStage::Prep);
         if (batchParamsList.empty()) {
-             logWarn("BatchFlow prepBatch returned empty list.");
-             // Still call postBatch even if empty
+            static LogSite site;
+            logWarn(site, [] { return std::string("BatchFlow prepBatch returned empty list."); });
+        }
+        if (!batchParamsList.empty() && workers.empty()) {
+            throw CognitoFlowException("DistributedBatchFlow has no workers");
         }
 
-        for (const auto& batchParams : batchParamsList) {
-            // Run the orchestration for each parameter set.
-            // Result of individual orchestrations is ignored here; focus is on side effects.
-            orchestrate(sharedContext, batchParams);
+        std::vector<std::string> replies = runShards(encodeShards(sharedContext, batchParamsList));
+
+        runActions.assign(batchParamsList.size(), std::nullopt);
+        for (const std::string& reply : replies) {
+            detail::ByteReader reader(reply);
+            std::uint32_t count = reader.u32();
+            for (std::uint32_t i = 0; i < count && reader.ok(); ++i) {
+                std::uint64_t index = reader.u64();
+                bool hasAction = reader.u8() != 0;
+                std::string_view action = reader.bytes();
+                std::string_view changedBytes = reader.bytes();
+                std::vector<std::string> erased(reader.count(4)); // Each key has a 4-byte length
+                for (auto& key : erased) key = std::string(reader.bytes());
+                if (!reader.ok() || index >= batchParamsList.size()) break;
+                if (hasAction) runActions[index] = std::string(action);
+                Context changed;
+                SnapshotView(changedBytes).loadInto(changed);
+                mergeRunDelta(sharedContext, changed, erased, batchParamsList[index], static_cast<std::size_t>(index));
+            }
+            if (!reader.ok() || !reader.atEnd()) throw CognitoFlowException("Malformed shard reply");
         }
+        trace.stageDone(TraceStage::Exec);
 
-        // After all batches, call postBatch
-        return postBatch(sharedContext, batchParamsList);
+        std::optional<std::string> action = postBatch(sharedContext, batchParamsList);
+        trace.stageDone(TraceStage::Post);
+        trace.finish(action);
+        return action;
+    }
+
+private:
+    std::vector<std::string> encodeShards(const Context& sharedContext, const std::vector<Params>& batchParamsList) const {
+        const std::string baseBytes = encodeSnapshot(sharedContext);
+        const Params flowParams = getParams();
+        std::vector<std::string> shards;
+        for (std::size_t first = 0; first < batchParamsList.size(); first += shardSize) {
+            std::size_t count = std::min(shardSize, batchParamsList.size() - first);
+            std::string request;
+            request.push_back(1);
+            detail::putBytes(request, flowName);
+            detail::putBytes(request, baseBytes);
+            detail::putU32(request, static_cast<std::uint32_t>(count));
+            std::string paramBytes;
+            for (std::size_t index = first; index < first + count; ++index) {
+                paramBytes.clear();
+                encodeSnapshot(Params::layered(flowParams, batchParamsList[index]), paramBytes);
+                detail::putU64(request, index);
+                detail::putBytes(request, paramBytes);
+            }
+            shards.push_back(std::move(request));
+        }
+        return shards;
+    }
+
+    // Hands shards to idle workers until every shard has a reply; returns them in shard
+    // order as soon as the last one arrives. Copies still running (duplicates, or
+    // attempts that timed out) answer into `state`, which outlives this call.
+    std::vector<std::string> runShards(std::vector<std::string> requests) {
+        using Clock = std::chrono::steady_clock;
+        struct Shard {
+            std::vector<bool> failedOn; // Per worker
+            int attempts = 0;
+            std::size_t copiesRunning = 0;
+            Clock::time_point started;
+            bool done = false;
+            std::string lastError;
+        };
+        // One request sent to one worker
+        struct Copy {
+            std::size_t shard;
+            std::size_t worker;
+            Clock::time_point deadline;
+            bool expired = false; // Counted as failed; the worker stays busy until it answers
+        };
+        struct Event {
+            std::size_t copy;
+            ShardReply reply;
+        };
+        struct State {
+            std::mutex mutex;
+            std::condition_variable cv;
+            std::deque<Event> events;
+        };
+
+        const std::size_t workerCount = workers.size();
+        std::vector<Shard> shards(requests.size());
+        for (auto& shard : shards) shard.failedOn.assign(workerCount, false);
+        std::vector<std::string> replies(requests.size());
+        std::deque<std::size_t> pending;
+        for (std::size_t i = 0; i < shards.size(); ++i) pending.push_back(i);
+        std::vector<bool> busy(workerCount, false), lost(workerCount, false);
+        std::vector<Copy> copies;
+        std::vector<std::size_t> running; // Copies neither answered nor expired
+        auto state = std::make_shared<State>(); // Outlives this call for late callbacks
+        std::size_t remaining = shards.size();
+        std::string failure;
+
+        auto dispatch = [&](std::size_t shardIndex, std::size_t worker) {
+            Shard& shard = shards[shardIndex];
+            Clock::time_point now = Clock::now();
+            if (shard.copiesRunning == 0) shard.started = now;
+            ++shard.copiesRunning;
+            busy[worker] = true;
+            std::size_t copy = copies.size();
+            copies.push_back(Copy{shardIndex, worker, shardTimeout.count() > 0 ? now + shardTimeout : Clock::time_point::max()});
+            running.push_back(copy);
+            workers[worker]->send(requests[shardIndex], [state, copy](ShardReply reply) {
+                {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    state->events.push_back(Event{copy, std::move(reply)});
+                }
+                state->cv.notify_one();
+            });
+        };
+
+        // A failed copy: retried elsewhere unless the shard is out of attempts
+        auto copyFailed = [&](const Copy& copy, const std::string& error) {
+            Shard& shard = shards[copy.shard];
+            shard.failedOn[copy.worker] = true;
+            shard.lastError = workers[copy.worker]->name() + ": " + error;
+            if (++shard.attempts >= maxAttempts) {
+                failure = "shard " + std::to_string(copy.shard) + " failed " + std::to_string(shard.attempts)
+                        + " times; last error from " + shard.lastError;
+            } else if (shard.copiesRunning == 0) {
+                bool untried = false;
+                for (std::size_t worker = 0; worker < workerCount; ++worker) untried = untried || (!lost[worker] && !shard.failedOn[worker]);
+                if (!untried) std::fill(shard.failedOn.begin(), shard.failedOn.end(), false); // Every live worker failed it; allow repeats
+                pending.push_front(copy.shard);
+            }
+        };
+
+        while (remaining > 0 && failure.empty()) {
+            for (std::size_t worker = 0; worker < workerCount; ++worker) {
+                if (busy[worker] || lost[worker]) continue;
+                // Oldest pending shard this worker has not failed
+                auto next = std::find_if(pending.begin(), pending.end(), [&](std::size_t s) { return !shards[s].failedOn[worker]; });
+                if (next != pending.end()) {
+                    std::size_t shardIndex = *next;
+                    pending.erase(next);
+                    dispatch(shardIndex, worker);
+                    continue;
+                }
+                if (!speculative || !pending.empty()) continue;
+                // Nothing left to hand out: back up the longest-running unfinished shard
+                std::optional<std::size_t> straggler;
+                for (std::size_t s = 0; s < shards.size(); ++s) {
+                    const Shard& shard = shards[s];
+                    if (shard.done || shard.copiesRunning != 1 || shard.failedOn[worker]) continue;
+                    if (!straggler || shard.started < shards[*straggler].started) straggler = s;
+                }
+                if (straggler) dispatch(*straggler, worker);
+            }
+
+            // Workers holding an expired copy do not count: they may never answer
+            if (running.empty()) {
+                failure = "no worker is available for the remaining shards";
+                for (std::size_t s : pending) {
+                    if (!shards[s].lastError.empty()) {
+                        failure += "; last error from " + shards[s].lastError;
+                        break;
+                    }
+                }
+                break;
+            }
+
+            std::optional<Event> event;
+            {
+                Clock::time_point deadline = Clock::time_point::max();
+                for (std::size_t copy : running) deadline = std::min(deadline, copies[copy].deadline);
+                std::unique_lock<std::mutex> lock(state->mutex);
+                auto arrived = [&] { return !state->events.empty(); };
+                if (deadline == Clock::time_point::max()) {
+                    state->cv.wait(lock, arrived);
+                } else {
+                    state->cv.wait_until(lock, deadline, arrived);
+                }
+                if (!state->events.empty()) {
+                    event = std::move(state->events.front());
+                    state->events.pop_front();
+                }
+            }
+
+            if (!event) {
+                // Deadline passed: expire every overdue copy
+                Clock::time_point now = Clock::now();
+                long long millis = static_cast<long long>(shardTimeout.count());
+                for (std::size_t i = 0; i < running.size() && failure.empty();) {
+                    Copy& copy = copies[running[i]];
+                    if (copy.deadline > now) {
+                        ++i;
+                        continue;
+                    }
+                    copy.expired = true;
+                    running.erase(running.begin() + static_cast<std::ptrdiff_t>(i));
+                    --shards[copy.shard].copiesRunning;
+                    if (!shards[copy.shard].done) copyFailed(copy, "no reply within " + std::to_string(millis) + " ms");
+                }
+                continue;
+            }
+
+            Copy& copy = copies[event->copy];
+            busy[copy.worker] = false;
+            if (event->reply.workerLost) lost[copy.worker] = true;
+            Shard& shard = shards[copy.shard];
+            if (!copy.expired) {
+                running.erase(std::find(running.begin(), running.end(), event->copy));
+                --shard.copiesRunning;
+            }
+            if (shard.done) continue; // A duplicate already answered
+
+            if (event->reply.ok) {
+                shard.done = true; // A late answer from an expired copy still counts
+                replies[copy.shard] = std::move(event->reply.data);
+                --remaining;
+                continue;
+            }
+            if (!copy.expired) copyFailed(copy, event->reply.data); // An expired copy was already counted
+        }
+
+        if (!failure.empty()) throw CognitoFlowException("DistributedBatchFlow failed: " + failure);
+        return replies;
     }
+};
+
+
+// --- Pipeline Flow ---
+namespace detail {
+    // Bounded lock-free multi-producer/multi-consumer ring (Vyukov): each cell carries a
+    // sequence number telling producers and consumers whose turn it is, so push and pop
+    // are a CAS on their own index plus one release store. Capacity is rounded up to a
+    // power of two.
+    template <typename T>
+    class BoundedMpmcQueue {
+        struct Cell {
+            std::atomic<std::size_t> sequence;
+            T value;
+        };
+        std::unique_ptr<Cell[]> cells;
+        std::size_t mask;
+        alignas(64) std::atomic<std::size_t> enqueuePos{0};
+        alignas(64) std::atomic<std::size_t> dequeuePos{0};
+
+    public:
+        explicit BoundedMpmcQueue(std::size_t capacity) {
+            std::size_t size = 2;
+            while (size < capacity) size <<= 1;
+            cells.reset(new Cell[size]);
+            mask = size - 1;
+            for (std::size_t i = 0; i < size; ++i) cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+
+        BoundedMpmcQueue(const BoundedMpmcQueue&) = delete;
+        BoundedMpmcQueue& operator=(const BoundedMpmcQueue&) = delete;
+
+        bool tryPush(T value) {
+            std::size_t pos = enqueuePos.load(std::memory_order_relaxed);
+            Cell* cell;
+            for (;;) {
+                cell = &cells[pos & mask];
+                std::size_t sequence = cell->sequence.load(std::memory_order_acquire);
+                std::intptr_t diff = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(pos);
+                if (diff == 0) {
+                    if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+                } else if (diff < 0) {
+                    return false; // Full
+                } else {
+                    pos = enqueuePos.load(std::memory_order_relaxed);
+                }
+            }
+            cell->value = std::move(value);
+            cell->sequence.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool tryPop(T& value) {
+            std::size_t pos = dequeuePos.load(std::memory_order_relaxed);
+            Cell* cell;
+            for (;;) {
+                cell = &cells[pos & mask];
+                std::size_t sequence = cell->sequence.load(std::memory_order_acquire);
+                std::intptr_t diff = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(pos + 1);
+                if (diff == 0) {
+                    if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+                } else if (diff < 0) {
+                    return false; // Empty
+                } else {
+                    pos = dequeuePos.load(std::memory_order_relaxed);
+                }
+            }
+            value = std::move(cell->value);
+            cell->sequence.store(pos + mask + 1, std::memory_order_release);
+            return true;
+        }
+    };
+
+    // BoundedMpmcQueue plus blocking for idle ends: a thread spins briefly, then parks on
+    // a condition variable that the other side only touches when someone is parked.
+    // close() ends the stream; pop() returns false once it is closed and drained.
+    template <typename T>
+    class PipeChannel {
+        BoundedMpmcQueue<T> queue;
+        std::mutex mutex;
+        std::condition_variable notEmpty, notFull;
+        std::atomic<int> parkedConsumers{0}, parkedProducers{0};
+        std::atomic<bool> closed{false};
+
+        static constexpr int SPINS = 64;
+
+    public:
+        explicit PipeChannel(std::size_t capacity) : queue(capacity) {}
+
+        void push(T value) {
+            for (int spin = 0; !queue.tryPush(value);) {
+                if (++spin < SPINS) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                std::unique_lock<std::mutex> lock(mutex);
+                parkedProducers.fetch_add(1);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                bool pushed = notFull.wait_for(lock, std::chrono::milliseconds(1), [&] { return queue.tryPush(value); });
+                parkedProducers.fetch_sub(1);
+                if (pushed) break;
+            }
+            wake(parkedConsumers, notEmpty);
+        }
+
+        bool pop(T& value) {
+            for (int spin = 0;;) {
+                if (queue.tryPop(value)) break;
+                if (closed.load(std::memory_order_acquire)) {
+                    if (queue.tryPop(value)) break; // Pushed just before close
+                    return false;
+                }
+                if (++spin < SPINS) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                std::unique_lock<std::mutex> lock(mutex);
+                parkedConsumers.fetch_add(1);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                bool popped = false;
+                notEmpty.wait_for(lock, std::chrono::milliseconds(1), [&] {
+                    popped = queue.tryPop(value);
+                    return popped || closed.load(std::memory_order_acquire);
+                });
+                parkedConsumers.fetch_sub(1);
+                if (popped) break;
+            }
+            wake(parkedProducers, notFull);
+            return true;
+        }
+
+        void close() {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed.store(true, std::memory_order_release);
+            notEmpty.notify_all();
+        }
+
+    private:
+        void wake(std::atomic<int>& parked, std::condition_variable& cv) {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (parked.load() > 0) {
+                std::lock_guard<std::mutex> lock(mutex);
+                cv.notify_one();
+            }
+        }
+    };
+} // namespace detail
+
+
+// Items finished by PipelineFlow::runPipelined
+struct PipelineStats {
+    std::size_t items = 0;
+};
+
+// Flow over a linear chain in which every node is a pipeline stage with its own
+// threads, connected by bounded lock-free queues. runPipelined streams many contexts
+// through the chain, so context k+1 can be in stage 1 while context k is in stage 2.
+// Throughput approaches that of the slowest stage, and setStageParallelism adds
+// threads to a slow stage. Every context runs statelessly in its own RunFrame, as in
+// ParallelBatchFlow: nodes must not write members during a run, and a stage with more
+// than one thread runs its node concurrently. A context whose action has no successor
+// skips the remaining stages. The context namespace applies to every stage. Pipelined
+// runs do not record checkpoints or incremental steps and throw if either is set;
+// run() still executes one context as a plain Flow.
+class PipelineFlow : public Flow {
+protected:
+    std::vector<std::size_t> stageParallelism; // Indexed by stage; missing entries mean 1
+    std::size_t queueCapacity = 64;
 
 public:
-    // Prevent calling the regular post method directly for BatchFlow
-    std::optional<std::string> post(Context& /*sharedContext*/, const std::nullptr_t& /*prepResult*/, const std::optional<std::string>& /*execResult*/) final override {
-         throw std::logic_error("Use postBatch for BatchFlow, not post.");
+    PipelineFlow() = default;
+    explicit PipelineFlow(std::shared_ptr<IBaseNode> start) : Flow(std::move(start)) {}
+    virtual ~PipelineFlow() override = default;
+
+    // Threads for stage `stage` (0 = the start node)
+    PipelineFlow& setStageParallelism(std::size_t stage, std::size_t threads) {
+        if (threads == 0) throw std::invalid_argument("Stage parallelism must be at least 1");
+        if (stageParallelism.size() <= stage) stageParallelism.resize(stage + 1, 1);
+        stageParallelism[stage] = threads;
+        return *this;
+    }
+
+    // Contexts each inter-stage queue holds before its producer blocks
+    PipelineFlow& setQueueCapacity(std::size_t items) {
+        if (items == 0) throw std::invalid_argument("Queue capacity must be at least 1");
+        queueCapacity = items;
+        return *this;
+    }
+
+    // The chain from the start node. Throws if a node has more than one successor or
+    // a successor is reached twice.
+    std::vector<std::shared_ptr<IBaseNode>> stages() const {
+        std::vector<std::shared_ptr<IBaseNode>> chain;
+        std::shared_ptr<IBaseNode> node = startNode;
+        while (node) {
+            if (std::find(chain.begin(), chain.end(), node) != chain.end()) {
+                throw CognitoFlowException("PipelineFlow needs a linear chain, but node " + node->getClassName() + " is reached twice");
+            }
+            chain.push_back(node);
+            std::shared_ptr<IBaseNode> next;
+            for (const auto& successor : node->getSuccessors()) {
+                if (next && successor.second != next) {
+                    throw CognitoFlowException("PipelineFlow needs a linear chain, but node " + node->getClassName() + " has several successors");
+                }
+                next = successor.second;
+            }
+            node = next;
+        }
+        return chain;
+    }
+
+    // Pulls contexts from `source` and streams them through the stages. sink(context,
+    // lastAction) is called on the calling thread for every finished context, in
+    // completion order. If a node, the source or the sink throws, no more contexts are
+    // pulled, and the first exception is rethrown once the pipeline has drained.
+    PipelineStats runPipelined(ItemSource<Context>& source,
+                               const std::function<void(Context&, const std::optional<std::string>&)>& sink) {
+        std::vector<Context> chunk;
+        std::size_t taken = 0;
+        return runStages(
+            [&](Item& item) {
+                if (taken == chunk.size()) {
+                    chunk.clear();
+                    taken = 0;
+                    if (source.pull(chunk, queueCapacity) == 0) return false;
+                }
+                item.owned = std::move(chunk[taken++]);
+                item.context = &item.owned;
+                return true;
+            },
+            [&](Item& item) { sink(*item.context, item.action); });
+    }
+
+    // Runs every context through the pipeline in place; returns each one's last action
+    std::vector<std::optional<std::string>> runAll(std::vector<Context>& contexts) {
+        std::vector<std::optional<std::string>> actions(contexts.size());
+        std::size_t next = 0;
+        runStages(
+            [&](Item& item) {
+                if (next == contexts.size()) return false;
+                item.index = next;
+                item.context = &contexts[next++];
+                return true;
+            },
+            [&](Item& item) { actions[item.index] = std::move(item.action); });
+        return actions;
+    }
+
+protected:
+    struct Item {
+        Context owned;              // Storage when the pipeline owns the context
+        Context* context = nullptr;
+        std::size_t index = 0;
+        RunFrame frame;
+        std::optional<std::string> action;
+        bool finished = false;      // Ended early or failed: later stages pass it on
+
+        Item(const Params& params, RunFrame* parent) : frame(params, parent) {}
+    };
+
+    // Feeds items from fill() through the stages on their own threads while this thread
+    // hands finished items to complete()
+    PipelineStats runStages(const std::function<bool(Item&)>& fill, const std::function<void(Item&)>& complete) {
+        if (checkpoint || incremental) {
+            throw std::logic_error("PipelineFlow cannot pipeline runs with a checkpoint log or incremental re-runs; use run()");
+        }
+        std::vector<std::shared_ptr<IBaseNode>> chain = stages();
+        if (chain.empty()) {
+            static LogSite site;
+            logWarn(site, [] { return std::string("Flow started with no start node."); });
+            return PipelineStats();
+        }
+
+        struct Shared {
+            std::vector<std::unique_ptr<detail::PipeChannel<Item*>>> channels; // channels[i] feeds stage i; the last one completes
+            std::vector<std::atomic<std::size_t>> running;                     // Live threads per stage
+            std::atomic<bool> failed{false};
+            std::mutex errorMutex;
+            std::exception_ptr firstError;
+
+            explicit Shared(std::size_t stageCount) : running(stageCount) {}
+
+            void fail(std::exception_ptr error) {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!firstError) firstError = std::move(error);
+                failed = true;
+            }
+        };
+        Shared shared(chain.size());
+        for (std::size_t i = 0; i <= chain.size(); ++i) {
+            shared.channels.push_back(std::make_unique<detail::PipeChannel<Item*>>(queueCapacity));
+        }
+
+        const Params runParams = getParams();
+        RunFrame* outerFrame = detail::currentFrame();
+        Executor* runExecutor = executor ? executor.get() : detail::currentExecutor();
+        std::chrono::steady_clock::time_point deadline = detail::currentDeadline();
+        if (runTimeout.count() > 0) deadline = std::min(deadline, std::chrono::steady_clock::now() + runTimeout);
+
+        std::vector<std::thread> threads;
+        threads.emplace_back([&] {
+            detail::ScopedDeadline deadlineScope(deadline);
+            while (!shared.failed.load(std::memory_order_relaxed)) {
+                auto item = std::make_unique<Item>(runParams, outerFrame);
+                try {
+                    if (!fill(*item)) break;
+                } catch (...) {
+                    shared.fail(std::current_exception());
+                    break;
+                }
+                shared.channels[0]->push(item.release());
+            }
+            shared.channels[0]->close();
+        });
+        for (std::size_t stage = 0; stage < chain.size(); ++stage) {
+            std::size_t threadCount = stage < stageParallelism.size() ? stageParallelism[stage] : 1;
+            shared.running[stage] = threadCount;
+            for (std::size_t t = 0; t < threadCount; ++t) {
+                threads.emplace_back([&, stage] {
+                    detail::ScopedExecutor executorScope(runExecutor);
+                    detail::ScopedDeadline deadlineScope(deadline);
+                    IBaseNode* node = chain[stage].get();
+                    Item* item;
+                    while (shared.channels[stage]->pop(item)) {
+                        if (!item->finished && shared.failed.load(std::memory_order_relaxed)) item->finished = true;
+                        if (!item->finished) {
+                            try {
+                                detail::checkDeadline(node);
+                                std::optional<ContextNamespace> keyScope;
+                                if (!contextNamespace.empty()) keyScope.emplace(*item->context, contextNamespace);
+                                item->action = node->internalRun(*item->context, item->frame);
+                                if (!node->getNextNode(item->action)) item->finished = true;
+                            } catch (...) {
+                                shared.fail(std::current_exception());
+                                item->finished = true;
+                            }
+                        }
+                        shared.channels[stage + 1]->push(item);
+                    }
+                    if (shared.running[stage].fetch_sub(1) == 1) shared.channels[stage + 1]->close();
+                });
+            }
+        }
+
+        PipelineStats stats;
+        Item* item;
+        while (shared.channels.back()->pop(item)) {
+            std::unique_ptr<Item> done(item);
+            if (shared.failed.load(std::memory_order_relaxed)) continue;
+            try {
+                complete(*done);
+                ++stats.items;
+            } catch (...) {
+                shared.fail(std::current_exception());
+            }
+        }
+        for (auto& thread : threads) thread.join();
+        if (shared.firstError) std::rethrow_exception(shared.firstError);
+        return stats;
+    }
+};
+
+
+// --- Static Flow ---
+// Flow whose graph is fixed at compile time. The nodes are held by value in one object,
+// and each step calls the node's internalRun directly (no virtual dispatch, no
+// shared_ptr, no successor map lookup). Routing is a switch over constexpr action
+// hashes, and the compiler can inline the whole chain into one loop. Declare the node
+// classes `final` so that their prep/exec/post calls are devirtualized too.
+//
+//     StaticFlow<SetNumberNode, AddNumberNode, ResultCaptureNode> flow;        // a chain
+//     StaticFlow<Step<Check, On<actionHash("retry"), 0>, On<actionHash("fail"), StaticFlowEnd>>,
+//                Compute, Report> routed;
+//
+// The default action moves to the next step (or ends after the last one), unless a
+// step declares OnDefault<Target>. An action without a route ends the run, as in Flow.
+// Actions are matched by their 64-bit hash only. A step whose postAction returns an
+// Action token is routed on the hash stored with the token, so the step does no string
+// work; a step that answers with a post() string has that string hashed. The run's
+// final action is turned into a string once, at the end. Configure nodes through node<I>().
+// Params set on the flow are handed to every node at the start of a stateful run.
+// Inside a RunFrame the nodes read the frame's params instead and are never written.
+constexpr std::size_t StaticFlowEnd = static_cast<std::size_t>(-1);
+
+constexpr std::uint64_t actionHash(std::string_view action) { return detail::hashKey(action); }
+
+// Route for the action whose actionHash is ActionHash
+template <std::uint64_t ActionHash, std::size_t Target>
+struct On {
+    static constexpr bool isAction = true;
+    static constexpr std::uint64_t hash = ActionHash;
+    static constexpr std::size_t target = Target;
+};
+
+// Where the default (nullopt) action goes from this step
+template <std::size_t Target>
+struct OnDefault {
+    static constexpr bool isAction = false;
+    static constexpr std::uint64_t hash = 0;
+    static constexpr std::size_t target = Target;
+};
+
+template <typename NodeT, typename... Routes>
+struct Step {};
+
+namespace detail {
+    template <typename S>
+    struct StaticStep {
+        using Node = S;
+        using Routes = std::tuple<>;
+    };
+
+    template <typename NodeT, typename... StepRoutes>
+    struct StaticStep<Step<NodeT, StepRoutes...>> {
+        using Node = NodeT;
+        using Routes = std::tuple<StepRoutes...>;
+    };
+
+    template <std::size_t Index, std::size_t Count, typename... Routes>
+    constexpr std::size_t staticDefaultTarget(std::tuple<Routes...>*) {
+        std::size_t target = Index + 1 < Count ? Index + 1 : StaticFlowEnd;
+        ((Routes::isAction ? void() : void(target = Routes::target)), ...);
+        return target;
+    }
+
+    template <std::size_t Count, typename... Routes>
+    constexpr bool staticRoutesValid(std::tuple<Routes...>*) {
+        return ((Routes::target < Count || Routes::target == StaticFlowEnd) && ...);
+    }
+
+    template <typename... Routes>
+    std::size_t staticActionTarget([[maybe_unused]] std::uint64_t hash, bool& matched, std::tuple<Routes...>*) {
+        std::size_t target = StaticFlowEnd;
+        matched = ((Routes::isAction && Routes::hash == hash ? (target = Routes::target, true) : false) || ...);
+        return target;
+    }
+} // namespace detail
+
+template <typename... Steps>
+class StaticFlow : public BaseNode<std::nullptr_t, std::optional<std::string>> {
+    static_assert(sizeof...(Steps) > 0, "StaticFlow needs at least one step");
+
+    using StepList = std::tuple<Steps...>;
+    template <std::size_t I>
+    using RoutesOf = typename detail::StaticStep<std::tuple_element_t<I, StepList>>::Routes;
+
+    std::tuple<typename detail::StaticStep<Steps>::Node...> nodes;
+
+public:
+    static constexpr std::size_t stepCount = sizeof...(Steps);
+
+    StaticFlow() = default;
+    virtual ~StaticFlow() override = default;
+
+    template <std::size_t I>
+    auto& node() { return std::get<I>(nodes); }
+
+    template <std::size_t I>
+    const auto& node() const { return std::get<I>(nodes); }
+
+    std::optional<std::string> exec(std::nullptr_t /*prepResult*/) final override {
+        throw std::logic_error("StaticFlow::exec() is internal and should not be called directly. Use run().");
+    }
+
+    // Default returns the final action of the run, like Flow
+    std::optional<std::string> post(Context& /*sharedContext*/, const std::nullptr_t& /*prepResult*/, const std::optional<std::string>& execResult) override {
+        return execResult;
+    }
+
+    std::optional<std::string> internalRun(Context& sharedContext) override {
+        detail::NodeTrace trace(this);
+        [[maybe_unused]] std::nullptr_t prepRes = prep(sharedContext);
+        trace.stageDone(TraceStage::Prep);
+        if (!detail::currentFrame()) {
+            std::apply([&](auto&... stepNodes) { (stepNodes.setParamsInternal(params), ...); }, nodes);
+        }
+        std::optional<std::string> result = runSteps(sharedContext, std::make_index_sequence<stepCount>{});
+        trace.stageDone(TraceStage::Exec);
+        std::optional<std::string> action = post(sharedContext, nullptr, result);
+        trace.stageDone(TraceStage::Post);
+        trace.finish(action);
+        return action;
+    }
+
+private:
+    template <std::size_t... Is>
+    std::optional<std::string> runSteps(Context& sharedContext, std::index_sequence<Is...>) {
+        static_assert((detail::staticRoutesValid<stepCount>(static_cast<RoutesOf<Is>*>(nullptr)) && ...),
+                      "StaticFlow route target out of range");
+        std::optional<std::string> action;
+        Action token = Action::unset(); // Set when the last step answered with a token
+        std::size_t current = 0;
+        while (current != StaticFlowEnd) {
+            // Compiles to a jump table over the inlined steps
+            ((current == Is ? (current = runStep<Is>(sharedContext, action, token), true) : false) || ...);
+        }
+        if (!token.isUnset()) action = token.toOptional();
+        return action;
+    }
+
+    template <std::size_t I>
+    std::size_t runStep(Context& sharedContext, std::optional<std::string>& action, Action& token) {
+        auto& stepNode = std::get<I>(nodes);
+        using NodeT = std::decay_t<decltype(stepNode)>;
+        detail::checkDeadline(&stepNode);
+        token = detail::runForToken(&stepNode, action, [&] {
+            return stepNode.NodeT::internalRun(sharedContext); // Qualified: no virtual dispatch
+        });
+
+        using Routes = RoutesOf<I>;
+        constexpr std::size_t defaultTarget = detail::staticDefaultTarget<I, stepCount>(static_cast<Routes*>(nullptr));
+        const bool isToken = !token.isUnset();
+        if (isToken ? token.isDefault() : !action) return defaultTarget;
+        bool matched = false;
+        std::size_t target = detail::staticActionTarget(isToken ? token.hash() : detail::hashKey(*action), matched, static_cast<Routes*>(nullptr));
+        if (!matched && (defaultTarget != StaticFlowEnd || std::tuple_size_v<Routes> > 0)) {
+            static LogSite site;
+            logWarn(site, [&] {
+                const std::string& name = isToken ? token.name() : *action;
+                return "Flow might end: Action '" + name + "' has no route from step " + std::to_string(I) + " (" + stepNode.getClassName() + ")";
+            });
+        }
+        return target;
     }
 };
 
@@ -0,0 +1,324 @@
+// Micro-benchmarks for CognitoFlow's own orchestration overhead.
+// Every node here does (almost) no work, so the timings measure the framework:
+// per node, per transition, per retry, per batch item and per context access.
+#include "Cognitoflow.h"
+
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace cognitoflow;
+
+namespace {
+
+// --- Benchmark Nodes ---
+
+// Does nothing; follows the default action
+class NoOpNode : public Node<std::nullptr_t, std::nullptr_t> {
+public:
+    std::nullptr_t exec(std::nullptr_t) override { return nullptr; }
+};
+
+// NoOpNode the compiler can devirtualize inside a StaticFlow
+class FinalNoOpNode final : public Node<std::nullptr_t, std::nullptr_t> {
+public:
+    std::nullptr_t exec(std::nullptr_t) override { return nullptr; }
+};
+
+// Returns one of `width` actions in turn, to exercise named transitions
+class RouterNode : public Node<std::nullptr_t, int> {
+    int width;
+    int nextAction = 0;
+    std::vector<std::string> actions;
+public:
+    explicit RouterNode(int actionCount) : width(actionCount) {
+        for (int i = 0; i < width; ++i) actions.push_back("route_" + std::to_string(i));
+    }
+    int exec(std::nullptr_t) override {
+        nextAction = (nextAction + 1) % width;
+        return nextAction;
+    }
+    std::optional<std::string> post(Context&, const std::nullptr_t&, const int& e) override {
+        return actions[static_cast<std::size_t>(e)];
+    }
+    const std::string& action(int i) const { return actions[static_cast<std::size_t>(i)]; }
+};
+
+// RouterNode returning interned Action tokens instead of strings
+class TokenRouterNode : public Node<std::nullptr_t, int> {
+    int width;
+    int nextAction = 0;
+    std::vector<Action> actions;
+public:
+    explicit TokenRouterNode(int actionCount) : width(actionCount) {
+        for (int i = 0; i < width; ++i) actions.emplace_back("route_" + std::to_string(i));
+    }
+    int exec(std::nullptr_t) override {
+        nextAction = (nextAction + 1) % width;
+        return nextAction;
+    }
+    Action postAction(Context&, const std::nullptr_t&, const int& e) override {
+        return actions[static_cast<std::size_t>(e)];
+    }
+    Action action(int i) const { return actions[static_cast<std::size_t>(i)]; }
+};
+
+// Fails the first `failures` attempts of every run, then succeeds
+class FlakyNode : public Node<std::nullptr_t, int> {
+    int failures;
+public:
+    FlakyNode(int failuresPerRun) : Node<std::nullptr_t, int>(failuresPerRun + 1, 0), failures(failuresPerRun) {}
+    int exec(std::nullptr_t) override {
+        if (getCurrentRetry() < failures) throw std::runtime_error("flaky");
+        return 1;
+    }
+};
+
+class TrivialBatchNode : public BatchNode<int, int> {
+    std::size_t itemCount;
+public:
+    explicit TrivialBatchNode(std::size_t items) : itemCount(items) {}
+    std::vector<int> prep(Context&) override { return std::vector<int>(itemCount, 1); }
+    int execItem(const int& item) override { return item + 1; }
+};
+
+class TrivialParallelBatchNode : public ParallelBatchNode<int, int> {
+    std::size_t itemCount;
+public:
+    explicit TrivialParallelBatchNode(std::size_t items) : itemCount(items) {}
+    std::vector<int> prep(Context&) override { return std::vector<int>(itemCount, 1); }
+    int execItem(const int& item) override { return item + 1; }
+};
+
+// Reads a param and writes one context key per batch entry
+class ParamEchoNode : public Node<int, int> {
+public:
+    int prep(Context&) override { return getParamOrDefault<int>("index", 0); }
+    int exec(int index) override { return index; }
+    std::optional<std::string> post(Context& ctx, const int&, const int& e) override {
+        ctx["last"] = e;
+        return std::nullopt;
+    }
+};
+
+template <typename BASE>
+class FanOutFlow : public BASE {
+    int entries;
+public:
+    FanOutFlow(std::shared_ptr<IBaseNode> start, int batchEntries) : BASE(std::move(start)), entries(batchEntries) {}
+    std::vector<Params> prepBatch(Context&) override {
+        std::vector<Params> batch;
+        batch.reserve(static_cast<std::size_t>(entries));
+        for (int i = 0; i < entries; ++i) batch.push_back(Params{{"index", i}});
+        return batch;
+    }
+    std::optional<std::string> postBatch(Context&, const std::vector<Params>&) override { return std::nullopt; }
+};
+
+// Performs `accesses` read-modify-write cycles on the context, by string or typed key
+class ContextStringNode : public Node<std::nullptr_t, std::nullptr_t> {
+    int accesses;
+    std::vector<std::string> keys;
+public:
+    ContextStringNode(int accessCount, int keyCount) : accesses(accessCount) {
+        for (int i = 0; i < keyCount; ++i) keys.push_back("key_" + std::to_string(i));
+    }
+    std::nullptr_t exec(std::nullptr_t) override { return nullptr; }
+    std::optional<std::string> post(Context& ctx, const std::nullptr_t&, const std::nullptr_t&) override {
+        for (int i = 0; i < accesses; ++i) {
+            const std::string& key = keys[static_cast<std::size_t>(i) % keys.size()];
+            auto it = ctx.find(key);
+            int value = it == ctx.end() ? 0 : std::any_cast<int>(it->second);
+            ctx[key] = value + 1;
+        }
+        return std::nullopt;
+    }
+};
+
+class ContextTypedNode : public Node<std::nullptr_t, std::nullptr_t> {
+    int accesses;
+    std::vector<std::string> names;
+    std::vector<ContextKey<int>> keys;
+public:
+    ContextTypedNode(int accessCount, int keyCount) : accesses(accessCount) {
+        names.reserve(static_cast<std::size_t>(keyCount));
+        for (int i = 0; i < keyCount; ++i) names.push_back("key_" + std::to_string(i));
+        for (const auto& name : names) keys.emplace_back(name);
+    }
+    std::nullptr_t exec(std::nullptr_t) override { return nullptr; }
+    std::optional<std::string> post(Context& ctx, const std::nullptr_t&, const std::nullptr_t&) override {
+        for (int i = 0; i < accesses; ++i) {
+            const ContextKey<int>& key = keys[static_cast<std::size_t>(i) % keys.size()];
+            ctx.set(key, ctx.getOr(key, 0) + 1);
+        }
+        return std::nullopt;
+    }
+};
+
+std::shared_ptr<IBaseNode> buildChain(int length) {
+    auto start = std::make_shared<NoOpNode>();
+    std::shared_ptr<IBaseNode> tail = start;
+    for (int i = 1; i < length; ++i) {
+        tail = tail->next(std::make_shared<NoOpNode>());
+    }
+    return start;
+}
+
+// --- Benchmarks ---
+
+void BM_LinearChain(benchmark::State& state) {
+    const int length = static_cast<int>(state.range(0));
+    Flow flow(buildChain(length));
+    if (state.range(1)) flow.compile();
+    Context ctx;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(flow.run(ctx));
+    }
+    state.SetItemsProcessed(state.iterations() * length);
+    state.SetLabel(state.range(1) ? "compiled" : "dynamic");
+}
+BENCHMARK(BM_LinearChain)->ArgsProduct({{1, 8, 64, 512}, {0, 1}});
+
+// `depth` flows nested in each other around a 2-node chain, run as nodes or inlined
+void BM_NestedFlows(benchmark::State& state) {
+    const int depth = static_cast<int>(state.range(0));
+    std::shared_ptr<Flow> flow = std::make_shared<Flow>(buildChain(2));
+    for (int level = 1; level < depth; ++level) {
+        flow->setInlinable(state.range(1) != 0);
+        flow = std::make_shared<Flow>(flow);
+    }
+    flow->compile();
+    Context ctx;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(flow->run(ctx));
+    }
+    state.SetItemsProcessed(state.iterations() * 2);
+    state.SetLabel(state.range(1) ? "inlined" : "nested");
+}
+BENCHMARK(BM_NestedFlows)->ArgsProduct({{1, 4, 16}, {0, 1}});
+
+// The 8-node chain of BM_LinearChain, fixed at compile time
+void BM_StaticChain(benchmark::State& state) {
+    using N = FinalNoOpNode;
+    StaticFlow<N, N, N, N, N, N, N, N> flow;
+    Context ctx;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(flow.run(ctx));
+    }
+    state.SetItemsProcessed(state.iterations() * 8);
+}
+BENCHMARK(BM_StaticChain);
+
+void BM_WideBranching(benchmark::State& state) {
+    const int width = static_cast<int>(state.range(0));
+    auto router = std::make_shared<RouterNode>(width);
+    for (int i = 0; i < width; ++i) {
+        router->next(std::make_shared<NoOpNode>(), router->action(i));
+    }
+    Flow flow(router);
+    if (state.range(1)) flow.compile();
+    Context ctx;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(flow.run(ctx));
+    }
+    state.SetItemsProcessed(state.iterations() * 2);
+    state.SetLabel(state.range(1) ? "compiled" : "dynamic");
+}
+BENCHMARK(BM_WideBranching)->ArgsProduct({{2, 16, 256}, {0, 1}});
+
+void BM_TokenBranching(benchmark::State& state) {
+    const int width = static_cast<int>(state.range(0));
+    auto router = std::make_shared<TokenRouterNode>(width);
+    for (int i = 0; i < width; ++i) {
+        router->next(std::make_shared<NoOpNode>(), router->action(i));
+    }
+    Flow flow(router);
+    flow.compile();
+    Context ctx;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(flow.run(ctx));
+    }
+    state.SetItemsProcessed(state.iterations() * 2);
+}
+BENCHMARK(BM_TokenBranching)->Arg(2)->Arg(16)->Arg(256);
+
+void BM_RetryPath(benchmark::State& state) {
+    const int failures = static_cast<int>(state.range(0));
+    auto node = std::make_shared<FlakyNode>(failures);
+    Context ctx;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(node->run(ctx));
+    }
+    state.SetItemsProcessed(state.iterations() * (failures + 1));
+}
+BENCHMARK(BM_RetryPath)->Arg(0)->Arg(1)->Arg(4);
+
+void BM_BatchNode(benchmark::State& state) {
+    auto node = std::make_shared<TrivialBatchNode>(static_cast<std::size_t>(state.range(0)));
+    Context ctx;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(node->run(ctx));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_BatchNode)->RangeMultiplier(10)->Range(1000, 1000000)->Unit(benchmark::kMicrosecond);
+
+void BM_ParallelBatchNode(benchmark::State& state) {
+    auto node = std::make_shared<TrivialParallelBatchNode>(static_cast<std::size_t>(state.range(0)));
+    Context ctx;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(node->run(ctx));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ParallelBatchNode)->RangeMultiplier(10)->Range(1000, 1000000)->Unit(benchmark::kMicrosecond);
+
+void BM_BatchFlowFanOut(benchmark::State& state) {
+    const int entries = static_cast<int>(state.range(0));
+    FanOutFlow<BatchFlow> flow(std::make_shared<ParamEchoNode>(), entries);
+    Context ctx;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(flow.run(ctx));
+    }
+    state.SetItemsProcessed(state.iterations() * entries);
+}
+BENCHMARK(BM_BatchFlowFanOut)->RangeMultiplier(10)->Range(10, 10000)->Unit(benchmark::kMicrosecond);
+
+void BM_ParallelBatchFlowFanOut(benchmark::State& state) {
+    const int entries = static_cast<int>(state.range(0));
+    FanOutFlow<ParallelBatchFlow> flow(std::make_shared<ParamEchoNode>(), entries);
+    Context ctx;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(flow.run(ctx));
+    }
+    state.SetItemsProcessed(state.iterations() * entries);
+}
+BENCHMARK(BM_ParallelBatchFlowFanOut)->RangeMultiplier(10)->Range(10, 10000)->Unit(benchmark::kMicrosecond);
+
+void BM_ContextStringKeys(benchmark::State& state) {
+    const int accesses = static_cast<int>(state.range(0));
+    auto node = std::make_shared<ContextStringNode>(accesses, static_cast<int>(state.range(1)));
+    Context ctx;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(node->run(ctx));
+    }
+    state.SetItemsProcessed(state.iterations() * accesses);
+}
+BENCHMARK(BM_ContextStringKeys)->ArgsProduct({{64}, {4, 64, 1024}});
+
+void BM_ContextTypedKeys(benchmark::State& state) {
+    const int accesses = static_cast<int>(state.range(0));
+    auto node = std::make_shared<ContextTypedNode>(accesses, static_cast<int>(state.range(1)));
+    Context ctx;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(node->run(ctx));
+    }
+    state.SetItemsProcessed(state.iterations() * accesses);
+}
+BENCHMARK(BM_ContextTypedKeys)->ArgsProduct({{64}, {4, 64, 1024}});
+
+} // namespace
+
+BENCHMARK_MAIN();
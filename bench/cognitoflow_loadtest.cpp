@@ -0,0 +1,728 @@
+// End-to-end load test for CognitoFlow orchestration.
+// Drives synthetic workloads through Flow, BatchFlow and BatchNode with configurable
+// node latency, injected failures (exercising Node retries and fallbacks), context
+// size and concurrency, and prints throughput, latency percentiles, allocations per
+// run and peak RSS as JSON. With --baseline=<previous report> it also acts as a
+// regression gate: the exit code is 2 if throughput dropped or allocations per run
+// grew by more than --max-regression. A baseline recorded with a different workload
+// configuration is refused.
+//
+//     ./cognitoflow_loadtest --workload=flow --runs=20000 --concurrency=4 --output=base.json
+//     ./cognitoflow_loadtest --workload=flow --runs=20000 --concurrency=4 --baseline=base.json
+#include "Cognitoflow.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define COGNITOFLOW_HAS_RUSAGE 1
+#include <sys/resource.h>
+#else
+#define COGNITOFLOW_HAS_RUSAGE 0
+#endif
+#if defined(_MSC_VER)
+#include <malloc.h> // _aligned_malloc: MSVC has no std::aligned_alloc
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace cognitoflow;
+
+// --- Allocation Counting ---
+// Every global operator new in the process is counted; the counts are read around
+// the measured phase only.
+namespace {
+std::atomic<std::uint64_t> allocationCount{0};
+std::atomic<std::uint64_t> allocationBytes{0};
+
+void* countedAllocate(std::size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocationBytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size == 0 ? 1 : size)) return memory;
+    throw std::bad_alloc();
+}
+
+void* countedAllocate(std::size_t size, std::align_val_t alignment) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocationBytes.fetch_add(size, std::memory_order_relaxed);
+    std::size_t align = static_cast<std::size_t>(alignment);
+    std::size_t rounded = (std::max<std::size_t>(size, 1) + align - 1) / align * align; // aligned_alloc needs a multiple
+#if defined(_MSC_VER)
+    if (void* memory = _aligned_malloc(rounded, align)) return memory;
+#else
+    if (void* memory = std::aligned_alloc(align, rounded)) return memory;
+#endif
+    throw std::bad_alloc();
+}
+
+void countedFreeAligned(void* memory) {
+#if defined(_MSC_VER)
+    _aligned_free(memory);
+#else
+    std::free(memory);
+#endif
+}
+} // namespace
+
+void* operator new(std::size_t size) { return countedAllocate(size); }
+void* operator new[](std::size_t size) { return countedAllocate(size); }
+void* operator new(std::size_t size, std::align_val_t alignment) { return countedAllocate(size, alignment); }
+void* operator new[](std::size_t size, std::align_val_t alignment) { return countedAllocate(size, alignment); }
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete[](void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, std::size_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, std::size_t) noexcept { std::free(memory); }
+void operator delete(void* memory, std::align_val_t) noexcept { countedFreeAligned(memory); }
+void operator delete[](void* memory, std::align_val_t) noexcept { countedFreeAligned(memory); }
+void operator delete(void* memory, std::size_t, std::align_val_t) noexcept { countedFreeAligned(memory); }
+void operator delete[](void* memory, std::size_t, std::align_val_t) noexcept { countedFreeAligned(memory); }
+
+namespace {
+
+// --- Configuration ---
+
+// Simulated time one node exec (or batch item) takes
+struct LatencySpec {
+    enum class Kind { None, Fixed, Uniform, LogNormal };
+    Kind kind = Kind::None;
+    double first = 0;  // Fixed: micros; Uniform: min micros; LogNormal: median micros
+    double second = 0; // Uniform: max micros; LogNormal: sigma
+    std::string text = "none";
+};
+
+struct LoadConfig {
+    std::vector<std::string> workloads{"flow", "batchflow", "batchnode"};
+    std::size_t runs = 2000;       // Measured runs per workload, over all threads
+    std::size_t warmup = 100;      // Unmeasured runs before each workload
+    std::size_t concurrency = 1;   // Threads issuing runs
+    std::size_t nodes = 8;         // Nodes per flow
+    std::size_t batchSize = 16;    // Parameter sets per BatchFlow run, items per BatchNode run
+    std::size_t contextKeys = 32;  // Entries in each run's context
+    LatencySpec latency;
+    bool spin = false;             // Busy-wait the latency instead of sleeping
+    double failureRate = 0;        // Probability that one exec attempt throws
+    int retries = 3;               // Node maxRetries
+    std::uint64_t seed = 1;
+    std::string outputPath;        // "" = stdout
+    std::string baselinePath;
+    double maxRegression = 0.10;
+};
+
+[[noreturn]] void usage(const std::string& problem) {
+    std::cerr << "cognitoflow_loadtest: " << problem << "\n"
+              << "options: --workload=flow,batchflow,batchnode --runs=N --warmup=N --concurrency=N\n"
+              << "         --nodes=N --batch-size=N --context-keys=N --retries=N --seed=N\n"
+              << "         --latency=none|fixed:US|uniform:MIN_US:MAX_US|lognormal:MEDIAN_US:SIGMA --spin\n"
+              << "         --failure-rate=P --output=FILE --baseline=FILE --max-regression=FRACTION\n";
+    std::exit(1);
+}
+
+std::vector<std::string> split(const std::string& text, char separator) {
+    std::vector<std::string> parts;
+    std::stringstream stream(text);
+    std::string part;
+    while (std::getline(stream, part, separator)) parts.push_back(part);
+    return parts;
+}
+
+double parseNumber(const std::string& text, const std::string& option) {
+    try {
+        std::size_t used = 0;
+        double value = std::stod(text, &used);
+        if (used == text.size() && value >= 0) return value;
+    } catch (const std::exception&) {
+    }
+    usage("invalid value '" + text + "' for " + option);
+}
+
+std::size_t parseCount(const std::string& text, const std::string& option, std::size_t minimum) {
+    double value = parseNumber(text, option);
+    if (value < static_cast<double>(minimum) || value != static_cast<double>(static_cast<std::size_t>(value))) {
+        usage(option + " must be an integer of at least " + std::to_string(minimum));
+    }
+    return static_cast<std::size_t>(value);
+}
+
+LatencySpec parseLatency(const std::string& text) {
+    LatencySpec spec;
+    spec.text = text;
+    std::vector<std::string> parts = split(text, ':');
+    if (parts.empty()) usage("empty --latency");
+    if (parts[0] == "none" && parts.size() == 1) return spec;
+    if (parts[0] == "fixed" && parts.size() == 2) {
+        spec.kind = LatencySpec::Kind::Fixed;
+        spec.first = parseNumber(parts[1], "--latency");
+    } else if (parts[0] == "uniform" && parts.size() == 3) {
+        spec.kind = LatencySpec::Kind::Uniform;
+        spec.first = parseNumber(parts[1], "--latency");
+        spec.second = parseNumber(parts[2], "--latency");
+        if (spec.second < spec.first) usage("uniform latency needs MIN_US <= MAX_US");
+    } else if (parts[0] == "lognormal" && parts.size() == 3) {
+        spec.kind = LatencySpec::Kind::LogNormal;
+        spec.first = parseNumber(parts[1], "--latency");
+        spec.second = parseNumber(parts[2], "--latency");
+        if (spec.first <= 0) usage("lognormal latency needs a positive median");
+    } else {
+        usage("unknown --latency '" + text + "'");
+    }
+    return spec;
+}
+
+LoadConfig parseArgs(int argc, char** argv) {
+    LoadConfig config;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        std::size_t equals = arg.find('=');
+        std::string name = arg.substr(0, equals);
+        std::string value = equals == std::string::npos ? std::string() : arg.substr(equals + 1);
+        if (name == "--spin" && equals == std::string::npos) {
+            config.spin = true;
+            continue;
+        }
+        if (equals == std::string::npos) usage("expected --option=value, got '" + arg + "'");
+        if (name == "--workload") {
+            config.workloads = split(value, ',');
+            for (const std::string& workload : config.workloads) {
+                if (workload != "flow" && workload != "batchflow" && workload != "batchnode") usage("unknown workload '" + workload + "'");
+            }
+        } else if (name == "--runs") {
+            config.runs = parseCount(value, name, 1);
+        } else if (name == "--warmup") {
+            config.warmup = parseCount(value, name, 0);
+        } else if (name == "--concurrency") {
+            config.concurrency = parseCount(value, name, 1);
+        } else if (name == "--nodes") {
+            config.nodes = parseCount(value, name, 1);
+        } else if (name == "--batch-size") {
+            config.batchSize = parseCount(value, name, 1);
+        } else if (name == "--context-keys") {
+            config.contextKeys = parseCount(value, name, 1);
+        } else if (name == "--retries") {
+            config.retries = static_cast<int>(parseCount(value, name, 1));
+        } else if (name == "--seed") {
+            config.seed = parseCount(value, name, 0);
+        } else if (name == "--latency") {
+            config.latency = parseLatency(value);
+        } else if (name == "--failure-rate") {
+            config.failureRate = parseNumber(value, name);
+            if (config.failureRate > 1) usage("--failure-rate must be in [0, 1]");
+        } else if (name == "--output") {
+            config.outputPath = value;
+        } else if (name == "--baseline") {
+            config.baselinePath = value;
+        } else if (name == "--max-regression") {
+            config.maxRegression = parseNumber(value, name);
+        } else {
+            usage("unknown option '" + name + "'");
+        }
+    }
+    return config;
+}
+
+// --- Simulated Work ---
+
+// Injected failures and fallbacks across all threads
+std::atomic<std::uint64_t> injectedFailures{0};
+std::atomic<std::uint64_t> fallbackCalls{0};
+
+// Per-thread source of latencies and failures, so threads do not contend on one RNG
+class WorkModel {
+    const LoadConfig& config;
+    std::mt19937_64 random;
+    std::uniform_real_distribution<double> unit{0.0, 1.0};
+    std::lognormal_distribution<double> lognormal;
+
+public:
+    WorkModel(const LoadConfig& loadConfig, std::uint64_t stream)
+        : config(loadConfig), random(loadConfig.seed * 1000003 + stream),
+          lognormal(std::log(std::max(loadConfig.latency.first, 1e-9)), loadConfig.latency.second) {}
+
+    // One exec attempt: waits out the latency, then throws with the failure rate
+    void attempt() {
+        double micros = 0;
+        switch (config.latency.kind) {
+        case LatencySpec::Kind::None: break;
+        case LatencySpec::Kind::Fixed: micros = config.latency.first; break;
+        case LatencySpec::Kind::Uniform: micros = config.latency.first + unit(random) * (config.latency.second - config.latency.first); break;
+        case LatencySpec::Kind::LogNormal: micros = lognormal(random); break;
+        }
+        if (micros > 0) wait(std::chrono::duration<double, std::micro>(micros));
+        if (config.failureRate > 0 && unit(random) < config.failureRate) {
+            injectedFailures.fetch_add(1, std::memory_order_relaxed);
+            throw std::runtime_error("injected failure");
+        }
+    }
+
+private:
+    void wait(std::chrono::duration<double, std::micro> duration) {
+        auto until = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(duration);
+        if (!config.spin) {
+            std::this_thread::sleep_until(until);
+            return;
+        }
+        while (std::chrono::steady_clock::now() < until) {
+        }
+    }
+};
+
+// The calling thread's work model; set by each load thread before it issues runs
+WorkModel*& threadModel() {
+    thread_local WorkModel* model = nullptr;
+    return model;
+}
+
+// --- Workload Nodes ---
+
+// Reads one context key, does the simulated work and writes the next key
+class WorkNode : public Node<int, int> {
+    std::string inKey;
+    std::string outKey;
+
+public:
+    WorkNode(int retries, std::string readKey, std::string writeKey)
+        : Node<int, int>(retries, 0), inKey(std::move(readKey)), outKey(std::move(writeKey)) {}
+
+    int prep(Context& sharedContext) override { return std::any_cast<int>(sharedContext.at(inKey)); }
+
+    int exec(int value) override {
+        threadModel()->attempt();
+        return value + 1;
+    }
+
+    int execFallback(int value, const std::exception&) override {
+        fallbackCalls.fetch_add(1, std::memory_order_relaxed);
+        return value;
+    }
+
+    std::optional<std::string> post(Context& sharedContext, const int&, const int& result) override {
+        sharedContext[outKey] = result;
+        return std::nullopt;
+    }
+};
+
+std::string contextKey(std::size_t index, std::size_t keyCount) { return "k" + std::to_string(index % keyCount); }
+
+std::shared_ptr<IBaseNode> buildChain(const LoadConfig& config) {
+    std::shared_ptr<IBaseNode> first;
+    std::shared_ptr<IBaseNode> previous;
+    for (std::size_t i = 0; i < config.nodes; ++i) {
+        auto node = std::make_shared<WorkNode>(config.retries, contextKey(i, config.contextKeys), contextKey(i + 1, config.contextKeys));
+        if (previous) {
+            previous->next(node);
+        } else {
+            first = node;
+        }
+        previous = node;
+    }
+    return first;
+}
+
+// Runs the chain once per parameter set
+class LoadBatchFlow : public BatchFlow {
+    std::size_t batchSize;
+
+public:
+    LoadBatchFlow(std::shared_ptr<IBaseNode> start, std::size_t batch) : BatchFlow(std::move(start)), batchSize(batch) {}
+
+    std::vector<Params> prepBatch(Context&) override {
+        std::vector<Params> batch;
+        batch.reserve(batchSize);
+        for (std::size_t i = 0; i < batchSize; ++i) batch.push_back(Params{{"item", static_cast<int>(i)}});
+        return batch;
+    }
+
+    std::optional<std::string> postBatch(Context&, const std::vector<Params>&) override { return std::nullopt; }
+};
+
+// Processes batchSize items per run with the simulated work per item
+class LoadBatchNode : public BatchNode<int, int> {
+    std::size_t batchSize;
+
+public:
+    LoadBatchNode(int retries, std::size_t batch) : BatchNode<int, int>(retries, 0), batchSize(batch) {}
+
+    std::vector<int> prep(Context& sharedContext) override {
+        return std::vector<int>(batchSize, std::any_cast<int>(sharedContext.at("k0")));
+    }
+
+    int execItem(const int& item) override {
+        threadModel()->attempt();
+        return item + 1;
+    }
+
+    int execItemFallback(const int& item, const std::exception&) override {
+        fallbackCalls.fetch_add(1, std::memory_order_relaxed);
+        return item;
+    }
+
+    std::optional<std::string> post(Context& sharedContext, const std::vector<int>&, const std::vector<int>& results) override {
+        sharedContext["k0"] = results.empty() ? 0 : results.back();
+        return std::nullopt;
+    }
+};
+
+// --- Measurement ---
+
+struct WorkloadResult {
+    std::string name;
+    std::size_t runs = 0;
+    std::size_t failedRuns = 0; // Runs that threw despite retries and fallbacks
+    double seconds = 0;
+    double throughput = 0;      // Runs per second
+    double meanMicros = 0;
+    double p50Micros = 0;
+    double p99Micros = 0;
+    double p999Micros = 0;
+    double maxMicros = 0;
+    double allocationsPerRun = 0;
+    double allocatedBytesPerRun = 0;
+    std::uint64_t injectedFailures = 0;
+    std::uint64_t fallbacks = 0;
+    long peakRssKb = -1; // Of the process so far; -1 where the platform has no getrusage
+};
+
+long peakRssKb() {
+#if COGNITOFLOW_HAS_RUSAGE
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+    return static_cast<long>(usage.ru_maxrss / 1024); // Bytes on macOS
+#else
+    return usage.ru_maxrss; // Kilobytes on Linux
+#endif
+#else
+    return -1;
+#endif
+}
+
+double percentile(const std::vector<double>& sorted, double fraction) {
+    if (sorted.empty()) return 0;
+    std::size_t index = static_cast<std::size_t>(fraction * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+// Issues config.runs runs from config.concurrency threads; makeRunner(thread) returns
+// the callable one thread invokes per run with a fresh copy of the template context
+template <typename MakeRunner>
+WorkloadResult measure(const std::string& name, const LoadConfig& config, MakeRunner&& makeRunner) {
+    Context templateContext;
+    templateContext.reserve(config.contextKeys);
+    for (std::size_t i = 0; i < config.contextKeys; ++i) templateContext[contextKey(i, config.contextKeys)] = static_cast<int>(i);
+
+    const std::size_t threads = config.concurrency;
+    std::vector<std::vector<double>> latencies(threads);
+    std::vector<std::size_t> failures(threads, 0);
+    std::atomic<std::size_t> ready{0};
+    std::atomic<bool> go{false};
+
+    auto body = [&](std::size_t thread) {
+        WorkModel model(config, thread);
+        threadModel() = &model;
+        auto runOnce = makeRunner(thread);
+        auto issue = [&]() {
+            Context context(templateContext);
+            try {
+                runOnce(context);
+                return true;
+            } catch (const std::exception&) {
+                return false; // Retries and fallback exhausted; counted, not fatal
+            }
+        };
+        for (std::size_t i = thread; i < config.warmup; i += threads) issue();
+        std::size_t share = config.runs / threads + (thread < config.runs % threads ? 1 : 0);
+        latencies[thread].reserve(share);
+        ready.fetch_add(1);
+        while (!go.load(std::memory_order_acquire)) std::this_thread::yield();
+        for (std::size_t i = 0; i < share; ++i) {
+            auto start = std::chrono::steady_clock::now();
+            if (!issue()) ++failures[thread];
+            latencies[thread].push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+        }
+        threadModel() = nullptr;
+    };
+
+    std::vector<std::thread> workers;
+    for (std::size_t t = 0; t < threads; ++t) workers.emplace_back(body, t);
+    // Counters and the clock start once every thread has warmed up, so warmup and
+    // per-thread setup are excluded from the report
+    while (ready.load() < threads) std::this_thread::yield();
+    injectedFailures.store(0);
+    fallbackCalls.store(0);
+    std::uint64_t allocationsBefore = allocationCount.load();
+    std::uint64_t bytesBefore = allocationBytes.load();
+    auto started = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    for (std::thread& worker : workers) worker.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    std::uint64_t allocations = allocationCount.load() - allocationsBefore;
+    std::uint64_t bytes = allocationBytes.load() - bytesBefore;
+
+    std::vector<double> all;
+    for (const std::vector<double>& perThread : latencies) all.insert(all.end(), perThread.begin(), perThread.end());
+    std::sort(all.begin(), all.end());
+
+    WorkloadResult result;
+    result.name = name;
+    result.runs = all.size();
+    for (std::size_t count : failures) result.failedRuns += count;
+    result.seconds = seconds;
+    result.throughput = seconds > 0 ? static_cast<double>(all.size()) / seconds : 0;
+    double total = 0;
+    for (double micros : all) total += micros;
+    result.meanMicros = total / static_cast<double>(all.size());
+    result.p50Micros = percentile(all, 0.50);
+    result.p99Micros = percentile(all, 0.99);
+    result.p999Micros = percentile(all, 0.999);
+    result.maxMicros = all.back();
+    result.allocationsPerRun = static_cast<double>(allocations) / static_cast<double>(all.size());
+    result.allocatedBytesPerRun = static_cast<double>(bytes) / static_cast<double>(all.size());
+    result.injectedFailures = injectedFailures.load();
+    result.fallbacks = fallbackCalls.load();
+    result.peakRssKb = peakRssKb();
+    return result;
+}
+
+WorkloadResult runWorkload(const std::string& name, const LoadConfig& config) {
+    if (name == "flow") {
+        // One compiled, stateless flow shared by every thread, as a server would
+        auto flow = std::make_shared<Flow>(buildChain(config));
+        flow->setExecutionMode(ExecutionMode::Stateless).compile();
+        return measure(name, config, [flow](std::size_t) {
+            return [flow](Context& context) { flow->run(context); };
+        });
+    }
+    if (name == "batchflow") {
+        // BatchFlow runs are stateful, so each thread gets its own instance
+        return measure(name, config, [&config](std::size_t) {
+            auto flow = std::make_shared<LoadBatchFlow>(buildChain(config), config.batchSize);
+            flow->compile();
+            return [flow](Context& context) { flow->run(context); };
+        });
+    }
+    return measure(name, config, [&config](std::size_t) {
+        auto node = std::make_shared<LoadBatchNode>(config.retries, config.batchSize);
+        return [node](Context& context) { node->run(context); };
+    });
+}
+
+// --- Report ---
+
+std::string jsonString(const std::string& text) {
+    std::string quoted = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') quoted += '\\';
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+std::string number(double value) {
+    char buffer[64];
+    std::snprintf(buffer, sizeof(buffer), "%.3f", value);
+    return buffer;
+}
+
+// One "config" field of the report as JSON; `compared` fields must match a baseline's
+struct ConfigField {
+    std::string key;
+    std::string value;
+    bool compared;
+};
+
+std::vector<ConfigField> configFields(const LoadConfig& config) {
+    return {
+        {"runs", std::to_string(config.runs), true},
+        {"warmup", std::to_string(config.warmup), false},
+        {"concurrency", std::to_string(config.concurrency), true},
+        {"nodes", std::to_string(config.nodes), true},
+        {"batch_size", std::to_string(config.batchSize), true},
+        {"context_keys", std::to_string(config.contextKeys), true},
+        {"latency", jsonString(config.latency.text), true},
+        {"latency_wait", jsonString(config.spin ? "spin" : "sleep"), true},
+        {"failure_rate", number(config.failureRate), true},
+        {"retries", std::to_string(config.retries), true},
+        {"seed", std::to_string(config.seed), false},
+        {"tracing", Tracer::compiledIn() ? "true" : "false", true},
+    };
+}
+
+// Throughput and allocations of each workload in a previous report. Only reads the
+// format this program writes: one workload object per "name" key.
+struct BaselineEntry {
+    std::string name;
+    double throughput = 0;
+    double allocationsPerRun = 0;
+};
+
+struct Baseline {
+    std::string configText; // The report's "config" object
+    std::vector<BaselineEntry> workloads;
+};
+
+// Raw JSON value of `key` in a flat object as this program writes it
+std::optional<std::string> fieldValue(const std::string& object, const std::string& key) {
+    std::string marker = "\"" + key + "\": ";
+    std::size_t at = object.find(marker);
+    if (at == std::string::npos) return std::nullopt;
+    std::size_t start = at + marker.size();
+    std::size_t end = object.find_first_of(",\n}", start);
+    return object.substr(start, end == std::string::npos ? std::string::npos : end - start);
+}
+
+// Compared config fields whose value differs from the baseline's, as "key: baseline vs current"
+std::vector<std::string> configMismatches(const LoadConfig& config, const Baseline& baseline) {
+    std::vector<std::string> mismatches;
+    for (const ConfigField& field : configFields(config)) {
+        if (!field.compared) continue;
+        std::optional<std::string> recorded = fieldValue(baseline.configText, field.key);
+        if (!recorded || *recorded != field.value) {
+            mismatches.push_back(field.key + ": " + recorded.value_or("missing") + " vs " + field.value);
+        }
+    }
+    return mismatches;
+}
+
+std::optional<double> numberAfter(const std::string& text, std::size_t from, std::size_t until, const std::string& key) {
+    std::size_t at = text.find("\"" + key + "\":", from);
+    if (at == std::string::npos || at >= until) return std::nullopt;
+    return std::strtod(text.c_str() + at + key.size() + 3, nullptr);
+}
+
+Baseline readBaseline(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) usage("cannot read baseline '" + path + "'");
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    const std::string text = buffer.str();
+    Baseline baseline;
+    std::size_t configStart = text.find("\"config\": {");
+    std::size_t configEnd = configStart == std::string::npos ? std::string::npos : text.find('}', configStart);
+    if (configEnd == std::string::npos) usage("baseline '" + path + "' has no config");
+    baseline.configText = text.substr(configStart, configEnd + 1 - configStart);
+    std::vector<BaselineEntry>& entries = baseline.workloads;
+    const std::string marker = "\"name\": \"";
+    for (std::size_t at = text.find(marker); at != std::string::npos;) {
+        std::size_t nameStart = at + marker.size();
+        std::size_t nameEnd = text.find('"', nameStart);
+        std::size_t next = text.find(marker, nameEnd);
+        std::size_t until = next == std::string::npos ? text.size() : next;
+        BaselineEntry entry;
+        entry.name = text.substr(nameStart, nameEnd - nameStart);
+        std::optional<double> throughput = numberAfter(text, nameEnd, until, "throughput_runs_per_sec");
+        std::optional<double> allocations = numberAfter(text, nameEnd, until, "allocations_per_run");
+        if (throughput && allocations) {
+            entry.throughput = *throughput;
+            entry.allocationsPerRun = *allocations;
+            entries.push_back(entry);
+        }
+        at = next;
+    }
+    return baseline;
+}
+
+std::vector<std::string> findRegressions(const std::vector<WorkloadResult>& results, const std::vector<BaselineEntry>& baseline, double tolerance) {
+    std::vector<std::string> regressions;
+    for (const WorkloadResult& result : results) {
+        for (const BaselineEntry& entry : baseline) {
+            if (entry.name != result.name) continue;
+            if (result.throughput < entry.throughput * (1 - tolerance)) {
+                regressions.push_back(result.name + ": throughput " + number(result.throughput) + " runs/s vs baseline " + number(entry.throughput));
+            }
+            // An allocation-free baseline still tolerates a fraction of one allocation per run
+            if (result.allocationsPerRun > entry.allocationsPerRun * (1 + tolerance) + 0.5) {
+                regressions.push_back(result.name + ": " + number(result.allocationsPerRun) + " allocations/run vs baseline " + number(entry.allocationsPerRun));
+            }
+        }
+    }
+    return regressions;
+}
+
+std::string report(const LoadConfig& config, const std::vector<WorkloadResult>& results, const std::vector<std::string>* regressions) {
+    std::ostringstream out;
+    out << "{\n";
+    out << "  \"config\": {\n";
+    std::vector<ConfigField> fields = configFields(config);
+    for (std::size_t i = 0; i < fields.size(); ++i) {
+        out << "    \"" << fields[i].key << "\": " << fields[i].value << (i + 1 < fields.size() ? "," : "") << "\n";
+    }
+    out << "  },\n";
+    out << "  \"workloads\": [\n";
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        const WorkloadResult& r = results[i];
+        out << "    {\n";
+        out << "      \"name\": " << jsonString(r.name) << ",\n";
+        out << "      \"runs\": " << r.runs << ",\n";
+        out << "      \"failed_runs\": " << r.failedRuns << ",\n";
+        out << "      \"seconds\": " << number(r.seconds) << ",\n";
+        out << "      \"throughput_runs_per_sec\": " << number(r.throughput) << ",\n";
+        out << "      \"latency_us\": {\"mean\": " << number(r.meanMicros) << ", \"p50\": " << number(r.p50Micros)
+            << ", \"p99\": " << number(r.p99Micros) << ", \"p999\": " << number(r.p999Micros) << ", \"max\": " << number(r.maxMicros) << "},\n";
+        out << "      \"allocations_per_run\": " << number(r.allocationsPerRun) << ",\n";
+        out << "      \"allocated_bytes_per_run\": " << number(r.allocatedBytesPerRun) << ",\n";
+        out << "      \"injected_failures\": " << r.injectedFailures << ",\n";
+        out << "      \"fallbacks\": " << r.fallbacks << ",\n";
+        out << "      \"peak_rss_kb\": " << (r.peakRssKb < 0 ? std::string("null") : std::to_string(r.peakRssKb)) << "\n";
+        out << "    }" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]";
+    if (regressions) {
+        out << ",\n  \"baseline\": " << jsonString(config.baselinePath) << ",\n";
+        out << "  \"max_regression\": " << number(config.maxRegression) << ",\n";
+        out << "  \"regressions\": [";
+        for (std::size_t i = 0; i < regressions->size(); ++i) {
+            out << (i ? ", " : "") << jsonString((*regressions)[i]);
+        }
+        out << "]";
+    }
+    out << "\n}\n";
+    return out.str();
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    LoadConfig config = parseArgs(argc, argv);
+    Baseline baseline;
+    if (!config.baselinePath.empty()) {
+        baseline = readBaseline(config.baselinePath);
+        // Throughput is only comparable for the same workload shape
+        std::vector<std::string> mismatches = configMismatches(config, baseline);
+        if (!mismatches.empty()) {
+            std::cerr << "cognitoflow_loadtest: baseline '" << config.baselinePath << "' was recorded with a different configuration (baseline vs current):\n";
+            for (const std::string& mismatch : mismatches) std::cerr << "    " << mismatch << "\n";
+            return 1;
+        }
+    }
+
+    // Injected failures are expected; keep the retry warnings out of the report
+    Logger::instance().setLevel(LogLevel::Error);
+
+    std::vector<WorkloadResult> results;
+    for (const std::string& workload : config.workloads) {
+        results.push_back(runWorkload(workload, config));
+    }
+
+    std::vector<std::string> regressions;
+    if (!config.baselinePath.empty()) regressions = findRegressions(results, baseline.workloads, config.maxRegression);
+    std::string json = report(config, results, config.baselinePath.empty() ? nullptr : &regressions);
+
+    if (config.outputPath.empty()) {
+        std::cout << json;
+    } else {
+        std::ofstream file(config.outputPath);
+        if (!file) usage("cannot write '" + config.outputPath + "'");
+        file << json;
+    }
+    for (const std::string& regression : regressions) std::cerr << "regression: " << regression << "\n";
+    return regressions.empty() ? 0 : 2;
+}
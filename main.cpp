@@ -1,9 +1,12 @@
-#include "cognitoflow.h"
+#include "Cognitoflow.h"
 #include <iostream>
 #include <string>
 #include <vector>
 #include <map>
 #include <memory> // For std::make_shared
+#include <cstdio> // For std::remove
+#include <stdexcept>
+#include <functional>
 
 // Use the namespace
 using namespace cognitoflow;
@@ -54,6 +57,9 @@ public:
 
 // --- Example Test Nodes mirroring Java Test ---
 
+// Typed, pre-hashed key for the value passed between the example nodes
+constexpr ContextKey<int> currentValueKey{"currentValue"};
+
 // P=nullptr_t, E=int
 class SetNumberNode : public Node<std::nullptr_t, int> {
     int number;
@@ -66,7 +72,7 @@ public:
     }
 
     std::optional<std::string> post(Context& ctx, const std::nullptr_t&, const int& e) override {
-        ctx["currentValue"] = e; // Store result in context
+        ctx.set(currentValueKey, e); // Store result in context
         return e > 20 ? std::make_optional("over_20") : std::nullopt; // Branching action
     }
 };
@@ -80,7 +86,7 @@ public:
     int prep(Context& ctx) override {
         // Get value from context, throw if not found or wrong type
         try {
-            return std::any_cast<int>(ctx.at("currentValue"));
+            return ctx.at(currentValueKey);
         } catch (const std::out_of_range& oor) {
             throw CognitoFlowException("Context missing 'currentValue' for AddNumberNode");
         } catch (const std::bad_any_cast& bac) {
@@ -93,7 +99,7 @@ public:
     }
 
     std::optional<std::string> post(Context& ctx, const int&, const int& e) override {
-        ctx["currentValue"] = e; // Update context
+        ctx.set(currentValueKey, e); // Update context
         return "added";          // Fixed action
     }
 };
@@ -125,6 +131,121 @@ public:
     // No post needed, default action (nullopt) is fine
 };
 
+// P=nullptr_t, E=nullptr_t; writes one int under a fixed key
+class WriteKeyNode : public Node<std::nullptr_t, std::nullptr_t> {
+    std::string key;
+    int value;
+public:
+    WriteKeyNode(std::string k, int v) : key(std::move(k)), value(v) {}
+
+    std::nullptr_t exec(std::nullptr_t) override { return nullptr; }
+
+    std::optional<std::string> post(Context& ctx, const std::nullptr_t&, const std::nullptr_t&) override {
+        ctx[key] = value;
+        return std::nullopt;
+    }
+};
+
+// P=nullptr_t, E=nullptr_t; replaces "tags" only when the "tags" param is set
+class TagsNode : public Node<std::nullptr_t, std::nullptr_t> {
+public:
+    std::nullptr_t exec(std::nullptr_t) override { return nullptr; }
+
+    std::optional<std::string> post(Context& ctx, const std::nullptr_t&, const std::nullptr_t&) override {
+        std::vector<int> tags = getParamOrDefault<std::vector<int>>("tags", {});
+        if (!tags.empty()) ctx["tags"] = tags;
+        return std::nullopt;
+    }
+};
+
+// Two parameter sets: the first writes tags {9, 9}, the second leaves them alone
+class TagsBatchFlow : public ParallelBatchFlow {
+public:
+    using ParallelBatchFlow::ParallelBatchFlow;
+
+    std::vector<Params> prepBatch(Context&) override {
+        return {Params{{"tags", std::vector<int>{9, 9}}}, Params{}};
+    }
+
+    std::optional<std::string> postBatch(Context&, const std::vector<Params>&) override { return std::nullopt; }
+};
+
+// P=nullptr_t, E=nullptr_t; counts its execs and fails the first `failures` of them
+class FlakyStepNode : public Node<std::nullptr_t, std::nullptr_t> {
+    int failures;
+public:
+    int executions = 0;
+
+    FlakyStepNode(int failCount = 0) : failures(failCount) {}
+
+    std::nullptr_t exec(std::nullptr_t) override {
+        if (++executions <= failures) throw std::runtime_error("step failed");
+        return nullptr;
+    }
+};
+
+// P=nullptr_t, E=int; stores ten times its "item" param under "item_<n>"
+class ShardItemNode : public Node<std::nullptr_t, int> {
+public:
+    int exec(std::nullptr_t) override { return getParamOrDefault<int>("item", 0) * 10; }
+
+    std::optional<std::string> post(Context& ctx, const std::nullptr_t&, const int& e) override {
+        ctx["item_" + std::to_string(e / 10)] = e;
+        return "stored";
+    }
+};
+
+// Four parameter sets, one per shard
+class ItemsDistributedFlow : public DistributedBatchFlow {
+public:
+    using DistributedBatchFlow::DistributedBatchFlow;
+
+    std::vector<Params> prepBatch(Context&) override {
+        std::vector<Params> batch;
+        for (int item = 0; item < 4; ++item) batch.push_back(Params{{"item", item}});
+        return batch;
+    }
+
+    std::optional<std::string> postBatch(Context&, const std::vector<Params>&) override { return std::nullopt; }
+};
+
+// In-process worker whose runner rejects every request, to exercise shard retries
+class CorruptingShardWorker : public InProcessShardWorker {
+public:
+    CorruptingShardWorker() : InProcessShardWorker("corrupting") {}
+
+    void send(std::string request, std::function<void(ShardReply)> done) override {
+        request[0] = 9; // Unsupported request version
+        InProcessShardWorker::send(std::move(request), std::move(done));
+    }
+};
+
+// P=int, E=int; writes the sum of its input keys to its output key
+class SumKeysNode : public Node<int, int> {
+    std::vector<std::string> inputs;
+    std::string output;
+public:
+    int executions = 0;
+
+    SumKeysNode(std::vector<std::string> in, std::string out) : inputs(std::move(in)), output(std::move(out)) {}
+
+    int prep(Context& ctx) override {
+        int sum = 0;
+        for (const auto& key : inputs) sum += std::any_cast<int>(ctx.at(key));
+        return sum;
+    }
+
+    int exec(int sum) override {
+        ++executions;
+        return sum;
+    }
+
+    std::optional<std::string> post(Context& ctx, const int&, const int& e) override {
+        ctx[output] = e;
+        return std::nullopt;
+    }
+};
+
 
 int main() {
     // --- Simple Workflow Example ---
@@ -162,6 +283,7 @@ int main() {
           ->next(capture, "added"); // addNum's "added" action connects to capture
 
      Flow linearFlow(setNum);
+     linearFlow.compile(); // Freeze the graph into index-based successor tables
      Context linearContext;
      linearFlow.run(linearContext);
 
@@ -213,5 +335,159 @@ int main() {
      std::cout << std::endl;
 
 
+    // --- Parallel Fork Test Example ---
+    // Each branch may write only its declared key; "tags" is left alone by both
+    std::cout << "--- Running Parallel Fork Test Workflow ---" << std::endl;
+    ParallelFlow forkFlow({ForkBranch(std::make_shared<WriteKeyNode>("a", 1), {"a"}),
+                           ForkBranch(std::make_shared<WriteKeyNode>("b", 2), {"b"})});
+    Context forkContext;
+    forkContext["tags"] = std::vector<int>{1, 2, 3};
+    forkFlow.run(forkContext);
+
+    std::cout << "Fork Test: 'a' + 'b': "
+              << std::any_cast<int>(forkContext.at("a")) + std::any_cast<int>(forkContext.at("b"))
+              << " (Expected: 3)" << std::endl;
+    std::cout << "Fork Test: 'tags' size: "
+              << std::any_cast<const std::vector<int>&>(forkContext.at("tags")).size()
+              << " (Expected: 3)" << std::endl;
+    std::cout << std::endl;
+
+
+    // --- Parallel Batch Flow Test Example ---
+    // The idle second run must not put the original tags back
+    std::cout << "--- Running Parallel Batch Flow Test Workflow ---" << std::endl;
+    TagsBatchFlow tagsFlow(std::make_shared<TagsNode>());
+    Context tagsContext;
+    tagsContext["tags"] = std::vector<int>{1};
+    tagsFlow.run(tagsContext);
+
+    std::cout << "Parallel Batch Test: 'tags' size: "
+              << std::any_cast<const std::vector<int>&>(tagsContext.at("tags")).size()
+              << " (Expected: 2)" << std::endl;
+    std::cout << std::endl;
+
+
+    // --- Snapshot Round Trip Test Example ---
+    std::cout << "--- Running Snapshot Round Trip Test ---" << std::endl;
+    Context snapshotSource;
+    snapshotSource["count"] = 42;
+    snapshotSource["name"] = std::string("cognito");
+    snapshotSource["weights"] = std::vector<float>{0.5f, 1.5f, 2.0f};
+    const std::string snapshotBytes = encodeSnapshot(snapshotSource);
+
+    SnapshotView snapshotView(snapshotBytes);
+    float weightSum = 0.0f;
+    for (float weight : snapshotView.getArray<float>("weights")) weightSum += weight;
+    Context snapshotCopy;
+    snapshotView.loadInto(snapshotCopy);
+    std::cout << "Snapshot Test: 'count': " << snapshotView.get<int>("count").value_or(-1)
+              << " (Expected: 42)" << std::endl;
+    std::cout << "Snapshot Test: 'name': " << snapshotView.getString("name")
+              << " (Expected: cognito)" << std::endl;
+    std::cout << "Snapshot Test: 'weights' sum: " << weightSum << " (Expected: 4)" << std::endl;
+    std::cout << "Snapshot Test: loaded 'weights' size: "
+              << std::any_cast<const std::vector<float>&>(snapshotCopy.at("weights")).size()
+              << " (Expected: 3)" << std::endl;
+
+    // Every prefix of the snapshot must be rejected, never read out of bounds
+    std::size_t rejectedPrefixes = 0;
+    for (std::size_t length = 0; length < snapshotBytes.size(); ++length) {
+        try {
+            Context truncatedCopy;
+            SnapshotView(std::string_view(snapshotBytes).substr(0, length)).loadInto(truncatedCopy);
+        } catch (const CognitoFlowException&) {
+            ++rejectedPrefixes;
+        }
+    }
+    std::cout << "Snapshot Test: rejected truncated snapshots: " << rejectedPrefixes << " of "
+              << snapshotBytes.size() << " (Expected: all)" << std::endl;
+
+    struct Unregistered {};
+    snapshotSource["opaque"] = Unregistered{};
+    try {
+        encodeSnapshot(snapshotSource);
+        std::cout << "Snapshot Test: unregistered type encoded (Expected: an error)" << std::endl;
+    } catch (const CognitoFlowException& e) {
+        std::cout << "Snapshot Test: unregistered type rejected: " << e.what() << std::endl;
+    }
+    std::cout << std::endl;
+
+
+    // --- Distributed Batch Flow Test Example ---
+    // Shards the corrupting worker fails are retried on the healthy one
+    std::cout << "--- Running Distributed Batch Flow Test Workflow ---" << std::endl;
+    FlowRegistry::instance().add("shard-items", [] { return std::make_shared<Flow>(std::make_shared<ShardItemNode>()); });
+    ItemsDistributedFlow distributedFlow("shard-items", {std::make_shared<CorruptingShardWorker>(),
+                                                         std::make_shared<InProcessShardWorker>("healthy")});
+    distributedFlow.setShardSize(1);
+    Context distributedContext;
+    distributedFlow.run(distributedContext);
+
+    int itemSum = 0;
+    for (int item = 0; item < 4; ++item) {
+        itemSum += std::any_cast<int>(distributedContext.at("item_" + std::to_string(item)));
+    }
+    std::size_t storedActions = 0;
+    for (const auto& action : distributedFlow.getRunActions()) storedActions += action == std::optional<std::string>("stored");
+    std::cout << "Distributed Test: sum of 'item_*': " << itemSum << " (Expected: 60)" << std::endl;
+    std::cout << "Distributed Test: 'stored' run actions: " << storedActions << " (Expected: 4)" << std::endl;
+    std::cout << std::endl;
+
+
+    // --- Incremental Re-run Test Example ---
+    // Only "y" changes between the runs, so the step reading "x" is replayed
+    std::cout << "--- Running Incremental Re-run Test Workflow ---" << std::endl;
+    auto doubleX = std::make_shared<SumKeysNode>(std::vector<std::string>{"x", "x"}, "a");
+    auto copyY = std::make_shared<SumKeysNode>(std::vector<std::string>{"y"}, "b");
+    auto addAB = std::make_shared<SumKeysNode>(std::vector<std::string>{"a", "b"}, "sum");
+    doubleX->next(copyY)->next(addAB);
+    Flow incrementalFlow(doubleX);
+    incrementalFlow.setIncremental();
+
+    Context firstInputs;
+    firstInputs["x"] = 1;
+    firstInputs["y"] = 2;
+    incrementalFlow.run(firstInputs);
+    Context secondInputs; // A fresh context: "x" matches by value hash, not by version
+    secondInputs["x"] = 1;
+    secondInputs["y"] = 5;
+    incrementalFlow.run(secondInputs);
+
+    IncrementalStats incrementalStats = incrementalFlow.getIncrementalStats();
+    std::cout << "Incremental Test: executed/replayed steps: " << incrementalStats.executed << "/"
+              << incrementalStats.replayed << " (Expected: 5/1)" << std::endl;
+    std::cout << "Incremental Test: 'x' node executions: " << doubleX->executions << " (Expected: 1)" << std::endl;
+    std::cout << "Incremental Test: 'a' and 'sum' after the re-run: " << std::any_cast<int>(secondInputs.at("a")) << ", "
+              << std::any_cast<int>(secondInputs.at("sum")) << " (Expected: 2, 7)" << std::endl;
+    std::cout << std::endl;
+
+
+    // --- Checkpoint Resume Test Example ---
+    // The second step fails once; running again with the same log resumes after the first
+    std::cout << "--- Running Checkpoint Resume Test Workflow ---" << std::endl;
+    auto firstStep = std::make_shared<FlakyStepNode>();
+    auto secondStep = std::make_shared<FlakyStepNode>(1);
+    firstStep->next(secondStep);
+    Flow checkpointFlow(firstStep);
+    const std::string checkpointPath = "cognitoflow_example.ckpt";
+    checkpointFlow.setCheckpoint(std::make_shared<CheckpointLog>(
+        checkpointPath, CheckpointOptions{std::make_shared<SnapshotContextCodec>()}));
+    Context checkpointContext;
+    try {
+        checkpointFlow.run(checkpointContext);
+    } catch (const std::exception&) {
+        std::cout << "Checkpoint Test: first run failed as planned" << std::endl;
+    }
+    checkpointFlow.run(checkpointContext);
+    checkpointFlow.setCheckpoint(nullptr);
+    std::remove(checkpointPath.c_str());
+
+    std::cout << "Checkpoint Test: first step executions: " << firstStep->executions
+              << " (Expected: 1)" << std::endl;
+    std::cout << "Checkpoint Test: second step executions: " << secondStep->executions
+              << " (Expected: 2)" << std::endl;
+    std::cout << std::endl;
+
+
     return 0;
 }